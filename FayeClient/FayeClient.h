@@ -27,6 +27,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "FayeMessageFilter.h"
 
 #define kFayeErrorDomain @"FayeErrorDomain"
 
@@ -52,10 +53,36 @@ typedef NS_ENUM(NSInteger, FayeClientConnectionStatus) {
     FayeClientConnectionStatusDisconnecting
 };
 
+typedef NS_OPTIONS(NSUInteger, FayeChannelSubscriptionOptions) {
+    FayeChannelSubscriptionOptionsNone = 0,
+    // Keep the latest message on each matching channel for lastMessageOnChannel:
+    FayeChannelSubscriptionOptionCacheLastValue = 1 << 0,
+    // While earlier messages are still waiting to be handled, newer ones replace
+    // them instead of queueing up behind them.  See setConflationKeyPath:forChannel:
+    FayeChannelSubscriptionOptionConflate = 1 << 1,
+    // Messages carry a per-channel ext.seq from the server.  Out-of-order
+    // messages are held back until the gap fills, and resubscribing asks the
+    // server to replay whatever was missed while disconnected.
+    FayeChannelSubscriptionOptionSequenced = 1 << 2,
+    // Message data is handed over as the encoded JSON bytes of the `data`
+    // member, undecoded.  Use subscribeToChannel:options:rawMessageHandler:completionHandler:
+    FayeChannelSubscriptionOptionRawData = 1 << 3,
+    // Message data is a dictionary that decodes each field the first time
+    // it's read, for handlers that only look at part of a large payload.
+    FayeChannelSubscriptionOptionLazyDecode = 1 << 4
+};
+
+typedef NS_ENUM(NSInteger, FayeClientMessageEncoding) {
+    FayeClientMessageEncodingJSON,
+    FayeClientMessageEncodingMessagePack
+};
+
 @class FayeClient;
 typedef void(^FayeClientChannelMessageHandlerBlock)(FayeClient *client, NSString* channelPath, NSDictionary *messageDict);
+typedef void(^FayeClientChannelRawMessageHandlerBlock)(FayeClient *client, NSString* channelPath, NSData *messageData);
 typedef void(^FayeClientChannelSubscriptionStatusHandlerBlock)(FayeClient *client, NSString* channelPath, FayeChannelSubscriptionStatus subscriptionStatus);
 typedef void(^FayeClientConnectionStatusHandlerBlock)(FayeClient *client, NSError *error);
+typedef void(^FayeClientRequestCompletionHandlerBlock)(FayeClient *client, NSDictionary *response, NSError *error);
 
 @protocol FayeClientDelegate <NSObject>
 @optional
@@ -80,21 +107,152 @@ typedef void(^FayeClientConnectionStatusHandlerBlock)(FayeClient *client, NSErro
 // respectively.  It's perfectly OK to block returning from these methods until your
 // data delegate has finished its work, but keep in mind that blocking for too long
 // may cause the server to time your client out.
+// Interceptors (below) do the same a batch at a time, and without decoding
+// everything that comes in.
 - (NSDictionary*) fayeClient: (FayeClient*) client willSendMessage: (NSDictionary*) message;
 - (NSDictionary*) fayeClient: (FayeClient*) client willReceiveMessage: (NSDictionary*) message;
 @end
 
+typedef void(^FayeClientInterceptorNextBlock)(NSData *data);
+
+@protocol FayeClientInterceptor <NSObject>
+@optional
+/** The data stages see each batch as the bytes that come off or go on the
+ wire, on the client's network queue, and pass it along by calling `next`
+ exactly once, from any thread, with the same or different bytes (nil drops
+ the batch).  There's no hurry, up to interceptorTimeout: later batches wait
+ their turn behind it, but the read and write queues carry on with what they
+ have.  Dropping a long-polling request stalls the connection until it times
+ out.  Handshakes raced across servers aren't intercepted. */
+- (void) fayeClient: (FayeClient*) client
+     didReceiveData: (NSData*) data
+               next: (FayeClientInterceptorNextBlock) next;
+- (void) fayeClient: (FayeClient*) client
+       willSendData: (NSData*) data
+               next: (FayeClientInterceptorNextBlock) next;
+/** Every outgoing batch as message dictionaries, on the write queue just
+ before it's encoded.  Return the messages to send. */
+- (NSArray*) fayeClient: (FayeClient*) client willSendMessages: (NSArray*) messages;
+@end
+
 
 
 @interface FayeClient : NSObject
 @property (nonatomic, weak) id <FayeClientDelegate> delegate;
 @property (nonatomic, weak) id <FayeClientDataDelegate> dataDelegate;
+// In the order they run; see addInterceptor:
+@property (nonatomic, readonly) NSArray *interceptors;
+/** How long a data stage gets to call `next` before its batch is dropped.
+ Disconnecting drops whatever is still on its way through, too; `next`
+ called after either is ignored.  Defaults to 10 seconds; zero waits forever. */
+@property (nonatomic, assign) NSTimeInterval interceptorTimeout;
 @property (nonatomic, readonly) NSSet *subscribedChannels;
 @property (nonatomic, copy) NSDictionary *extension;
 @property (nonatomic, copy) NSDictionary *handshakeExtension;
 @property (nonatomic, copy) NSDictionary *connectExtension;
 @property (nonatomic, assign) NSTimeInterval timeout;
+/** The encoding to ask the server for during the handshake.  Binary encodings
+ are only used over WebSockets, and only if the server agrees to them in its
+ handshake response; otherwise the client quietly stays on JSON. */
+@property (nonatomic, assign) FayeClientMessageEncoding preferredMessageEncoding;
+/** Largest frame (WebSocket message or long-polling request body) to send, in
+ bytes.  Batches are split across as many frames as it takes, keeping their
+ order, and publishes that won't fit on their own are sent in chunks for
+ subscribers to reassemble.  The limit is also passed to the server in the
+ handshake.  Zero (the default) means no limit. */
+@property (nonatomic, assign) NSUInteger maximumFrameSize;
+/** HTTP servers only.  Ask to receive messages over a Server-Sent Events
+ (EventSource) stream instead of long-polling, so there's no request to re-open
+ after every delivery.  Publishes and subscriptions still go up as ordinary
+ POSTs, one at a time, alongside the /meta/connect heartbeat.  Falls back to
+ long-polling if the server doesn't offer it. */
+@property (nonatomic, assign) BOOL prefersEventSource;
+/** WebSocket heartbeats.  Every heartbeatInterval seconds the client pings the
+ server, and waits for the pong, or anything else from the server, within an
+ adaptive deadline (the smoothed round-trip time plus four deviations, at most
+ the interval itself).  If two pings in a row go unanswered the connection is
+ given up on and the next best server tried.  Without them a dead socket is
+ only noticed once the server's timeout advice has run out.  Zero (the default) disables heartbeats. */
+@property (nonatomic, assign) NSTimeInterval heartbeatInterval;
+/** Happy eyeballs.  Instead of trying servers one at a time, connecting
+ handshakes with the best server and then, every raceStaggerInterval seconds
+ (default 0.25) it goes unanswered, the next best as well.  The first to
+ complete its handshake is kept and the rest are dropped.  Needs more than
+ one server; off by default. */
+@property (nonatomic, assign) BOOL racesServers;
+@property (nonatomic, assign) NSTimeInterval raceStaggerInterval;
+// Smoothed ping round-trip time to the current server; zero until measured.
+@property (nonatomic, readonly) NSTimeInterval roundTripTime;
+/** Where message handlers, completion handlers and delegate methods are called.
+ Defaults to the main queue; setting nil restores it.  Networking always runs
+ on the client's own queues, so a busy callback queue only slows delivery, not
+ the connection.  Set it before connecting. */
+@property (nonatomic, strong) dispatch_queue_t callbackQueue;
 @property (nonatomic, readonly, assign) FayeClientConnectionStatus connectionStatus;
+/** Limits for the last-value cache used by FayeChannelSubscriptionOptionCacheLastValue
+ subscriptions.  The least recently read or written channels are evicted first.
+ Defaults are 1000 channels and 4MB (approximate); zero means unlimited. */
+@property (nonatomic, assign) NSUInteger lastValueCacheCountLimit;
+@property (nonatomic, assign) NSUInteger lastValueCacheMemoryLimit;
+// Number of messages dropped in favour of newer ones by conflating subscriptions.
+@property (nonatomic, readonly) NSUInteger conflatedMessageCount;
+/** Backpressure.  Once deliveryHighWatermark messages are waiting to be handled
+ on the callback queue, further messages are held back inside the client, and
+ long-polling stops asking for more by holding back the next /meta/connect,
+ until the backlog drains to deliveryLowWatermark.  Meta traffic and the
+ connection timeout carry on as normal.  Zero (the default) disables it. */
+@property (nonatomic, assign) NSUInteger deliveryHighWatermark;
+// Must not be above the high watermark; a value that is is ignored.
+@property (nonatomic, assign) NSUInteger deliveryLowWatermark;
+/** While throttled, conflating subscriptions keep only the newest held message
+ per channel.  Past heldMessageLimit held messages (default 10000, zero for no
+ limit) the oldest are dropped.  Disconnecting discards them all. */
+@property (nonatomic, assign) NSUInteger heldMessageLimit;
+@property (nonatomic, readonly) NSUInteger droppedMessageCount;
+// Total time spent throttled, and how many times it happened.
+@property (nonatomic, readonly) NSTimeInterval throttledTimeInterval;
+@property (nonatomic, readonly) NSUInteger throttleCount;
+/** Duplicate suppression.  Messages whose channel, id and publisher match one
+ of the last duplicateSuppressionHorizon messages received are dropped.  This
+ catches server replays after reconnects and failover.  Message ids are only
+ unique per publishing client, so the publisher is its clientId when the
+ server passes that on, and otherwise the ext value at
+ duplicateSuppressionExtensionKey; messages with neither are never treated
+ as duplicates.  Zero (the default) disables it. */
+@property (nonatomic, assign) NSUInteger duplicateSuppressionHorizon;
+@property (nonatomic, copy) NSString *duplicateSuppressionExtensionKey;
+@property (nonatomic, readonly) NSUInteger suppressedDuplicateCount;
+/** Local echo.  Publishing to a channel we're subscribed to hands the message
+ to the matching handlers straight away, rather than once the server has sent
+ it back, and the copy that does come back is dropped.  Filters still apply;
+ sequenced subscriptions are left to the server.  Off by default. */
+@property (nonatomic, assign) BOOL deliversPublishesLocally;
+/** How long sequenced subscriptions wait for a gap to be filled before giving
+ up on the missing messages (default 2 seconds), and how many messages they'll
+ hold back meanwhile (default 256). */
+@property (nonatomic, assign) NSTimeInterval sequenceGapTimeout;
+@property (nonatomic, assign) NSUInteger sequenceReorderLimit;
+// Messages on sequenced subscriptions that were never recovered.
+@property (nonatomic, readonly) NSUInteger lostSequencedMessageCount;
+// Messages turned away by subscription filters.  See setFilter:forChannel:
+@property (nonatomic, readonly) NSUInteger filteredMessageCount;
+/** Reconnecting after a dropped connection picks the session back up with a
+ /meta/connect for the existing client ID, rather than handshaking and
+ resubscribing to every channel.  If the server has forgotten the client it
+ advises a handshake, which then happens straight away over the same
+ connection.  Publishes sent while it was finding that out are sent again
+ under the new client ID.  Defaults to YES. */
+@property (nonatomic, assign) BOOL reusesClientID;
+/** Bayeux allows a list of channels in one /meta/subscribe or
+ /meta/unsubscribe, and with this set setSubscribedChannels: sends each change
+ as a single message.  Server extensions that expect `subscription` to be a
+ string will reject (or choke on) those, so it's off by default.  If a list is
+ refused anyway, its channels are retried one message each and this is turned
+ back off. */
+@property (nonatomic, assign) BOOL batchesSubscriptions;
+// Requests (see sendRequest:) awaiting replies at any one time; any more wait
+// their turn.  Zero (the default) means no limit.
+@property (nonatomic, assign) NSUInteger maximumConcurrentRequests;
 // Should we make this read/write?  Discuss.
 @property (nonatomic, readonly) NSString *clientID;
 @property (nonatomic, assign) BOOL debug;
@@ -104,6 +262,17 @@ typedef void(^FayeClientConnectionStatusHandlerBlock)(FayeClient *client, NSErro
 
 - (void) addServerWithURL: (NSURL*) url;
 
+/** Interceptors run in the order they were added, in both directions.  With
+ none, the traffic doesn't go near them. */
+- (void) addInterceptor: (id <FayeClientInterceptor>) interceptor;
+- (void) removeInterceptor: (id <FayeClientInterceptor>) interceptor;
+
+/** Gets ready to connect: looks up every server's host name ahead of time
+ (the answers are kept for as long as their DNS records allow) and opens a
+ connection to each HTTP(S) server, which the real requests then reuse, TLS
+ and all.  For WebSocket servers only the lookup is done.  Servers whose names
+ don't resolve are tried last.  Call it as early as you like. */
+- (void) prewarm;
 - (void) connect;
 - (void) connectWithConnectionStatusChangedHandler: (FayeClientConnectionStatusHandlerBlock) handler;
 - (void) disconnect;
@@ -114,6 +283,32 @@ typedef void(^FayeClientConnectionStatusHandlerBlock)(FayeClient *client, NSErro
 - (void) subscribeToChannel: (NSString *) channel
              messageHandler: (FayeClientChannelMessageHandlerBlock) messageHandler
           completionHandler: (dispatch_block_t) completionHandler;
+- (void) subscribeToChannel: (NSString *) channel
+                    options: (FayeChannelSubscriptionOptions) options
+             messageHandler: (FayeClientChannelMessageHandlerBlock) messageHandler
+          completionHandler: (dispatch_block_t) completionHandler;
+/** The handler gets each message's data as JSON bytes, sliced straight out of
+ the received frame where possible (re-encoded if it arrived as MessagePack).
+ Implies FayeChannelSubscriptionOptionRawData. */
+- (void) subscribeToChannel: (NSString *) channel
+                    options: (FayeChannelSubscriptionOptions) options
+          rawMessageHandler: (FayeClientChannelRawMessageHandlerBlock) messageHandler
+          completionHandler: (dispatch_block_t) completionHandler;
+/** Returns the most recent message data received on the given (concrete, not
+ wildcard) channel, provided a subscription with FayeChannelSubscriptionOptionCacheLastValue
+ matches it.  Safe to call from any thread; never waits on message delivery. */
+- (NSDictionary*) lastMessageOnChannel: (NSString*) channel;
+/** By default a conflating subscription keeps one pending message per channel.
+ Give it a key path into the message data (e.g. @"symbol") to keep one per
+ distinct value instead.  The channel must already be subscribed to. */
+- (void) setConflationKeyPath: (NSString*) keyPath
+                   forChannel: (NSString*) channel;
+- (NSUInteger) conflatedMessageCountForChannel: (NSString*) channel;
+/** Only messages matching `filter` are delivered on this subscription (nil
+ removes it).  Messages without data, such as publish acknowledgements, are
+ never filtered.  The channel must already be subscribed to. */
+- (void) setFilter: (FayeMessageFilter*) filter
+        forChannel: (NSString*) channel;
 /** Note that if you want this extension to be included in the subscription
  message, you must call this BEFORE calling subscribeToChannel */
 - (void) setExtension: (NSDictionary*) extension
@@ -123,6 +318,34 @@ typedef void(^FayeClientConnectionStatusHandlerBlock)(FayeClient *client, NSErro
 - (void) unsubscribeFromChannel: (NSString*) channel
               completionHandler: (dispatch_block_t) handler;
 
+/** Makes `channels` the set of channels subscribed with subscribeToChannel:.
+ Only the difference from the current set is sent (see batchesSubscriptions).
+ Channels already subscribed keep their handlers and options; new ones get
+ `messageHandler`.  Handler tokens are unaffected.  The completion handler runs
+ once, when the server has answered for every change (or straight away if
+ there's nothing to change).  A channel the server refused is left
+ unsubscribed; check subscriptionStatusForChannel: if it matters. */
+- (void) setSubscribedChannels: (NSSet*) channels;
+- (void) setSubscribedChannels: (NSSet*) channels
+                messageHandler: (FayeClientChannelMessageHandlerBlock) messageHandler
+             completionHandler: (dispatch_block_t) completionHandler;
+
+/** Shared subscriptions.  Any number of handlers can be added to a channel and
+ removed again independently, by token.  The server is subscribed when the
+ first arrives and unsubscribed once the last is gone (subscribeToChannel:
+ counts as one more, until unsubscribeFromChannel:).  A channel that an
+ existing wildcard subscription covers, such as /foo/bar under /foo/*, isn't
+ subscribed with the server at all: its handlers are fed from the wildcard's
+ messages, unless the wildcard has a filter or conflates or sequences them.
+ The completion handler runs once the messages are flowing.  Options, filters
+ and extensions belong to the subscription the handlers hang off, not to the
+ handlers: a locally fed channel's are the wildcard's, so giving the wildcard a
+ filter or conflation key path later applies to them as well. */
+- (id) addHandlerToChannel: (NSString*) channel
+            messageHandler: (FayeClientChannelMessageHandlerBlock) messageHandler
+         completionHandler: (dispatch_block_t) completionHandler;
+- (void) removeHandler: (id) token;
+
 - (void) sendMessage: (NSDictionary*) message
            toChannel: (NSString*) channel;
 - (void) sendMessage: (NSDictionary*) message
@@ -133,4 +356,30 @@ typedef void(^FayeClientConnectionStatusHandlerBlock)(FayeClient *client, NSErro
            extension: (NSDictionary*) extension
    completionHandler: (dispatch_block_t) handler;
 
+/** Request/response.  The message is published to `channel` with
+ ext.replyTo, naming a reply channel (/replies/<random>) that the client
+ subscribes to once, the first time it's needed, and ext.correlationId.  The
+ responder publishes its answer to the reply channel with the same
+ ext.correlationId, or sets ext.error to fail the request.  The handler gets
+ the answer's data, or an error if none arrives within `timeout` (the client's
+ timeout, for the shorter form).  "Sample Server/rpc.js" is a responder. */
+- (void) sendRequest: (NSDictionary*) message
+           toChannel: (NSString*) channel
+   completionHandler: (FayeClientRequestCompletionHandlerBlock) handler;
+- (void) sendRequest: (NSDictionary*) message
+           toChannel: (NSString*) channel
+             timeout: (NSTimeInterval) timeout
+   completionHandler: (FayeClientRequestCompletionHandlerBlock) handler;
+
+/** Session persistence.  Saves the servers (failure counts, advice, round-trip
+ times and client IDs), the subscriptions and any publishes that haven't gone
+ out yet to a compact binary property list.  Restoring that into a new,
+ disconnected client before connecting lets it resume the old session straight
+ away (see reusesClientID) and steer clear of servers that were failing.
+ Handlers and filters can't be saved, so subscribe again after restoring to
+ reattach them; channels the server still has us on aren't resubscribed.
+ Restored publishes are sent once connected, without completion handlers. */
+- (BOOL) writeSessionToURL: (NSURL*) url error: (NSError**) error;
+- (BOOL) restoreSessionFromURL: (NSURL*) url error: (NSError**) error;
+
 @end
@@ -30,9 +30,52 @@
 #import "FayeMessage.h"
 #import "FayeChannel.h"
 #import "FayeServer.h"
+#import "FayeMessagePack.h"
+#import "FayeLastValueCache.h"
+#import "FayeMessageDispatcher.h"
+#import "FayeMessageIDWindow.h"
+#import "FayeSequenceTracker.h"
+#import "FayeJSONScanner.h"
+#import "FayeLazyJSONDictionary.h"
+#import "FayeChannelNameTable.h"
+#import "FayeMessagePool.h"
+#import "FayeMessageChunker.h"
+#import "FayeEventSourceParser.h"
+#import "FayeConnectionRace.h"
+#import "FayeHostCache.h"
+#import "FayeRequestTable.h"
+#import "FayeInterceptorChain.h"
+#import "FayeWeakDelegate.h"
 #import "SRWebSocket.h"
+#import <pthread.h>
+#import <stdatomic.h>
 
 static NSString * const FayeClientBayeuxVersion = @"1.0";
+static NSString * const FayeClientMessagePackEncodingName = @"msgpack";
+static NSString * const FayeClientJSONEncodingName = @"json";
+// Names that didn't come through the interning table can't hit in the
+// routing cache, so don't let them pile up in it either.
+static const NSUInteger FayeClientRoutingCacheLimit = 4096;
+// Don't declare a connection dead just because one pong was a little late.
+static const NSTimeInterval FayeClientMinimumHeartbeatDeadline = 1.0;
+// Pings in a row that can go unanswered before the connection is given up on.
+static const NSUInteger FayeClientMaximumMissedHeartbeats = 2;
+static const NSInteger FayeClientSessionVersion = 1;
+// Local echoes remembered while waiting for the server's copy.
+static const NSUInteger FayeClientLocalEchoHorizon = 1024;
+
+// One-shot timers on the network queue.  Scheduling an armed timer pushes it
+// back; cancelling just disarms it so it can be scheduled again later.
+static void FayeClientScheduleTimer(dispatch_source_t timer, NSTimeInterval delay)
+{
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)),
+                              DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 20);
+}
+
+static void FayeClientCancelTimer(dispatch_source_t timer)
+{
+    dispatch_source_set_timer(timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+}
 
 NSString * const FayeClientHandshakeChannel = @"/meta/handshake";
 NSString * const FayeClientConnectChannel = @"/meta/connect";
@@ -45,8 +88,19 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
 @interface FayeMessageQueueItem : NSObject
 @property (nonatomic, copy) FayeMessageQueueItemGetMessageBlock block;
 @property (nonatomic, copy) dispatch_block_t sentMessageHandler;
+// Channel, data and ext of a publish, for saving with the session.
+@property (nonatomic, copy) NSDictionary *publication;
 @end
 
+static NSString *FayeMessageQueueItemSubscriptionDescription(NSDictionary *message)
+{
+    id subscription = message[@"subscription"];
+    if ([subscription isKindOfClass: [NSArray class]]) {
+        return [NSString stringWithFormat: @"%lu channels", (unsigned long) [subscription count]];
+    }
+    return subscription;
+}
+
 @implementation FayeMessageQueueItem
 + (instancetype) itemWithBlock: (FayeMessageQueueItemGetMessageBlock) block
 {
@@ -67,30 +121,87 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
         } else if ([d[@"channel"] isEqualToString: FayeClientDisconnectChannel]) {
             desc = @"disconnect";
         } else if ([d[@"channel"] isEqualToString: FayeClientSubscribeChannel]) {
-            desc = [NSString stringWithFormat: @"subscribe %@", d[@"subscription"]];
+            desc = [NSString stringWithFormat: @"subscribe %@", FayeMessageQueueItemSubscriptionDescription(d)];
         } else if ([d[@"channel"] isEqualToString: FayeClientUnsubscribeChannel]) {
-            desc = [NSString stringWithFormat: @"unsubscribe %@", d[@"subscription"]];
+            desc = [NSString stringWithFormat: @"unsubscribe %@", FayeMessageQueueItemSubscriptionDescription(d)];
         }
     }
     return [NSString stringWithFormat: @"<%@: %p> (%@)", self.class, self, desc];
 }
 @end
 
-@interface FayeClient () <SRWebSocketDelegate, NSURLConnectionDataDelegate, NSURLConnectionDelegate>
+@interface FayeClient () <SRWebSocketDelegate, NSURLSessionDataDelegate>
 @property (nonatomic, retain) SRWebSocket* webSocket;
 @property (nonatomic, strong) NSMutableDictionary *subscriptions;
 @property (nonatomic, strong) NSFileHandle *logFile;
 @property (nonatomic, strong) FayeServer *currentServer;
 @property (nonatomic, strong) NSMutableDictionary *servers;
 @property (nonatomic, copy) FayeClientConnectionStatusHandlerBlock connectionStatusHandler;
-@property (nonatomic, strong) NSURLResponse *lastResponse;
 @property (strong) NSMutableArray *queuedMessages;
 @property (strong) NSMutableArray *alternateQueue;
-@property (nonatomic, strong) NSURLConnection *httpConnection;
-@property (nonatomic, strong) NSMutableData *httpData;
 @property (nonatomic, strong) NSMutableDictionary *sentMessageHandlers;
-@property (nonatomic, assign) dispatch_queue_t readQueue;
-@property (nonatomic, assign) dispatch_queue_t writeQueue;
+// Outgoing (un)subscribes awaiting replies, by message ID.  @synchronized.
+@property (nonatomic, strong) NSMutableDictionary *subscriptionRequests;
+@property (nonatomic, strong) FayeLastValueCache *lastValueCache;
+@property (nonatomic, strong) FayeMessageDispatcher *messageDispatcher;
+// Only touched on the read queue.
+@property (nonatomic, strong) FayeMessageIDWindow *duplicateWindow;
+@property (nonatomic, readwrite) NSUInteger suppressedDuplicateCount;
+// Read queue only.  IDs of publishes already delivered locally.
+@property (nonatomic, strong) FayeMessageIDWindow *echoWindow;
+// Starts the ID of every locally delivered publish, and no other client's.
+@property (nonatomic, copy) NSString *echoIDPrefix;
+@property (nonatomic, readwrite) NSUInteger filteredMessageCount;
+@property (nonatomic, strong) FayeSequenceTracker *sequenceTracker;
+// Read queue only.  Routing results are cached against the interned channel
+// names, keyed by pointer, until the subscriptions or the names change.
+@property (nonatomic, strong) FayeChannelNameTable *channelNames;
+@property (nonatomic, strong) NSMapTable *routingCache;
+@property (nonatomic, strong) FayeMessagePool *messagePool;
+// Read queue only.
+@property (nonatomic, strong) FayeMessageChunker *chunker;
+// Read queue only.  Messages held back while delivery is throttled, in order,
+// and the ones that later messages on the same channel may replace.
+@property (nonatomic, strong) NSMutableArray *heldMessages;
+@property (nonatomic, strong) NSMutableDictionary *conflatableHeldMessages;
+@property (nonatomic, readwrite) NSUInteger droppedMessageCount;
+// Write queue only.  Long-polling frames still to go, one per request.
+@property (nonatomic, strong) NSMutableArray *pendingUploadFrames;
+// Network queue only.  The long-poll (or connect heartbeat), the EventSource
+// receive stream, and the one publish POST allowed in flight beside it.
+@property (nonatomic, strong) NSURLSession *urlSession;
+@property (nonatomic, strong) NSURLSessionDataTask *httpTask;
+@property (nonatomic, strong) NSMutableData *httpData;
+@property (nonatomic, strong) NSURLSessionDataTask *eventSourceTask;
+@property (nonatomic, strong) FayeEventSourceParser *eventSourceParser;
+@property (nonatomic, strong) NSURLSessionDataTask *publishTask;
+@property (nonatomic, strong) NSMutableData *publishData;
+@property (nonatomic, strong) dispatch_queue_t readQueue;
+@property (nonatomic, strong) dispatch_queue_t writeQueue;
+// Network queue only.
+@property (nonatomic, strong) FayeConnectionRace *connectionRace;
+@property (nonatomic, strong) FayeHostCache *hostCache;
+// Any queue.  Hosts the cache last failed to resolve, for sortedServers.
+@property (atomic, copy) NSSet *unresolvableHosts;
+// Set while a reconnect's /meta/connect for the old client ID is unanswered.
+@property (atomic, assign) BOOL resumingSession;
+@property (atomic, copy) NSArray *interceptors;
+// Those that take whole outgoing batches as messages.
+@property (atomic, copy) NSArray *messageInterceptors;
+// Network queue only.  Bytes on their way in and out.
+@property (nonatomic, strong) FayeInterceptorChain *incomingChain;
+@property (nonatomic, strong) FayeInterceptorChain *outgoingChain;
+// Read queue only.  Requests awaiting replies.
+@property (nonatomic, strong) FayeRequestTable *requestTable;
+// Where replies to our requests come back, once subscribed.
+@property (atomic, copy) NSString *replyChannel;
+// Publishes (as JSON) restored from a saved session, waiting for a connection.
+@property (nonatomic, strong) NSMutableArray *restoredPublications;
+// Publishes sent under a client ID the server hasn't yet confirmed it still
+// knows.  @synchronized.
+@property (nonatomic, strong) NSMutableArray *unconfirmedPublications;
+// Transport callbacks and timers all run here, never on the main queue.
+@property (nonatomic, strong) dispatch_queue_t networkQueue;
 
 - (void) _debugMessage: (NSString*) format, ... NS_FORMAT_FUNCTION(1,2);
 
@@ -112,6 +223,33 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     
     NSInteger _nextSortIndex;
     NSInteger _messageID;
+    BOOL _publishInFlight;
+    
+    dispatch_source_t _timeoutTimer;
+    dispatch_source_t _sendTimer;
+    dispatch_source_t _connectTimer;
+    
+    // Network queue only.
+    dispatch_source_t _pingTimer;
+    dispatch_source_t _pongTimer;
+    uint64_t _pingSequence;
+    CFAbsoluteTime _pingSentTime;
+    BOOL _awaitingPong;
+    NSUInteger _missedPongs;
+    
+    atomic_uint_fast64_t _echoCount;
+    atomic_int _subscriptionsGeneration;
+    int32_t _routingCacheSubscriptionsGeneration;
+    NSUInteger _routingCacheNamesGeneration;
+    
+    pthread_mutex_t _throttleLock;
+    struct {
+        BOOL active;
+        BOOL pollDeferred;
+        NSUInteger count;
+        CFAbsoluteTime startTime;
+        NSTimeInterval totalTime;
+    } _throttle;
 }
 
 #pragma mark - Initialization
@@ -124,19 +262,96 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
         self.subscriptions = [NSMutableDictionary dictionary];
         self.queuedMessages = [NSMutableArray array];
         self.sentMessageHandlers = [NSMutableDictionary dictionary];
+        self.subscriptionRequests = [NSMutableDictionary dictionary];
         self.timeout = 10;
+        self.raceStaggerInterval = 0.25;
+        self.reusesClientID = YES;
+        self.restoredPublications = [NSMutableArray array];
+        self.unconfirmedPublications = [NSMutableArray array];
         self.handshakeExtension = @{};
         self.connectExtension = @{};
         self.extension = @{};
         self.httpData = [NSMutableData data];
         self.debugLogFileName = @"faye.log";
+        self.echoIDPrefix = [NSString stringWithFormat: @"_%08x.", arc4random()];
         _nextSortIndex = 0;
         self.readQueue = dispatch_queue_create("com.sudeium.fayeclient-readqueue", DISPATCH_QUEUE_SERIAL);
         self.writeQueue = dispatch_queue_create("com.sudeium.fayeclient-writequeue", DISPATCH_QUEUE_SERIAL);
+        self.networkQueue = dispatch_queue_create("com.sudeium.fayeclient-networkqueue", DISPATCH_QUEUE_SERIAL);
+        self.hostCache = [[FayeHostCache alloc] initWithQueue: self.networkQueue];
+        _callbackQueue = dispatch_get_main_queue();
+        self.lastValueCache = [FayeLastValueCache new];
+        self.lastValueCache.countLimit = 1000;
+        self.lastValueCache.costLimit = 4 * 1024 * 1024;
+        self.messageDispatcher = [[FayeMessageDispatcher alloc] initWithQueue: _callbackQueue];
+        pthread_mutex_init(&_throttleLock, NULL);
+        __weak FayeClient *weakSelf = self;
+        self.messageDispatcher.throttleHandler = ^(BOOL throttled) {
+            [weakSelf setDeliveryThrottled: throttled];
+        };
+        _timeoutTimer = [self timerWithHandler: ^(FayeClient *client) {
+            [client failWithTimeout];
+        }];
+        _sendTimer = [self timerWithHandler: ^(FayeClient *client) {
+            [client sendMessagesAndEmptyQueue];
+        }];
+        _connectTimer = [self timerWithHandler: ^(FayeClient *client) {
+            [client startHTTPConnection];
+        }];
+        _pingTimer = [self timerWithHandler: ^(FayeClient *client) {
+            [client sendHeartbeat];
+        }];
+        _pongTimer = [self timerWithHandler: ^(FayeClient *client) {
+            [client heartbeatDidTimeOut];
+        }];
+        self.channelNames = [FayeChannelNameTable new];
+        self.messagePool = [[FayeMessagePool alloc] initWithCapacity: 16];
+        self.chunker = [FayeMessageChunker new];
+        self.heldMessages = [NSMutableArray new];
+        self.conflatableHeldMessages = [NSMutableDictionary new];
+        self.heldMessageLimit = 10000;
+        self.pendingUploadFrames = [NSMutableArray array];
+        self.routingCache = [NSMapTable mapTableWithKeyOptions: NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality
+                                                  valueOptions: NSPointerFunctionsStrongMemory];
+        self.sequenceTracker = [[FayeSequenceTracker alloc] initWithQueue: self.readQueue];
+        self.interceptors = @[];
+        self.messageInterceptors = @[];
+        self.incomingChain = [[FayeInterceptorChain alloc] initWithQueue: self.networkQueue
+                                                                selector: @selector(fayeClient:didReceiveData:next:)
+                                                                   stage: ^(id interceptor, NSData *data, FayeInterceptorChainNextBlock next) {
+            [interceptor fayeClient: weakSelf didReceiveData: data next: next];
+        }];
+        self.outgoingChain = [[FayeInterceptorChain alloc] initWithQueue: self.networkQueue
+                                                                selector: @selector(fayeClient:willSendData:next:)
+                                                                   stage: ^(id interceptor, NSData *data, FayeInterceptorChainNextBlock next) {
+            [interceptor fayeClient: weakSelf willSendData: data next: next];
+        }];
+        self.interceptorTimeout = 10;
+        self.requestTable = [[FayeRequestTable alloc] initWithQueue: self.readQueue];
+        // Until the reply channel is subscribed.
+        self.requestTable.suspended = YES;
+        self.sequenceTracker.flushHandler = ^(NSArray *messages) {
+            [weakSelf deliverSequencedMessages: messages];
+        };
     }
     return self;
 }
 
+- (dispatch_source_t) timerWithHandler: (void(^)(FayeClient *client)) handler
+{
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.networkQueue);
+    __weak FayeClient *weakSelf = self;
+    dispatch_source_set_event_handler(timer, ^{
+        FayeClient *client = weakSelf;
+        if (client != nil) {
+            handler(client);
+        }
+    });
+    FayeClientCancelTimer(timer);
+    dispatch_resume(timer);
+    return timer;
+}
+
 + (instancetype) fayeClientWithURL:(NSURL *)url
 {
     FayeClient *client = [[self alloc] init];
@@ -158,6 +373,46 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     [self _debugMessage: @"Registered server: %@", url.absoluteString];
 }
 
+- (NSTimeInterval) interceptorTimeout
+{
+    return self.incomingChain.stageTimeout;
+}
+
+- (void) setInterceptorTimeout:(NSTimeInterval)interceptorTimeout
+{
+    self.incomingChain.stageTimeout = interceptorTimeout;
+    self.outgoingChain.stageTimeout = interceptorTimeout;
+}
+
+- (void) addInterceptor:(id<FayeClientInterceptor>)interceptor
+{
+    @synchronized (self.incomingChain) {
+        if (interceptor == nil || [self.interceptors indexOfObjectIdenticalTo: interceptor] != NSNotFound) {
+            return;
+        }
+        self.interceptors = [self.interceptors arrayByAddingObject: interceptor];
+        if ([interceptor respondsToSelector: @selector(fayeClient:willSendMessages:)]) {
+            self.messageInterceptors = [self.messageInterceptors arrayByAddingObject: interceptor];
+        }
+        [self.incomingChain addInterceptor: interceptor];
+        [self.outgoingChain addInterceptor: interceptor];
+    }
+}
+
+- (void) removeInterceptor:(id<FayeClientInterceptor>)interceptor
+{
+    @synchronized (self.incomingChain) {
+        NSMutableArray *interceptors = self.interceptors.mutableCopy;
+        [interceptors removeObjectIdenticalTo: interceptor];
+        self.interceptors = interceptors;
+        NSMutableArray *messageInterceptors = self.messageInterceptors.mutableCopy;
+        [messageInterceptors removeObjectIdenticalTo: interceptor];
+        self.messageInterceptors = messageInterceptors;
+        [self.incomingChain removeInterceptor: interceptor];
+        [self.outgoingChain removeInterceptor: interceptor];
+    }
+}
+
 - (void) setDelegate:(id<FayeClientDelegate>)delegate
 {
     if (delegate != _delegate) {
@@ -182,11 +437,150 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     }
 }
 
+- (void) setCallbackQueue:(dispatch_queue_t)callbackQueue
+{
+    if (callbackQueue == nil) {
+        callbackQueue = dispatch_get_main_queue();
+    }
+    if (callbackQueue == _callbackQueue) {
+        return;
+    }
+    _callbackQueue = callbackQueue;
+    // Retargeted rather than replaced, so nothing already on its way is lost.
+    self.messageDispatcher.queue = callbackQueue;
+}
+
+- (NSTimeInterval) roundTripTime
+{
+    return self.currentServer.roundTripTime;
+}
+
 - (NSString*) clientID
 {
     return self.currentServer.clientID;
 }
 
+- (NSUInteger) lastValueCacheCountLimit
+{
+    return self.lastValueCache.countLimit;
+}
+
+- (void) setLastValueCacheCountLimit:(NSUInteger)lastValueCacheCountLimit
+{
+    self.lastValueCache.countLimit = lastValueCacheCountLimit;
+}
+
+- (NSUInteger) lastValueCacheMemoryLimit
+{
+    return self.lastValueCache.costLimit;
+}
+
+- (void) setLastValueCacheMemoryLimit:(NSUInteger)lastValueCacheMemoryLimit
+{
+    self.lastValueCache.costLimit = lastValueCacheMemoryLimit;
+}
+
+- (NSUInteger) conflatedMessageCount
+{
+    return self.messageDispatcher.conflatedCount;
+}
+
+- (NSUInteger) deliveryHighWatermark
+{
+    return self.messageDispatcher.highWatermark;
+}
+
+- (void) setDeliveryHighWatermark:(NSUInteger)deliveryHighWatermark
+{
+    if (deliveryHighWatermark > 0 && deliveryHighWatermark < self.deliveryLowWatermark) {
+        [self _debugMessage: @"Ignoring delivery high watermark %lu below the low watermark %lu.",
+         (unsigned long) deliveryHighWatermark, (unsigned long) self.deliveryLowWatermark];
+        return;
+    }
+    self.messageDispatcher.highWatermark = deliveryHighWatermark;
+}
+
+- (NSUInteger) deliveryLowWatermark
+{
+    return self.messageDispatcher.lowWatermark;
+}
+
+- (void) setDeliveryLowWatermark:(NSUInteger)deliveryLowWatermark
+{
+    // Otherwise the first delivery to finish after throttling lifts it again.
+    NSUInteger highWatermark = self.deliveryHighWatermark;
+    if (highWatermark > 0 && deliveryLowWatermark > highWatermark) {
+        [self _debugMessage: @"Ignoring delivery low watermark %lu above the high watermark %lu.",
+         (unsigned long) deliveryLowWatermark, (unsigned long) highWatermark];
+        return;
+    }
+    self.messageDispatcher.lowWatermark = deliveryLowWatermark;
+}
+
+- (void) setDuplicateSuppressionHorizon:(NSUInteger)duplicateSuppressionHorizon
+{
+    _duplicateSuppressionHorizon = duplicateSuppressionHorizon;
+    dispatch_async(self.readQueue, ^{
+        if (duplicateSuppressionHorizon == 0) {
+            self.duplicateWindow = nil;
+        } else if (self.duplicateWindow.horizon != duplicateSuppressionHorizon) {
+            self.duplicateWindow = [[FayeMessageIDWindow alloc] initWithHorizon: duplicateSuppressionHorizon];
+        }
+    });
+}
+
+- (void) setMaximumConcurrentRequests:(NSUInteger)maximumConcurrentRequests
+{
+    _maximumConcurrentRequests = maximumConcurrentRequests;
+    dispatch_async(self.readQueue, ^{
+        self.requestTable.concurrencyLimit = maximumConcurrentRequests;
+    });
+}
+
+- (NSTimeInterval) sequenceGapTimeout
+{
+    return self.sequenceTracker.gapTimeout;
+}
+
+- (void) setSequenceGapTimeout:(NSTimeInterval)sequenceGapTimeout
+{
+    self.sequenceTracker.gapTimeout = sequenceGapTimeout;
+}
+
+- (NSUInteger) sequenceReorderLimit
+{
+    return self.sequenceTracker.reorderLimit;
+}
+
+- (void) setSequenceReorderLimit:(NSUInteger)sequenceReorderLimit
+{
+    self.sequenceTracker.reorderLimit = sequenceReorderLimit;
+}
+
+- (NSUInteger) lostSequencedMessageCount
+{
+    return self.sequenceTracker.lostMessageCount;
+}
+
+- (NSTimeInterval) throttledTimeInterval
+{
+    pthread_mutex_lock(&_throttleLock);
+    NSTimeInterval total = _throttle.totalTime;
+    if (_throttle.active) {
+        total += CFAbsoluteTimeGetCurrent() - _throttle.startTime;
+    }
+    pthread_mutex_unlock(&_throttleLock);
+    return total;
+}
+
+- (NSUInteger) throttleCount
+{
+    pthread_mutex_lock(&_throttleLock);
+    NSUInteger count = _throttle.count;
+    pthread_mutex_unlock(&_throttleLock);
+    return count;
+}
+
 #pragma mark - Channels
 
 - (void) subscribeToChannel:(NSString *)channel
@@ -203,24 +597,170 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
              messageHandler:(FayeClientChannelMessageHandlerBlock)messageHandler
           completionHandler:(dispatch_block_t)completionHandler
 {
-    FayeChannel *fayeChannel = self.subscriptions[channel];
-    if (fayeChannel == nil) {
-        fayeChannel = [FayeChannel new];
-        fayeChannel.channelPath = channel;
-        self.subscriptions[channel] = fayeChannel;
-        [self setSubscriptionStatus: FayeChannelSubscriptionStatusUnsubscribed forChannel: channel];
-    }
+    [self subscribeToChannel: channel
+                     options: FayeChannelSubscriptionOptionsNone
+              messageHandler: messageHandler
+           completionHandler: completionHandler];
+}
+
+- (void) subscribeToChannel:(NSString *)channel
+                    options:(FayeChannelSubscriptionOptions)options
+             messageHandler:(FayeClientChannelMessageHandlerBlock)messageHandler
+          completionHandler:(dispatch_block_t)completionHandler
+{
+    [self subscribeToChannel: channel
+                     options: options
+              messageHandler: messageHandler
+           rawMessageHandler: NULL
+           completionHandler: completionHandler];
+}
+
+- (void) subscribeToChannel:(NSString *)channel
+                    options:(FayeChannelSubscriptionOptions)options
+          rawMessageHandler:(FayeClientChannelRawMessageHandlerBlock)messageHandler
+          completionHandler:(dispatch_block_t)completionHandler
+{
+    [self subscribeToChannel: channel
+                     options: options | FayeChannelSubscriptionOptionRawData
+              messageHandler: NULL
+           rawMessageHandler: messageHandler
+           completionHandler: completionHandler];
+}
+
+- (void) subscribeToChannel:(NSString *)channel
+                    options:(FayeChannelSubscriptionOptions)options
+             messageHandler:(FayeClientChannelMessageHandlerBlock)messageHandler
+          rawMessageHandler:(FayeClientChannelRawMessageHandlerBlock)rawMessageHandler
+          completionHandler:(dispatch_block_t)completionHandler
+{
+    FayeChannel *fayeChannel = [self subscriptionForChannelCreatingIfNeeded: channel];
+    fayeChannel.subscribedDirectly = YES;
     fayeChannel.messageHandlerBlock = messageHandler;
+    fayeChannel.rawMessageHandlerBlock = rawMessageHandler;
+    if ((fayeChannel.options & FayeChannelSubscriptionOptionCacheLastValue) &&
+        !(options & FayeChannelSubscriptionOptionCacheLastValue))
+    {
+        [self.lastValueCache removeDataForSubscription: channel];
+    }
+    fayeChannel.options = options;
     fayeChannel.statusHandlerBlock = ^(FayeClient *client, NSString* channelPath, FayeChannelSubscriptionStatus status) {
         if (status == FayeChannelSubscriptionStatusSubscribed) {
             if (completionHandler != NULL) {
-                dispatch_async(dispatch_get_main_queue(), completionHandler);
+                dispatch_async(self.callbackQueue, completionHandler);
             }
             [self _debugMessage: @"Channel: %@ subscribed.", channel];
         }
     };
+    [self queueSubscriptionIfNeeded: fayeChannel];
+}
+
+- (id) addHandlerToChannel:(NSString *)channel
+            messageHandler:(FayeClientChannelMessageHandlerBlock)messageHandler
+         completionHandler:(dispatch_block_t)completionHandler
+{
+    FayeChannelHandler *handler = [FayeChannelHandler new];
+    handler.channelPath = channel;
+    handler.messageHandlerBlock = messageHandler;
+    [handler setCompletionHandler: completionHandler];
+    
+    FayeChannel *fayeChannel = self.subscriptions[channel];
+    FayeChannel *wildcard = nil;
+    if (fayeChannel == nil) {
+        wildcard = self.subscriptions[[self wildcardCoveringChannel: channel]];
+    }
+    if (wildcard != nil && [self subscriptionIsHeld: wildcard] && [self wildcardCanFeedHandlersLocally: wildcard]) {
+        // The messages are already coming in; no need to ask the server again.
+        NSMutableDictionary *localHandlers = wildcard.localHandlers.mutableCopy ?: [NSMutableDictionary dictionary];
+        localHandlers[channel] = [localHandlers[channel] ?: @[] arrayByAddingObject: handler];
+        handler.channel = wildcard;
+        wildcard.localHandlers = localHandlers;
+        fayeChannel = wildcard;
+        [self _debugMessage: @"Channel: %@ handled locally by %@.", channel, wildcard.channelPath];
+    } else {
+        fayeChannel = [self subscriptionForChannelCreatingIfNeeded: channel];
+        handler.channel = fayeChannel;
+        fayeChannel.handlers = [fayeChannel.handlers ?: @[] arrayByAddingObject: handler];
+        [self queueSubscriptionIfNeeded: fayeChannel];
+    }
+    if ([self subscriptionStatusForChannel: fayeChannel.channelPath] == FayeChannelSubscriptionStatusSubscribed) {
+        [self completeHandler: handler];
+    }
+    return handler;
+}
+
+- (void) removeHandler:(id)token
+{
+    if (![token isKindOfClass: [FayeChannelHandler class]]) {
+        return;
+    }
+    FayeChannelHandler *handler = token;
+    FayeChannel *fayeChannel = handler.channel;
+    if (fayeChannel == nil || self.subscriptions[fayeChannel.channelPath] != fayeChannel) {
+        [self _debugMessage: @"Attempt to remove handler for channel '%@' which isn't registered.", handler.channelPath];
+        return;
+    }
+    handler.channel = nil;
+    NSArray *localHandlers = fayeChannel.localHandlers[handler.channelPath];
+    if ([localHandlers indexOfObjectIdenticalTo: handler] != NSNotFound) {
+        NSMutableArray *remaining = localHandlers.mutableCopy;
+        [remaining removeObjectIdenticalTo: handler];
+        NSMutableDictionary *updated = fayeChannel.localHandlers.mutableCopy;
+        if (remaining.count > 0) {
+            updated[handler.channelPath] = remaining;
+        } else {
+            [updated removeObjectForKey: handler.channelPath];
+        }
+        fayeChannel.localHandlers = updated;
+        return;
+    }
+    NSMutableArray *handlers = fayeChannel.handlers.mutableCopy;
+    [handlers removeObjectIdenticalTo: handler];
+    fayeChannel.handlers = handlers;
+    if (![self subscriptionIsHeld: fayeChannel]) {
+        [self releaseSubscription: fayeChannel completionHandler: NULL];
+    }
+}
+
+- (FayeChannel*) subscriptionForChannelCreatingIfNeeded: (NSString*) channel
+{
+    FayeChannel *fayeChannel = self.subscriptions[channel];
+    if (fayeChannel == nil) {
+        fayeChannel = [FayeChannel channelWithPath: channel];
+        // Handlers a wildcard was feeding move over to the new subscription.
+        FayeChannel *wildcard = self.subscriptions[[self wildcardCoveringChannel: channel]];
+        NSArray *adopted = wildcard.localHandlers[channel];
+        if (adopted != nil) {
+            NSMutableDictionary *localHandlers = wildcard.localHandlers.mutableCopy;
+            [localHandlers removeObjectForKey: channel];
+            wildcard.localHandlers = localHandlers;
+            for (FayeChannelHandler *handler in adopted) {
+                handler.channel = fayeChannel;
+            }
+            fayeChannel.handlers = adopted;
+        }
+        self.subscriptions[channel] = fayeChannel;
+        [self subscriptionsDidChange];
+        [self setSubscriptionStatus: FayeChannelSubscriptionStatusUnsubscribed forChannel: channel];
+    }
+    return fayeChannel;
+}
+
+- (void) queueSubscriptionIfNeeded: (FayeChannel*) fayeChannel
+{
+    [self queueSubscriptionIfNeeded: fayeChannel batch: nil];
+}
+
+// With a batch, the channel is added to it for queueChannelSubscriptions:
+// instead of being queued on its own.
+- (void) queueSubscriptionIfNeeded: (FayeChannel*) fayeChannel batch: (NSMutableArray*) batch
+{
+    NSString *channel = fayeChannel.channelPath;
     if ([self subscriptionStatusForChannel:channel] == FayeChannelSubscriptionStatusUnsubscribed) {
-        [self queueChannelSubscription: channel];
+        if (batch != nil) {
+            [batch addObject: channel];
+        } else {
+            [self queueChannelSubscription: channel];
+        }
         [self _debugMessage: @"Channel: %@ queued for subscription.", channel];
     } else if ([self subscriptionStatusForChannel:channel] == FayeChannelSubscriptionStatusUnsubscribing) {
         fayeChannel.markedForUnsubscription = NO;
@@ -228,6 +768,41 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     }
 }
 
+// Whether anything still wants the server subscription.
+- (BOOL) subscriptionIsHeld: (FayeChannel*) fayeChannel
+{
+    return fayeChannel.subscribedDirectly || fayeChannel.handlers.count > 0;
+}
+
+// Handlers fed by a wildcard get its messages as it sees them, so only one
+// that delivers everything, one at a time, as it arrives, will do.
+- (BOOL) wildcardCanFeedHandlersLocally: (FayeChannel*) wildcard
+{
+    return wildcard.filter == nil &&
+        !(wildcard.options & (FayeChannelSubscriptionOptionConflate | FayeChannelSubscriptionOptionSequenced));
+}
+
+// The single-segment wildcard that would match `channel`, if it isn't one itself.
+- (NSString*) wildcardCoveringChannel: (NSString*) channel
+{
+    if ([channel hasSuffix: @"*"]) {
+        return nil;
+    }
+    NSRange lastSlash = [channel rangeOfString: @"/" options: NSBackwardsSearch];
+    if (lastSlash.location == NSNotFound) {
+        return nil;
+    }
+    return [[channel substringToIndex: NSMaxRange(lastSlash)] stringByAppendingString: @"*"];
+}
+
+- (void) completeHandler: (FayeChannelHandler*) handler
+{
+    dispatch_block_t completionHandler = [handler takeCompletionHandler];
+    if (completionHandler != NULL) {
+        dispatch_async(self.callbackQueue, completionHandler);
+    }
+}
+
 - (void) unsubscribeFromChannel:(NSString *)channel
 {
     [self unsubscribeFromChannel: channel completionHandler: NULL];
@@ -240,23 +815,148 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
         [self _debugMessage: @"Attempt to unsubscribe from channel '%@' which is not subscribed to.", channel];
         return;
     }
+    fayeChannel.subscribedDirectly = NO;
     fayeChannel.messageHandlerBlock = NULL;
+    fayeChannel.rawMessageHandlerBlock = NULL;
+    if ([self subscriptionIsHeld: fayeChannel]) {
+        // Handler tokens are still listening.
+        if (handler != NULL) {
+            dispatch_async(self.callbackQueue, handler);
+        }
+        return;
+    }
+    [self releaseSubscription: fayeChannel completionHandler: handler];
+}
+
+- (void) releaseSubscription: (FayeChannel*) fayeChannel completionHandler: (dispatch_block_t) handler
+{
+    [self releaseSubscription: fayeChannel completionHandler: handler batch: nil];
+}
+
+- (void) releaseSubscription: (FayeChannel*) fayeChannel
+           completionHandler: (dispatch_block_t) handler
+                       batch: (NSMutableArray*) batch
+{
+    NSString *channel = fayeChannel.channelPath;
+    // Channels a wildcard was feeding locally need subscriptions of their own.
+    for (NSString *channelPath in fayeChannel.localHandlers) {
+        [self queueSubscriptionIfNeeded: [self subscriptionForChannelCreatingIfNeeded: channelPath]];
+    }
+    __weak FayeChannel *weakChannel = fayeChannel;
     fayeChannel.statusHandlerBlock = ^(FayeClient *client, NSString* channelPath, FayeChannelSubscriptionStatus status) {
         if (status == FayeChannelSubscriptionStatusUnsubscribed) {
-            [self.subscriptions removeObjectForKey: channelPath];
+            // Unless a handler turned up in the meantime.
+            if (![self subscriptionIsHeld: weakChannel]) {
+                [self.subscriptions removeObjectForKey: channelPath];
+                [self subscriptionsDidChange];
+                [self.lastValueCache removeDataForSubscription: channelPath];
+                [self.sequenceTracker forgetSubscription: channelPath];
+            }
             if (handler != NULL) {
-                dispatch_async(dispatch_get_main_queue(), handler);
+                dispatch_async(self.callbackQueue, handler);
             }
         }
         [self _debugMessage: @"Channel: %@ unsubscribed.", channel];
     };
-    if ([self subscriptionStatusForChannel:channel] == FayeChannelSubscriptionStatusSubscribed) {
-        [self queueChannelUnsubscription: channel];
+    FayeChannelSubscriptionStatus status = [self subscriptionStatusForChannel:channel];
+    if (status == FayeChannelSubscriptionStatusSubscribed) {
+        if (batch != nil) {
+            [batch addObject: channel];
+        } else {
+            [self queueChannelUnsubscription: channel];
+        }
         [self _debugMessage: @"Channel: %@ queued for unsubscription.", channel];
-    } else if ([self subscriptionStatusForChannel:channel] == FayeChannelSubscriptionStatusSubscribing) {
+    } else if (status == FayeChannelSubscriptionStatusSubscribing) {
         fayeChannel.markedForUnsubscription = YES;
         fayeChannel.markedForSubscription = NO;
+    } else if (status == FayeChannelSubscriptionStatusUnsubscribed) {
+        // Nothing to tell the server (we're disconnected, say), but it mustn't
+        // be subscribed again when we reconnect.
+        fayeChannel.statusHandlerBlock(self, channel, status);
+    }
+}
+
+- (void) setSubscribedChannels:(NSSet *)channels
+{
+    [self setSubscribedChannels: channels messageHandler: NULL completionHandler: NULL];
+}
+
+- (void) setSubscribedChannels:(NSSet *)channels
+                messageHandler:(FayeClientChannelMessageHandlerBlock)messageHandler
+             completionHandler:(dispatch_block_t)completionHandler
+{
+    NSMutableArray *added = [NSMutableArray new];
+    NSMutableArray *removed = [NSMutableArray new];
+    for (NSString *channel in channels) {
+        if (![self.subscriptions[channel] subscribedDirectly]) {
+            [added addObject: channel];
+        }
+    }
+    [self.subscriptions enumerateKeysAndObjectsUsingBlock:^(NSString *channel, FayeChannel *fayeChannel, BOOL *stop) {
+        if (fayeChannel.subscribedDirectly && ![channels containsObject: channel]) {
+            [removed addObject: channel];
+        }
+    }];
+    if (added.count == 0 && removed.count == 0) {
+        if (completionHandler != NULL) {
+            dispatch_async(self.callbackQueue, completionHandler);
+        }
+        return;
+    }
+    
+    __block atomic_uint remaining = (unsigned int) (added.count + removed.count);
+    dispatch_block_t arrive = ^{
+        if (atomic_fetch_sub(&remaining, 1) == 1 && completionHandler != NULL) {
+            dispatch_async(self.callbackQueue, completionHandler);
+        }
+    };
+    
+    NSMutableArray *unsubscriptions = [NSMutableArray new];
+    for (NSString *channel in removed) {
+        FayeChannel *fayeChannel = self.subscriptions[channel];
+        fayeChannel.subscribedDirectly = NO;
+        fayeChannel.messageHandlerBlock = NULL;
+        fayeChannel.rawMessageHandlerBlock = NULL;
+        if ([self subscriptionIsHeld: fayeChannel]) {
+            arrive();
+        } else {
+            [self releaseSubscription: fayeChannel completionHandler: arrive batch: unsubscriptions];
+        }
+    }
+    
+    NSMutableArray *subscriptions = [NSMutableArray new];
+    for (NSString *channel in added) {
+        FayeChannel *fayeChannel = [self subscriptionForChannelCreatingIfNeeded: channel];
+        fayeChannel.subscribedDirectly = YES;
+        fayeChannel.messageHandlerBlock = messageHandler;
+        fayeChannel.rawMessageHandlerBlock = NULL;
+        __block BOOL arrived = NO;
+        __weak FayeChannel *weakChannel = fayeChannel;
+        fayeChannel.statusHandlerBlock = ^(FayeClient *client, NSString* channelPath, FayeChannelSubscriptionStatus status) {
+            // Only the first answer counts; later ones are resubscriptions.
+            // Being refused is an answer too, but an earlier unsubscribe
+            // finishing (with this one queued behind it) isn't.
+            BOOL answered = status == FayeChannelSubscriptionStatusSubscribed ||
+                (status == FayeChannelSubscriptionStatusUnsubscribed && !weakChannel.markedForSubscription);
+            if (answered && !arrived) {
+                arrived = YES;
+                arrive();
+            }
+            if (status == FayeChannelSubscriptionStatusSubscribed) {
+                [self _debugMessage: @"Channel: %@ subscribed.", channelPath];
+            }
+        };
+        if ([self subscriptionStatusForChannel: channel] == FayeChannelSubscriptionStatusSubscribed) {
+            // Handler tokens already had it subscribed.
+            arrived = YES;
+            arrive();
+        } else {
+            [self queueSubscriptionIfNeeded: fayeChannel batch: subscriptions];
+        }
     }
+    
+    [self queueChannelUnsubscriptions: unsubscriptions];
+    [self queueChannelSubscriptions: subscriptions];
 }
 
 - (void) setExtension:(NSDictionary *)extension forChannel:(NSString *)channel
@@ -269,6 +969,36 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     fayeChannel.extension = extension;
 }
 
+- (NSDictionary*) lastMessageOnChannel:(NSString *)channel
+{
+    return [self.lastValueCache dataForChannel: channel];
+}
+
+- (void) setConflationKeyPath:(NSString *)keyPath forChannel:(NSString *)channel
+{
+    FayeChannel *fayeChannel = self.subscriptions[channel];
+    if (fayeChannel == nil) {
+        [self _debugMessage: @"Attempt to set conflation key path on channel '%@' which is not subscribed to.", channel];
+        return;
+    }
+    fayeChannel.conflationKeyPath = keyPath;
+}
+
+- (NSUInteger) conflatedMessageCountForChannel:(NSString *)channel
+{
+    return [self.messageDispatcher conflatedCountForCounterKey: channel];
+}
+
+- (void) setFilter:(FayeMessageFilter *)filter forChannel:(NSString *)channel
+{
+    FayeChannel *fayeChannel = self.subscriptions[channel];
+    if (fayeChannel == nil) {
+        [self _debugMessage: @"Attempt to set filter on channel '%@' which is not subscribed to.", channel];
+        return;
+    }
+    fayeChannel.filter = filter;
+}
+
 - (NSSet*) subscribedChannels
 {
     NSMutableSet *channels = [NSMutableSet new];
@@ -301,9 +1031,18 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
         [self _debugMessage: @"Ignoring send message: no data."];
         return;
     }
+    NSString *messageID = nil;
+    if (self.deliversPublishesLocally) {
+        messageID = [self deliverPublishLocally: message toChannel: channel extension: extension];
+    }
     FayeMessageQueueItem *queueItem = [FayeMessageQueueItem itemWithBlock:^NSDictionary *{
-        return [self publishMessageForChannelPath: channel withData: message extension:extension];
+        return [self publishMessageForChannelPath: channel withData: message extension: extension messageID: messageID];
     }];
+    if (extension != nil) {
+        queueItem.publication = @{ @"channel": channel, @"data": message, @"ext": extension };
+    } else {
+        queueItem.publication = @{ @"channel": channel, @"data": message };
+    }
     
     if (self.subscriptions[channel] != nil) {
         // We only support sent message callbacks if you're subscribed to the channel you're sending to.
@@ -312,8 +1051,308 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     [self queueMessage: queueItem];
 }
 
+// Returns the ID the publish has to go out with for its echo to be recognised.
+- (NSString*) deliverPublishLocally: (NSDictionary*) data
+                          toChannel: (NSString*) channelPath
+                          extension: (NSDictionary*) extension
+{
+    NSString *messageID = [NSString stringWithFormat: @"%@%llx", self.echoIDPrefix,
+                           (unsigned long long) atomic_fetch_add(&_echoCount, 1) + 1];
+    FayeChannel *fayeChannel = self.subscriptions[channelPath];
+    NSDictionary *ext = [self mergeExtensionDictionaries: @[self.extension, fayeChannel.extension ?: @{}, extension ?: @{}]];
+    dispatch_async(self.readQueue, ^{
+        FayeChannelTag tag = FayeChannelTagUnknown;
+        FayeMessage *message = [FayeMessage new];
+        message.channel = [self.channelNames internString: channelPath tag: &tag];
+        message.channelTag = tag;
+        message.data = data;
+        message.fayeId = messageID;
+        message.ext = ext.count > 0 ? ext : nil;
+        FayeChannel *subscription = [self subscriptionForChannelPath: message.channel];
+        if (subscription == nil || (subscription.options & FayeChannelSubscriptionOptionSequenced)) {
+            return;
+        }
+        if (self.echoWindow == nil) {
+            self.echoWindow = [[FayeMessageIDWindow alloc] initWithHorizon: FayeClientLocalEchoHorizon];
+        }
+        [self.echoWindow recordChannel: message.channel messageID: messageID extra: nil];
+        [self deliverMessage: message toSubscription: subscription];
+    });
+    return messageID;
+}
+
+#pragma mark - Requests
+
+- (void) sendRequest:(NSDictionary *)message
+           toChannel:(NSString *)channel
+   completionHandler:(FayeClientRequestCompletionHandlerBlock)handler
+{
+    [self sendRequest: message toChannel: channel timeout: self.timeout completionHandler: handler];
+}
+
+- (void) sendRequest:(NSDictionary *)message
+           toChannel:(NSString *)channel
+             timeout:(NSTimeInterval)timeout
+   completionHandler:(FayeClientRequestCompletionHandlerBlock)handler
+{
+    if (message == nil) {
+        [self _debugMessage: @"Ignoring request: no data."];
+        return;
+    }
+    NSString *replyChannel = [self openReplyChannel];
+    dispatch_async(self.readQueue, ^{
+        [self.requestTable addRequestWithTimeout: timeout startHandler:^(NSString *correlationID) {
+            [self sendMessage: message
+                    toChannel: channel
+                    extension: @{ @"replyTo": replyChannel, @"correlationId": correlationID }
+            completionHandler: NULL];
+        } completionHandler:^(NSDictionary *response, NSError *error) {
+            if (handler != NULL) {
+                dispatch_async(self.callbackQueue, ^{
+                    handler(self, response, error);
+                });
+            }
+        }];
+    });
+}
+
+// Subscribes to the reply channel the first time a request needs it.  Requests
+// are held back until the subscription is in place.
+- (NSString*) openReplyChannel
+{
+    NSString *replyChannel = self.replyChannel;
+    if (replyChannel == nil) {
+        replyChannel = [@"/replies/" stringByAppendingString: [[NSUUID UUID].UUIDString lowercaseString]];
+        self.replyChannel = replyChannel;
+        [self addHandlerToChannel: replyChannel messageHandler: NULL completionHandler:^{
+            dispatch_async(self.readQueue, ^{
+                self.requestTable.suspended = NO;
+            });
+        }];
+    }
+    return replyChannel;
+}
+
+// Read queue only.
+- (void) handleReply: (FayeMessage*) message
+{
+    id correlationID = message.ext[@"correlationId"];
+    if (correlationID == nil) {
+        [self _debugMessage: @"Dropping reply without a correlation id."];
+        return;
+    }
+    NSError *error = nil;
+    id errorDescription = message.ext[@"error"];
+    if (errorDescription != nil) {
+        error = [NSError errorWithDomain: kFayeErrorDomain
+                                    code: 0
+                                userInfo: @{ NSLocalizedDescriptionKey: [errorDescription description] }];
+    }
+    if (![self.requestTable completeRequest: [correlationID description]
+                               withResponse: error != nil ? nil : message.data
+                                      error: error])
+    {
+        [self _debugMessage: @"Dropping reply to unknown request: %@", correlationID];
+    }
+}
+
+#pragma mark - Session Persistence
+
+- (BOOL) writeSessionToURL:(NSURL *)url error:(NSError **)error
+{
+    NSArray *servers = [self.servers.allValues sortedArrayUsingComparator:^NSComparisonResult(FayeServer *a, FayeServer *b) {
+        return [@(a.sortIndex) compare: @(b.sortIndex)];
+    }];
+    NSMutableArray *serverStates = [NSMutableArray new];
+    for (FayeServer *server in servers) {
+        [serverStates addObject: [server sessionState]];
+    }
+    NSMutableArray *subscriptions = [NSMutableArray new];
+    for (FayeChannel *channel in self.subscriptions.allValues) {
+        NSMutableDictionary *subscription = [NSMutableDictionary new];
+        subscription[@"channel"] = channel.channelPath;
+        subscription[@"options"] = @(channel.options);
+        if (channel.conflationKeyPath != nil) {
+            subscription[@"conflationKeyPath"] = channel.conflationKeyPath;
+        }
+        if (channel.extension.count > 0) {
+            NSData *extension = [NSJSONSerialization dataWithJSONObject: channel.extension options: 0 error: NULL];
+            if (extension != nil) {
+                subscription[@"ext"] = extension;
+            }
+        }
+        [subscriptions addObject: subscription];
+    }
+    // Publishes are kept as JSON; property lists can't hold NSNull.
+    NSMutableArray *outbound = [NSMutableArray new];
+    dispatch_sync(self.writeQueue, ^{
+        NSMutableArray *items = [NSMutableArray arrayWithArray: self.alternateQueue];
+        [items addObjectsFromArray: self.queuedMessages];
+        for (FayeMessageQueueItem *item in items) {
+            if (item.publication == nil) {
+                continue;
+            }
+            NSData *publication = [NSJSONSerialization dataWithJSONObject: item.publication options: 0 error: NULL];
+            if (publication != nil) {
+                [outbound addObject: publication];
+            }
+        }
+    });
+    @synchronized (self.restoredPublications) {
+        [outbound addObjectsFromArray: self.restoredPublications];
+    }
+    NSDictionary *session = @{ @"version": @(FayeClientSessionVersion),
+                               @"servers": serverStates,
+                               @"subscriptions": subscriptions,
+                               @"outbound": outbound };
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList: session
+                                                              format: NSPropertyListBinaryFormat_v1_0
+                                                             options: 0
+                                                               error: error];
+    if (data == nil) {
+        return NO;
+    }
+    return [data writeToURL: url options: NSDataWritingAtomic error: error];
+}
+
+- (BOOL) restoreSessionFromURL:(NSURL *)url error:(NSError **)error
+{
+    if (self.connectionStatus != FayeClientConnectionStatusDisconnected) {
+        if (error) {
+            *error = [NSError errorWithDomain: kFayeErrorDomain
+                                         code: 0
+                                     userInfo: @{ NSLocalizedDescriptionKey: @"Sessions can only be restored while disconnected." }];
+        }
+        return NO;
+    }
+    NSData *data = [NSData dataWithContentsOfURL: url options: 0 error: error];
+    if (data == nil) {
+        return NO;
+    }
+    NSDictionary *session = [NSPropertyListSerialization propertyListWithData: data
+                                                                      options: NSPropertyListImmutable
+                                                                       format: NULL
+                                                                        error: error];
+    if (session == nil) {
+        return NO;
+    }
+    if (![session isKindOfClass: [NSDictionary class]] ||
+        [session[@"version"] integerValue] != FayeClientSessionVersion)
+    {
+        if (error) {
+            *error = [NSError errorWithDomain: kFayeErrorDomain
+                                         code: 0
+                                     userInfo: @{ NSLocalizedDescriptionKey: @"Unrecognised session file." }];
+        }
+        return NO;
+    }
+    
+    for (NSDictionary *state in session[@"servers"]) {
+        NSURL *serverURL = [NSURL URLWithString: state[@"url"]];
+        if (serverURL == nil) {
+            continue;
+        }
+        [self addServerWithURL: serverURL];
+        [self.servers[serverURL.absoluteString] restoreSessionState: state];
+    }
+    for (NSDictionary *subscription in session[@"subscriptions"]) {
+        NSString *channelPath = subscription[@"channel"];
+        if (channelPath == nil || self.subscriptions[channelPath] != nil) {
+            continue;
+        }
+        // No handlers until the app subscribes again.
+        FayeChannel *channel = [FayeChannel channelWithPath: channelPath];
+        channel.subscribedDirectly = YES;
+        channel.options = [subscription[@"options"] unsignedIntegerValue];
+        channel.conflationKeyPath = subscription[@"conflationKeyPath"];
+        if (subscription[@"ext"] != nil) {
+            channel.extension = [NSJSONSerialization JSONObjectWithData: subscription[@"ext"] options: 0 error: NULL];
+        }
+        self.subscriptions[channelPath] = channel;
+    }
+    [self subscriptionsDidChange];
+    // Channel statuses are per server, so look them up on the one connect will pick.
+    if (self.servers.count > 0) {
+        self.currentServer = [[self sortedServers] objectAtIndex: 0];
+    }
+    @synchronized (self.restoredPublications) {
+        [self.restoredPublications addObjectsFromArray: session[@"outbound"]];
+    }
+    [self _debugMessage: @"Restored session from: %@", url.path];
+    return YES;
+}
+
+// Once connected, restored publishes go out as if they'd just been sent.
+- (void) sendRestoredPublications
+{
+    NSArray *publications = nil;
+    @synchronized (self.restoredPublications) {
+        publications = self.restoredPublications.copy;
+        [self.restoredPublications removeAllObjects];
+    }
+    for (NSData *data in publications) {
+        NSDictionary *publication = [NSJSONSerialization JSONObjectWithData: data options: 0 error: NULL];
+        if (![publication isKindOfClass: [NSDictionary class]] || publication[@"channel"] == nil) {
+            continue;
+        }
+        [self sendMessage: publication[@"data"]
+                toChannel: publication[@"channel"]
+                extension: publication[@"ext"]
+        completionHandler: NULL];
+    }
+}
+
 #pragma mark - Connection / Disconnection
 
+- (void) prewarm
+{
+    [self resolveServerHostsOpeningConnections: YES];
+}
+
+- (void) resolveServerHostsOpeningConnections: (BOOL) openConnections
+{
+    NSArray *servers = self.servers.allValues;
+    dispatch_async(self.networkQueue, ^{
+        for (FayeServer *server in servers) {
+            NSString *host = server.url.host;
+            if (host == nil) {
+                continue;
+            }
+            [self.hostCache resolveHost: host completionHandler:^(NSArray *addresses) {
+                [self updateUnresolvableHostsForServers: servers];
+                if (addresses.count == 0) {
+                    [self _debugMessage: @"Couldn't resolve server: %@", host];
+                } else if (openConnections && [server connectsWithLongPolling]) {
+                    [self openPrewarmConnectionToServer: server];
+                }
+            }];
+        }
+    });
+}
+
+// Network queue only.
+- (void) updateUnresolvableHostsForServers: (NSArray*) servers
+{
+    NSMutableSet *hosts = [NSMutableSet new];
+    for (FayeServer *server in servers) {
+        if (server.url.host != nil && [self.hostCache hostIsUnresolvable: server.url.host]) {
+            [hosts addObject: server.url.host];
+        }
+    }
+    self.unresolvableHosts = hosts;
+}
+
+// Network queue only.  Faye answers OPTIONS (it's a CORS preflight) without
+// doing anything, which is all it takes to leave a pooled connection behind.
+- (void) openPrewarmConnectionToServer: (FayeServer*) server
+{
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL: server.url
+                                                           cachePolicy: NSURLRequestReloadIgnoringLocalCacheData
+                                                       timeoutInterval: self.timeout];
+    [request setHTTPMethod: @"OPTIONS"];
+    [[self.urlSession dataTaskWithRequest: request] resume];
+}
+
 - (void) connect
 {
     [self connectWithConnectionStatusChangedHandler: nil];
@@ -334,6 +1373,22 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     self.currentServer = [[self sortedServers] objectAtIndex: 0];
     [self.queuedMessages removeAllObjects];
     self.connectionStatus = FayeClientConnectionStatusConnecting;
+    // Cheap while the cached answers are fresh; keeps the ordering honest.
+    [self resolveServerHostsOpeningConnections: NO];
+    if (!self.reusesClientID) {
+        self.currentServer.clientID = nil;
+    }
+    self.resumingSession = (self.currentServer.clientID != nil);
+    @synchronized (self.unconfirmedPublications) {
+        [self.unconfirmedPublications removeAllObjects];
+    }
+    if (self.resumingSession) {
+        [self _debugMessage: @"Resuming session: '%@'", self.currentServer.clientID];
+    } else if (self.racesServers && self.servers.count > 1) {
+        // Nothing to resume, so any server will do.
+        [self connectWithRace];
+        return;
+    }
     if ([self.currentServer connectsWithLongPolling]) {
         [self connectWithLongPolling];
     } else {
@@ -342,6 +1397,77 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     [self _debugMessage: @"Connecting to server: %@", self.currentServer.url.absoluteString];
 }
 
+- (void) connectWithRace
+{
+    NSArray *servers = [self sortedServers];
+    [self _debugMessage: @"Racing %lu servers.", (unsigned long) servers.count];
+    FayeConnectionRace *race = [[FayeConnectionRace alloc] initWithServers: servers queue: self.networkQueue];
+    race.staggerInterval = self.raceStaggerInterval;
+    race.timeout = self.timeout;
+    __weak FayeClient *weakSelf = self;
+    race.handshakeData = ^NSData*(FayeServer *server) {
+        return [NSJSONSerialization dataWithJSONObject: @[[weakSelf handshakeMessageForServer: server]] options: 0 error: NULL];
+    };
+    race.disconnectData = ^NSData*(FayeServer *server, NSString *clientID) {
+        FayeClient *strongSelf = weakSelf;
+        if (strongSelf == nil) {
+            return nil;
+        }
+        NSMutableDictionary *message = [NSMutableDictionary new];
+        [message addEntriesFromDictionary:
+         @{ @"channel": FayeClientDisconnectChannel,
+         @"id": [strongSelf nextMessageID],
+         @"clientId": clientID
+         }];
+        NSDictionary *ext = [strongSelf mergeExtensionDictionaries: @[strongSelf.extension, strongSelf.connectExtension]];
+        if ([ext count] > 0) {
+            message[@"ext"] = ext;
+        }
+        return [NSJSONSerialization dataWithJSONObject: @[message] options: 0 error: NULL];
+    };
+    dispatch_async(self.networkQueue, ^{
+        [self.connectionRace cancel];
+        self.connectionRace = race;
+        // The winner's connection is then already in our pool.
+        race.session = self.urlSession;
+        [race startWithCompletionHandler:^(FayeServer *server, NSData *handshakeResponse, SRWebSocket *webSocket) {
+            [weakSelf connectionRace: race didFinishWithServer: server handshakeResponse: handshakeResponse webSocket: webSocket];
+        }];
+    });
+}
+
+// Network queue only.
+- (void) connectionRace: (FayeConnectionRace*) race
+    didFinishWithServer: (FayeServer*) server
+      handshakeResponse: (NSData*) handshakeResponse
+              webSocket: (SRWebSocket*) webSocket
+{
+    if (race != self.connectionRace) {
+        return;
+    }
+    self.connectionRace = nil;
+    if (server == nil) {
+        [self _debugMessage: @"Every server failed to handshake."];
+        [self cycleConnection];
+        return;
+    }
+    [self _debugMessage: @"Won the race: %@", server.url.absoluteString];
+    self.currentServer = server;
+    server.messageEncoding = FayeClientMessageEncodingJSON;
+    server.streamsWithEventSource = NO;
+    if (webSocket != nil) {
+        self.webSocket = webSocket;
+        webSocket.delegate = self;
+        [self scheduleHeartbeat];
+    }
+    [self receiveData: handshakeResponse];
+    if ([server connectsWithLongPolling]) {
+        [self afterReceivedData: ^{
+            [self continueLongPolling];
+        }];
+    }
+}
+
 - (void) disconnect
 {
     if ([self.currentServer connectsWithLongPolling]) {
@@ -362,10 +1488,7 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
                 [self.queuedMessages addObject: [FayeMessageQueueItem itemWithBlock:^NSDictionary *{
                     return [self disconnectMessage];
                 }]];
-                NSData *data = [self dataForNextUpload];
-                if (data) {
-                    [self.webSocket send: data];
-                }
+                [self sendFramesToWebSocket: [self framesForNextUpload]];
             });
         }
     }
@@ -380,23 +1503,38 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
                                          timeoutInterval: self.timeout];
     self.webSocket = [[SRWebSocket alloc] initWithURLRequest: request];
     self.webSocket.delegate = self;
+    [self.webSocket setDelegateDispatchQueue: self.networkQueue];
     [self.webSocket open];
 }
 
 - (void) webSocketDidOpen:(SRWebSocket *)webSocket
 {
+    [self scheduleHeartbeat];
+    if (self.resumingSession && self.currentServer.clientID) {
+        // The server holds WebSocket connects, so whatever queued up while
+        // we were away can't wait for the answer.
+        [self _debugMessage: @"WebSocket: Opened.  Sending connect."];
+        [self queueConnectMessage];
+        [self sendMessagesAndEmptyQueueDelayed];
+        return;
+    }
     [self _debugMessage: @"WebSocket: Opened.  Sending handshake."];
+    [self sendHandshakeToWebSocket];
+}
+
+- (void) sendHandshakeToWebSocket
+{
     dispatch_async(self.writeQueue, ^{
+        // The handshake always goes up as JSON; the server picks the encoding in its reply.
+        self.currentServer.messageEncoding = FayeClientMessageEncodingJSON;
         self.alternateQueue = self.queuedMessages.mutableCopy;
         [self.queuedMessages removeAllObjects];
         [self.queuedMessages addObject: [FayeMessageQueueItem itemWithBlock:^NSDictionary *{
             return [self handshakeMessage];
         }]];
-        NSData *data = [self dataForNextUploadWithConnectMessage: NO];
+        NSArray *frames = [self framesForNextUploadWithConnectMessage: NO];
         [self.queuedMessages removeAllObjects];
-        if (data) {
-            [self.webSocket send: data];
-        }
+        [self sendFramesToWebSocket: frames];
     });
 }
 
@@ -415,6 +1553,8 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
           wasClean:(BOOL)wasClean
 {
     [self _debugMessage: @"WebSocket: Closed."];
+    FayeClientCancelTimer(_pingTimer);
+    FayeClientCancelTimer(_pongTimer);
     if (self.connectionStatus == FayeClientConnectionStatusDisconnecting) {
         self.connectionStatus = FayeClientConnectionStatusDisconnected;
         self.connectionStatusHandler = nil;
@@ -423,28 +1563,118 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
 
 - (void) webSocket:(SRWebSocket *)webSocket didReceiveMessage:(id)message
 {
+    if (webSocket == self.webSocket) {
+        [self heartbeatDidHearFromServer];
+    }
     if ([message isKindOfClass: [NSString class]]) {
-        dispatch_async(self.readQueue, ^{
-            [self handleReceivedData: [(NSString*) message dataUsingEncoding: NSUTF8StringEncoding]];
-        });
+        [self receiveData: [(NSString*) message dataUsingEncoding: NSUTF8StringEncoding]];
+    } else if ([message isKindOfClass: [NSData class]]) {
+        [self receiveData: message];
+    }
+}
+
+- (void) webSocket:(SRWebSocket *)webSocket didReceivePong:(NSData *)pongPayload
+{
+    uint64_t sequence = 0;
+    if (webSocket != self.webSocket || pongPayload.length != sizeof(sequence)) {
+        return;
     }
+    [pongPayload getBytes: &sequence length: sizeof(sequence)];
+    if (sequence != _pingSequence) {
+        // Answer to a ping we'd written off: late, but the server's there.
+        [self heartbeatDidHearFromServer];
+        return;
+    }
+    _awaitingPong = NO;
+    _missedPongs = 0;
+    FayeClientCancelTimer(_pongTimer);
+    [self.currentServer addRoundTripTimeSample: CFAbsoluteTimeGetCurrent() - _pingSentTime];
+    [self scheduleHeartbeat];
 }
 
 - (void) sendCurrentMessageQueueToWebSocket
 {
     dispatch_async(self.writeQueue, ^{
-        NSData *data = [self dataForNextUpload];
-        if (data) {
-            [self.webSocket send: data];
-        }
+        [self sendFramesToWebSocket: [self framesForNextUpload]];
         [self.queuedMessages removeAllObjects];
     });
 }
 
+- (void) sendFramesToWebSocket: (NSArray*) frames
+{
+    SRWebSocket *webSocket = self.webSocket;
+    dispatch_async(self.networkQueue, ^{
+        for (NSData *frame in frames) {
+            [self.outgoingChain processData: frame output: ^(NSData *data) {
+                if (data != nil) {
+                    [webSocket send: data];
+                }
+            }];
+        }
+    });
+}
+
+#pragma mark - Heartbeats
+
+// Network queue only.
+- (void) scheduleHeartbeat
+{
+    if (self.heartbeatInterval > 0) {
+        FayeClientScheduleTimer(_pingTimer, self.heartbeatInterval);
+    }
+}
+
+- (void) sendHeartbeat
+{
+    if (self.heartbeatInterval <= 0 || self.webSocket.readyState != SR_OPEN) {
+        return;
+    }
+    _pingSequence++;
+    _pingSentTime = CFAbsoluteTimeGetCurrent();
+    _awaitingPong = YES;
+    [self.webSocket sendPing: [NSData dataWithBytes: &_pingSequence length: sizeof(_pingSequence)]];
+    FayeClientScheduleTimer(_pongTimer, [self.currentServer heartbeatDeadlineWithMinimum: FayeClientMinimumHeartbeatDeadline
+                                                                                 maximum: self.heartbeatInterval]);
+}
+
+// Network queue only.  Anything at all from the server will do instead of the
+// pong; its round trip just isn't worth measuring.
+- (void) heartbeatDidHearFromServer
+{
+    _missedPongs = 0;
+    if (_awaitingPong) {
+        _awaitingPong = NO;
+        FayeClientCancelTimer(_pongTimer);
+        [self scheduleHeartbeat];
+    }
+}
+
+- (void) heartbeatDidTimeOut
+{
+    if (self.webSocket.readyState != SR_OPEN) {
+        return;
+    }
+    _awaitingPong = NO;
+    _missedPongs++;
+    if (_missedPongs < FayeClientMaximumMissedHeartbeats) {
+        // One slow pong is more likely a busy server than a dead one.
+        [self _debugMessage: @"WebSocket: Pong is late.  Pinging again."];
+        [self sendHeartbeat];
+        return;
+    }
+    _missedPongs = 0;
+    [self _debugMessage: @"WebSocket: No pong from server.  Giving up on it."];
+    self.currentServer.failures += 1;
+    [self cycleConnection];
+}
+
 #pragma mark - HTTP Long Polling
 
 - (void) connectWithLongPolling
 {
+    if (self.currentServer.streamsWithEventSource && self.currentServer.clientID) {
+        [self startEventSourceConnection];
+    }
     [self startHTTPConnection];
 }
 
@@ -452,12 +1682,47 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
 {
     dispatch_async(self.writeQueue, ^{
         NSData *data = nil;
-        if (self.currentServer.clientID) {
-            data = [self dataForNextUpload];
+        if (self.currentServer.clientID && self.currentServer.streamsWithEventSource) {
+            // Just the heartbeat; the queue goes up through startPublishConnection.
+            self.alternateQueue = self.queuedMessages.mutableCopy;
+            [self.queuedMessages removeAllObjects];
+            NSArray *frames = [self framesForNextUploadWithConnectMessage: YES];
+            self.queuedMessages = self.alternateQueue;
+            self.alternateQueue = nil;
+            data = [frames lastObject];
             if (data == nil) {
                 return;
             }
+        } else if (self.currentServer.clientID) {
+            NSArray *messages = [self messagesForNextUploadWithConnectMessage: YES];
             [self.queuedMessages removeAllObjects];
+            NSError *error = nil;
+            NSArray *frames = [self framesWithMessages: messages error: &error];
+            if (frames.count > 1 || self.pendingUploadFrames.count > 0) {
+                // The server holds whichever request carries the connect, so
+                // what doesn't fit beside it (or would overtake frames still
+                // waiting) goes up the publish path instead, one request at a
+                // time and in order, and the connect goes alone.
+                NSIndexSet *connects = [messages indexesOfObjectsPassingTest:^BOOL(NSDictionary *message, NSUInteger index, BOOL *stop) {
+                    return [message[@"channel"] isEqual: FayeClientConnectChannel];
+                }];
+                NSMutableArray *others = messages.mutableCopy;
+                [others removeObjectsAtIndexes: connects];
+                frames = [self framesWithMessages: [messages objectsAtIndexes: connects] error: &error];
+                NSArray *otherFrames = [self framesWithMessages: others error: &error];
+                if (frames != nil && otherFrames != nil) {
+                    [self.pendingUploadFrames addObjectsFromArray: otherFrames];
+                    [self startPublishConnection];
+                }
+            }
+            if (frames == nil) {
+                [self _failWithError: error];
+                return;
+            }
+            data = frames.firstObject;
+            if (data == nil) {
+                return;
+            }
         } else {
             NSError *error = nil;
             data = [NSJSONSerialization dataWithJSONObject: @[[self handshakeMessage]] options: 0 error: &error];
@@ -467,73 +1732,251 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
             }
         }
         
-        if (self.httpConnection != nil) {
-            [self.httpConnection cancel];
-            self.httpConnection = nil;
-        }
-        
+        // The server holds a long-poll open for up to its advised timeout.
         NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL: self.currentServer.url
-                                                               cachePolicy: NSURLCacheStorageNotAllowed
-                                                           timeoutInterval: self.currentServer.timeoutAdvice];
+                                                               cachePolicy: NSURLRequestReloadIgnoringLocalCacheData
+                                                           timeoutInterval: self.currentServer.timeoutAdvice + self.timeout];
         [request setHTTPMethod: @"POST"];
-        [request setHTTPBody: data];
         [request setValue: @"application/json" forHTTPHeaderField: @"Content-Type"];
-        dispatch_async(dispatch_get_main_queue(), ^{
-            self.httpConnection = [NSURLConnection connectionWithRequest: request delegate: self];
-            [self.httpConnection start];
+        dispatch_async(self.networkQueue, ^{
+            [self.outgoingChain processData: data output: ^(NSData *body) {
+                if (body == nil) {
+                    return;
+                }
+                [request setHTTPBody: body];
+                [self.httpTask cancel];
+                [self.httpData setLength: 0];
+                self.httpTask = [self.urlSession dataTaskWithRequest: request];
+                [self.httpTask resume];
+            }];
         });
     });
 }
 
-- (void) connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+- (void) httpTaskDidCompleteWithError: (NSError*) error statusCode: (NSInteger) statusCode
+{
+    if (error != nil) {
+        [self _debugMessage: @"LONG-POLLING: Connection failure."];
+        self.currentServer.failures += 1;
+        [self cycleConnection];
+        return;
+    }
+    NSData *data = [self.httpData copy]; // Probably not the most efficient way, but I can't think of a better way...
+    [self receiveData: data];
+    [self.httpData setLength: 0];
+    [self _debugMessage: @"LONG-POLLING: Interval.  Timeout: %.1f", self.currentServer.timeoutAdvice];
+    if (statusCode >= 400) {
+        // EPIC FAIL
+        [self disconnectNow];
+        return;
+    }
+    // Decide on the next poll only once this batch has been handled, so that
+    // the handshake's client ID and any backpressure it caused are visible.
+    [self afterReceivedData: ^{
+        [self continueLongPolling];
+    }];
+}
+
+- (void) continueLongPolling
+{
+    if (self.currentServer.clientID == nil) {
+        return;
+    }
+    pthread_mutex_lock(&_throttleLock);
+    BOOL throttled = _throttle.active;
+    if (throttled) {
+        _throttle.pollDeferred = YES;
+    }
+    pthread_mutex_unlock(&_throttleLock);
+    if (throttled) {
+        [self _debugMessage: @"LONG-POLLING: Delivery backlog, holding back the next connect."];
+    } else if (self.currentServer.streamsWithEventSource) {
+        // Faye answers eventsource connects straight away and says when it
+        // wants the next one.
+        FayeClientScheduleTimer(_connectTimer, self.currentServer.intervalAdvice);
+    } else {
+        [self startHTTPConnection];
+    }
+}
+
+#pragma mark - EventSource
+
+- (void) startEventSourceConnection
+{
+    dispatch_async(self.networkQueue, ^{
+        if (self.eventSourceTask != nil || self.currentServer.clientID == nil ||
+            !self.currentServer.streamsWithEventSource ||
+            self.connectionStatus == FayeClientConnectionStatusDisconnected)
+        {
+            return;
+        }
+        NSURL *url = [self.currentServer.url URLByAppendingPathComponent: self.currentServer.clientID];
+        NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL: url
+                                                               cachePolicy: NSURLRequestReloadIgnoringLocalCacheData
+                                                           timeoutInterval: self.currentServer.intervalAdvice + self.currentServer.timeoutAdvice + self.timeout];
+        [request setHTTPMethod: @"GET"];
+        [request setValue: @"text/event-stream" forHTTPHeaderField: @"Accept"];
+        [request setValue: @"no-cache" forHTTPHeaderField: @"Cache-Control"];
+        if (self.eventSourceParser == nil) {
+            self.eventSourceParser = [FayeEventSourceParser new];
+        }
+        [self.eventSourceParser reset];
+        [self _debugMessage: @"EVENTSOURCE: Opening stream: %@", url.absoluteString];
+        self.eventSourceTask = [self.urlSession dataTaskWithRequest: request];
+        [self.eventSourceTask resume];
+    });
+}
+
+- (void) eventSourceTaskDidCompleteWithError: (NSError*) error statusCode: (NSInteger) statusCode
 {
-    [self _debugMessage: @"LONG-POLLING: Connection failure."];
+    if (error == nil && statusCode < 400) {
+        [self _debugMessage: @"EVENTSOURCE: Stream closed by server, reopening."];
+        [self startEventSourceConnection];
+        return;
+    }
+    if ([error.domain isEqualToString: NSURLErrorDomain] && error.code == NSURLErrorTimedOut) {
+        // Nothing came down the stream for a while; that's not the server's fault.
+        [self _debugMessage: @"EVENTSOURCE: Stream idle, reopening."];
+        [self startEventSourceConnection];
+        return;
+    }
+    [self _debugMessage: @"EVENTSOURCE: Stream failure."];
     self.currentServer.failures += 1;
     [self cycleConnection];
 }
 
-- (void) connection:(NSURLConnection *)connection didSendBodyData:(NSInteger)bytesWritten totalBytesWritten:(NSInteger)totalBytesWritten totalBytesExpectedToWrite:(NSInteger)totalBytesExpectedToWrite
+// Publishes (and subscriptions) go up one request at a time, so a batch split
+// over several frames can't be reordered across connections, and none of them
+// ever cancels the held /meta/connect.  EventSource sends everything this way;
+// long-polling only what's left over when the queue won't fit in one frame.
+- (void) startPublishConnection
 {
-    // I think only sendMessage has completion handlers to run here...
+    dispatch_async(self.networkQueue, ^{
+        if (_publishInFlight) {
+            return;
+        }
+        _publishInFlight = YES;
+        dispatch_async(self.writeQueue, ^{
+            if (self.pendingUploadFrames.count == 0 && self.currentServer.clientID) {
+                NSArray *frames = [self framesForNextUploadWithConnectMessage: NO];
+                [self.pendingUploadFrames addObjectsFromArray: frames];
+                [self.queuedMessages removeAllObjects];
+            }
+            NSData *data = nil;
+            if (self.pendingUploadFrames.count > 0) {
+                data = self.pendingUploadFrames[0];
+                [self.pendingUploadFrames removeObjectAtIndex: 0];
+            }
+            dispatch_async(self.networkQueue, ^{
+                if (data == nil) {
+                    _publishInFlight = NO;
+                    return;
+                }
+                [self.outgoingChain processData: data output: ^(NSData *body) {
+                    if (body == nil) {
+                        // Dropped; on to the next one.
+                        _publishInFlight = NO;
+                        [self startPublishConnection];
+                        return;
+                    }
+                    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL: self.currentServer.url
+                                                                           cachePolicy: NSURLRequestReloadIgnoringLocalCacheData
+                                                                       timeoutInterval: self.currentServer.intervalAdvice + self.timeout];
+                    [request setHTTPMethod: @"POST"];
+                    [request setHTTPBody: body];
+                    [request setValue: @"application/json" forHTTPHeaderField: @"Content-Type"];
+                    self.publishData = [NSMutableData new];
+                    self.publishTask = [self.urlSession dataTaskWithRequest: request];
+                    [self.publishTask resume];
+                }];
+            });
+        });
+    });
 }
 
-- (void) connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+- (void) publishTaskDidCompleteWithError: (NSError*) error statusCode: (NSInteger) statusCode
 {
-    [self.httpData appendData: data];
+    NSData *data = [self.publishData copy];
+    self.publishData = nil;
+    _publishInFlight = NO;
+    if (error != nil || statusCode >= 400) {
+        [self _debugMessage: @"HTTP: Publish failure."];
+        self.currentServer.failures += 1;
+        [self cycleConnection];
+        return;
+    }
+    [self receiveData: data];
+    [self startPublishConnection];
 }
 
-- (void) connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+#pragma mark - NSURLSession
+
+// Network queue only.  The session holds on to its delegate until it's
+// invalidated, which happens once the client is fully disconnected.
+- (NSURLSession*) urlSession
 {
-    self.lastResponse = response;
+    if (_urlSession == nil) {
+        NSOperationQueue *delegateQueue = [NSOperationQueue new];
+        delegateQueue.maxConcurrentOperationCount = 1;
+        delegateQueue.underlyingQueue = self.networkQueue;
+        NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+        configuration.requestCachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+        configuration.URLCache = nil;
+        // The session would otherwise keep us alive for as long as it lives,
+        // which after a prewarm with no connect is forever.
+        _urlSession = [NSURLSession sessionWithConfiguration: configuration
+                                                    delegate: (id <NSURLSessionDataDelegate>) [[FayeWeakDelegate alloc] initWithTarget: self]
+                                               delegateQueue: delegateQueue];
+    }
+    return _urlSession;
 }
 
-- (void) connectionDidFinishLoading:(NSURLConnection *)connection
+- (void) URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data
 {
-    NSData *data = [self.httpData copy]; // Probably not the most efficient way, but I can't think of a better way...
-    dispatch_async(self.readQueue, ^{
-        [self handleReceivedData: data];
-    });
-    [self.httpData setLength: 0];
-    [self _debugMessage: @"LONG-POLLING: Interval.  Timeout: %.1f", self.currentServer.timeoutAdvice];
-    if ([self.lastResponse isKindOfClass: [NSHTTPURLResponse class]]) {
-        NSHTTPURLResponse *response = (NSHTTPURLResponse*) self.lastResponse;
-        if (response.statusCode >= 400) {
-            // EPIC FAIL
-            [self disconnectNow];
-            return;
+    if (dataTask == self.eventSourceTask) {
+        for (NSData *event in [self.eventSourceParser eventsByAppendingData: data]) {
+            [self receiveData: event];
         }
+    } else if (dataTask == self.publishTask) {
+        [self.publishData appendData: data];
+    } else if (dataTask == self.httpTask) {
+        [self.httpData appendData: data];
     }
-    if (self.currentServer.clientID) {
-        [self startHTTPConnection];
+}
+
+- (void) URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error
+{
+    NSInteger statusCode = 0;
+    if ([task.response isKindOfClass: [NSHTTPURLResponse class]]) {
+        statusCode = ((NSHTTPURLResponse*) task.response).statusCode;
+    }
+    if (task == self.httpTask) {
+        self.httpTask = nil;
+        [self httpTaskDidCompleteWithError: error statusCode: statusCode];
+    } else if (task == self.eventSourceTask) {
+        self.eventSourceTask = nil;
+        [self eventSourceTaskDidCompleteWithError: error statusCode: statusCode];
+    } else if (task == self.publishTask) {
+        self.publishTask = nil;
+        [self publishTaskDidCompleteWithError: error statusCode: statusCode];
     }
+    // Anything else was cancelled and has already been replaced, or was
+    // only there to warm up a connection.
 }
 
 #pragma mark - Message Assembly
 
 - (NSDictionary*) handshakeMessage
+{
+    return [self handshakeMessageForServer: self.currentServer];
+}
+
+- (NSDictionary*) handshakeMessageForServer: (FayeServer*) server
 {
     NSArray *connectionTypes = nil;
-    if ([self.currentServer connectsWithLongPolling]) {
+    if ([server connectsWithLongPolling] && self.prefersEventSource) {
+        connectionTypes = @[@"eventsource", @"long-polling"];
+    } else if ([server connectsWithLongPolling]) {
         connectionTypes = @[@"long-polling"];
     } else {
         connectionTypes = @[@"websocket"];
@@ -545,7 +1988,17 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
      @"minimumVersion": FayeClientBayeuxVersion,
      @"supportedConnectionTypes": connectionTypes
      }];
-    NSDictionary *ext = [self mergeExtensionDictionaries: @[self.extension, self.handshakeExtension]];
+    NSDictionary *encodingExtension = @{};
+    if (self.preferredMessageEncoding == FayeClientMessageEncodingMessagePack &&
+        [server connectsWithWebSockets])
+    {
+        encodingExtension = @{ @"encodings": @[FayeClientMessagePackEncodingName, FayeClientJSONEncodingName] };
+    }
+    NSDictionary *frameExtension = @{};
+    if (self.maximumFrameSize > 0) {
+        frameExtension = @{ @"maxFrameSize": @(self.maximumFrameSize) };
+    }
+    NSDictionary *ext = [self mergeExtensionDictionaries: @[self.extension, self.handshakeExtension, encodingExtension, frameExtension]];
     if ([ext count] > 0) {
         handshakeMessage[@"ext"] = ext;
     }
@@ -555,7 +2008,9 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
 - (NSDictionary*) connectMessage
 {
     NSString *connectionType = @"websocket";
-    if ([self.currentServer connectsWithLongPolling]) {
+    if (self.currentServer.streamsWithEventSource) {
+        connectionType = @"eventsource";
+    } else if ([self.currentServer connectsWithLongPolling]) {
         connectionType = @"long-polling";
     }
     NSMutableDictionary *connectMessage = [NSMutableDictionary new];
@@ -569,7 +2024,9 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     if ([ext count] > 0) {
         connectMessage[@"ext"] = ext;
     }
-    if (self.queuedMessages.count > 0 && [self.currentServer connectsWithLongPolling]) {
+    if (self.queuedMessages.count > 0 && [self.currentServer connectsWithLongPolling] &&
+        !self.currentServer.streamsWithEventSource)
+    {
         connectMessage[@"advice"] = @{ @"timeout": @0 };
     }
     return connectMessage.copy;
@@ -600,7 +2057,14 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
      @"clientId": self.currentServer.clientID
      }];
     FayeChannel *channel = self.subscriptions[channelPath];
-    NSDictionary *ext = [self mergeExtensionDictionaries: @[self.extension, channel.extension]];
+    NSDictionary *replayExtension = @{};
+    if (channel.options & FayeChannelSubscriptionOptionSequenced) {
+        NSDictionary *positions = [self.sequenceTracker replayPositionsForSubscription: channelPath];
+        if (positions.count > 0) {
+            replayExtension = @{ @"replay": positions };
+        }
+    }
+    NSDictionary *ext = [self mergeExtensionDictionaries: @[self.extension, channel.extension, replayExtension]];
     if ([ext count] > 0) {
         subscribeMessage[@"ext"] = ext;
     }
@@ -624,14 +2088,39 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     return unsubscribeMessage.copy;
 }
 
-- (NSDictionary*) publishMessageForChannelPath: (NSString*) channelPath withData: (NSDictionary*) data extension: (NSDictionary*) extension
+// Bayeux allows a list of channels in one (un)subscribe.  Batches only ever
+// hold channels with no extension or replay positions of their own.
+- (NSDictionary*) subscriptionMessageForChannel: (NSString*) metaChannel channelPaths: (NSArray*) channelPaths
+{
+    if (channelPaths.count == 1) {
+        return [metaChannel isEqualToString: FayeClientSubscribeChannel] ?
+            [self subscribeMessageForChannelPath: channelPaths.firstObject] :
+            [self unsubscribeMessageForChannelPath: channelPaths.firstObject];
+    }
+    NSMutableDictionary *message = [NSMutableDictionary new];
+    [message addEntriesFromDictionary:
+     @{ @"channel": metaChannel,
+     @"id": [self nextMessageID],
+     @"subscription": channelPaths,
+     @"clientId": self.currentServer.clientID
+     }];
+    if ([self.extension count] > 0) {
+        message[@"ext"] = self.extension;
+    }
+    return message.copy;
+}
+
+- (NSDictionary*) publishMessageForChannelPath: (NSString*) channelPath
+                                      withData: (NSDictionary*) data
+                                     extension: (NSDictionary*) extension
+                                     messageID: (NSString*) messageID
 {
     NSMutableDictionary *publishMessage = [NSMutableDictionary new];
     [publishMessage addEntriesFromDictionary: @{
      @"channel": channelPath,
      @"data": data,
      @"clientId": self.currentServer.clientID,
-     @"id": [self nextMessageID]
+     @"id": messageID ?: [self nextMessageID]
      }];
     FayeChannel *fayeChannel = self.subscriptions[channelPath];
     if (extension == nil) {
@@ -690,16 +2179,30 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     return messages.copy;
 }
 
-- (NSData*) dataForNextUpload
+- (NSArray*) framesForNextUpload
 {
     if (self.currentServer.connectsWithLongPolling) {
-        return [self dataForNextUploadWithConnectMessage: YES];
+        return [self framesForNextUploadWithConnectMessage: YES];
     } else {
-        return [self dataForNextUploadWithConnectMessage: NO];
+        return [self framesForNextUploadWithConnectMessage: NO];
     }
 }
 
-- (NSData*) dataForNextUploadWithConnectMessage: (BOOL) connectMessage
+- (NSArray*) framesForNextUploadWithConnectMessage: (BOOL) connectMessage
+{
+    NSArray *messages = [self messagesForNextUploadWithConnectMessage: connectMessage];
+    NSError *error = nil;
+    NSArray *frames = [self framesWithMessages: messages error: &error];
+    if (frames == nil) {
+        [self _failWithError: error];
+        return nil;
+    }
+    return frames;
+}
+
+// The queue as it'll go up, once the data delegate and interceptors have had
+// their say.
+- (NSArray*) messagesForNextUploadWithConnectMessage: (BOOL) connectMessage
 {
     NSMutableArray *proposedMessages = [NSMutableArray new];
     if (connectMessage) {
@@ -716,6 +2219,11 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
             if (item.sentMessageHandler != NULL) {
                 self.sentMessageHandlers[message[@"id"]] = item.sentMessageHandler;
             }
+            if (self.resumingSession) {
+                @synchronized (self.unconfirmedPublications) {
+                    [self.unconfirmedPublications addObject: item];
+                }
+            }
         }
         index++;
     }
@@ -730,13 +2238,122 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     } else {
         [actualMessages addObjectsFromArray: proposedMessages];
     }
-    NSError *error = nil;
-    NSData *data = [NSJSONSerialization dataWithJSONObject: actualMessages options: 0 error: &error];
-    if (error) {
-        [self _failWithError: error];
-        return nil;
+    NSArray *messagesToSend = actualMessages;
+    for (id <FayeClientInterceptor> interceptor in self.messageInterceptors) {
+        messagesToSend = [interceptor fayeClient: self willSendMessages: messagesToSend] ?: @[];
+    }
+    return messagesToSend;
+}
+
+- (NSArray*) framesWithMessages: (NSArray*) messages error: (NSError**) error
+{
+    NSUInteger maximumFrameSize = self.maximumFrameSize;
+    if (maximumFrameSize == 0) {
+        NSData *data = [self dataWithMessages: messages error: error];
+        return data ? @[data] : nil;
+    }
+    
+    BOOL messagePack = self.currentServer.messageEncoding == FayeClientMessageEncodingMessagePack;
+    NSData *(^encode)(NSDictionary*) = ^NSData*(NSDictionary *message) {
+        if (messagePack) {
+            return [FayeMessagePack dataWithObject: message error: error];
+        }
+        return [NSJSONSerialization dataWithJSONObject: message options: 0 error: error];
+    };
+    // Array brackets (or header) plus a separator.
+    const NSUInteger framing = messagePack ? 5 : 3;
+    
+    // Bayeux processes a batch in order, so frames only ever split it.
+    NSMutableArray *elements = [NSMutableArray new];
+    for (NSDictionary *message in messages) {
+        NSData *element = encode(message);
+        if (element == nil) {
+            return nil;
+        }
+        NSString *channel = message[@"channel"];
+        if (element.length + framing <= maximumFrameSize) {
+            [elements addObject: element];
+            continue;
+        }
+        NSArray *chunks = nil;
+        if (message[@"data"] != nil && ![channel hasPrefix: @"/meta/"]) {
+            chunks = [FayeMessageChunker chunksOfPublishMessage: message
+                                                  maximumLength: maximumFrameSize - framing
+                                                 envelopeLength: ^NSUInteger(NSDictionary *chunk) {
+                                                     return encode(chunk).length;
+                                                 }];
+        }
+        if (chunks == nil) {
+            [self _debugMessage: @"Message on %@ exceeds the maximum frame size and can't be chunked; sending it whole.", channel];
+            [elements addObject: element];
+        } else {
+            // Acknowledgements come back per chunk; the last one stands for the message.
+            id messageID = message[@"id"];
+            dispatch_block_t sentHandler = messageID ? self.sentMessageHandlers[messageID] : NULL;
+            if (sentHandler != NULL) {
+                [self.sentMessageHandlers removeObjectForKey: messageID];
+                self.sentMessageHandlers[[chunks lastObject][@"id"]] = sentHandler;
+            }
+            for (NSDictionary *chunk in chunks) {
+                NSData *chunkElement = encode(chunk);
+                if (chunkElement == nil) {
+                    return nil;
+                }
+                [elements addObject: chunkElement];
+            }
+        }
+    }
+    
+    NSMutableArray *frames = [NSMutableArray new];
+    NSMutableArray *frameElements = [NSMutableArray new];
+    NSUInteger frameLength = 0;
+    for (NSData *element in elements) {
+        if (frameElements.count > 0 && frameLength + element.length + framing > maximumFrameSize) {
+            [frames addObject: [self frameWithEncodedMessages: frameElements messagePack: messagePack]];
+            [frameElements removeAllObjects];
+            frameLength = 0;
+        }
+        [frameElements addObject: element];
+        frameLength += element.length + 1;
+    }
+    if (frameElements.count > 0) {
+        [frames addObject: [self frameWithEncodedMessages: frameElements messagePack: messagePack]];
+    }
+    return frames;
+}
+
+- (NSData*) frameWithEncodedMessages: (NSArray*) elements messagePack: (BOOL) messagePack
+{
+    if (messagePack) {
+        return [FayeMessagePack arrayDataWithEncodedElements: elements];
+    }
+    NSMutableData *frame = [NSMutableData dataWithBytes: "[" length: 1];
+    [elements enumerateObjectsUsingBlock:^(NSData *element, NSUInteger index, BOOL *stop) {
+        if (index > 0) {
+            [frame appendBytes: "," length: 1];
+        }
+        [frame appendData: element];
+    }];
+    [frame appendBytes: "]" length: 1];
+    return frame;
+}
+
+- (NSData*) dataWithMessages: (NSArray*) messages error: (NSError**) error
+{
+    if (self.currentServer.messageEncoding == FayeClientMessageEncodingMessagePack) {
+        return [FayeMessagePack dataWithObject: messages error: error];
+    }
+    return [NSJSONSerialization dataWithJSONObject: messages options: 0 error: error];
+}
+
+- (NSArray*) messagesWithData: (NSData*) data error: (NSError**) error
+{
+    // Sniff rather than trust the negotiated encoding: replies to the handshake
+    // itself (and anything a proxy sends us) are still JSON.
+    if ([FayeMessagePack dataLooksLikeMessagePack: data]) {
+        return [FayeMessagePack objectWithData: data error: error];
     }
-    return data;
+    return [NSJSONSerialization JSONObjectWithData: data options: 0 error: error];
 }
 
 #pragma mark - Internals
@@ -768,7 +2385,7 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
 {
     [self setSubscriptionStatus: FayeChannelSubscriptionStatusSubscribing forChannel: channel];
     [self queueMessage: [FayeMessageQueueItem itemWithBlock:^NSDictionary *{
-        return [self subscribeMessageForChannelPath: channel];
+        return [self trackSubscriptionMessage: [self subscribeMessageForChannelPath: channel]];
     }]];
 }
 
@@ -776,10 +2393,114 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
 {
     [self setSubscriptionStatus: FayeChannelSubscriptionStatusUnsubscribing forChannel: channel];
     [self queueMessage: [FayeMessageQueueItem itemWithBlock:^NSDictionary *{
-        return [self unsubscribeMessageForChannelPath: channel];
+        return [self trackSubscriptionMessage: [self unsubscribeMessageForChannelPath: channel]];
     }]];
 }
 
+// Whether the channel's (un)subscribe needs a message to itself.
+- (BOOL) channelNeedsOwnSubscriptionMessage: (NSString*) channel
+{
+    FayeChannel *fayeChannel = self.subscriptions[channel];
+    return fayeChannel.extension.count > 0 || (fayeChannel.options & FayeChannelSubscriptionOptionSequenced);
+}
+
+- (void) queueChannelSubscriptions: (NSArray*) channels
+{
+    NSMutableArray *batch = [NSMutableArray new];
+    for (NSString *channel in channels) {
+        if (!self.batchesSubscriptions || [self channelNeedsOwnSubscriptionMessage: channel]) {
+            [self queueChannelSubscription: channel];
+        } else {
+            [self setSubscriptionStatus: FayeChannelSubscriptionStatusSubscribing forChannel: channel];
+            [batch addObject: channel];
+        }
+    }
+    if (batch.count > 0) {
+        [self queueMessage: [FayeMessageQueueItem itemWithBlock:^NSDictionary *{
+            return [self trackSubscriptionMessage:
+                    [self subscriptionMessageForChannel: FayeClientSubscribeChannel channelPaths: batch]];
+        }]];
+    }
+}
+
+- (void) queueChannelUnsubscriptions: (NSArray*) channels
+{
+    NSMutableArray *batch = [NSMutableArray new];
+    for (NSString *channel in channels) {
+        if (!self.batchesSubscriptions || [self channelNeedsOwnSubscriptionMessage: channel]) {
+            [self queueChannelUnsubscription: channel];
+        } else {
+            [self setSubscriptionStatus: FayeChannelSubscriptionStatusUnsubscribing forChannel: channel];
+            [batch addObject: channel];
+        }
+    }
+    if (batch.count > 0) {
+        [self queueMessage: [FayeMessageQueueItem itemWithBlock:^NSDictionary *{
+            return [self trackSubscriptionMessage:
+                    [self subscriptionMessageForChannel: FayeClientUnsubscribeChannel channelPaths: batch]];
+        }]];
+    }
+}
+
+- (NSDictionary*) trackSubscriptionMessage: (NSDictionary*) message
+{
+    @synchronized (self.subscriptionRequests) {
+        self.subscriptionRequests[message[@"id"]] = message;
+    }
+    return message;
+}
+
+// Read queue only.  Whatever the server refused mustn't be left waiting for a
+// reply that's already come, or it'd never be asked for again.
+- (void) handleRefusedSubscriptionMessage: (FayeMessage*) message
+{
+    if (message.fayeId == nil) {
+        return;
+    }
+    NSDictionary *request = nil;
+    @synchronized (self.subscriptionRequests) {
+        request = self.subscriptionRequests[message.fayeId];
+        [self.subscriptionRequests removeObjectForKey: message.fayeId];
+    }
+    if (request == nil) {
+        return;
+    }
+    BOOL subscribing = [request[@"channel"] isEqualToString: FayeClientSubscribeChannel];
+    FayeChannelSubscriptionStatus pending = subscribing ?
+        FayeChannelSubscriptionStatusSubscribing : FayeChannelSubscriptionStatusUnsubscribing;
+    id subscription = request[@"subscription"];
+    NSArray *channels = [subscription isKindOfClass: [NSArray class]] ? subscription : @[subscription];
+    NSMutableArray *waiting = [NSMutableArray new];
+    for (NSString *channel in channels) {
+        if ([self subscriptionStatusForChannel: channel] == pending) {
+            [waiting addObject: channel];
+        }
+    }
+    
+    if (channels.count > 1) {
+        // Likely the list rather than the channels; ask for each on its own.
+        [self _debugMessage: @"Server refused a list of %lu channels; sending them one at a time.", (unsigned long) channels.count];
+        self.batchesSubscriptions = NO;
+        for (NSString *channel in waiting) {
+            if (subscribing) {
+                [self queueChannelSubscription: channel];
+            } else {
+                [self queueChannelUnsubscription: channel];
+            }
+        }
+        return;
+    }
+    for (NSString *channel in waiting) {
+        // Either way we no longer have (or want) it.  A refused subscription
+        // is tried again on the next handshake.
+        FayeChannel *fayeChannel = self.subscriptions[channel];
+        if (subscribing) {
+            fayeChannel.markedForUnsubscription = NO;
+        }
+        [self setSubscriptionStatus: FayeChannelSubscriptionStatusUnsubscribed forChannel: channel];
+    }
+}
+
 - (void) queueConnectMessage
 {
     // Connect messages should probably always go first.
@@ -795,31 +2516,27 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
         dispatch_async(self.writeQueue, ^{
             self.alternateQueue = self.queuedMessages.mutableCopy;
             [self.queuedMessages removeAllObjects];
-            NSData *data = [self dataForNextUploadWithConnectMessage: YES];
+            NSArray *frames = [self framesForNextUploadWithConnectMessage: YES];
             self.queuedMessages = self.alternateQueue;
             self.alternateQueue = nil;
-            [self _debugMessage: @"Sending connect message: %@", [[NSString alloc] initWithData: data encoding: NSUTF8StringEncoding]];
-            if (data) {
-                [self.webSocket send: data];
-            }
+            [self _debugMessage: @"Sending connect message: %@", [[NSString alloc] initWithData: [frames lastObject] encoding: NSUTF8StringEncoding]];
+            [self sendFramesToWebSocket: frames];
         });
     }
 }
 
 - (void) sendMessagesAndEmptyQueueDelayed
 {
-    dispatch_async(dispatch_get_main_queue(), ^{
-        // The only thread I know *for sure* that supports the runloop mode that this requires is main
-        [NSObject cancelPreviousPerformRequestsWithTarget: self selector: @selector(sendMessagesAndEmptyQueue) object: nil];
-        [self performSelector: @selector(sendMessagesAndEmptyQueue) withObject: nil afterDelay: 0.2];
-    });
+    FayeClientScheduleTimer(_sendTimer, 0.2);
 }
 
 - (void) sendMessagesAndEmptyQueue
 {
     if (self.queuedMessages.count > 0 && self.currentServer.clientID) {
         [self _debugMessage: @"Sending queue: %@", self.queuedMessages];
-        if ([self.currentServer connectsWithLongPolling]) {
+        if (self.currentServer.streamsWithEventSource) {
+            [self startPublishConnection];
+        } else if ([self.currentServer connectsWithLongPolling]) {
             [self startHTTPConnection];
         } else {
             [self sendCurrentMessageQueueToWebSocket];
@@ -827,26 +2544,72 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     }
 }
 
-- (void) setConnectionStatus:(FayeClientConnectionStatus)connectionStatus
+- (void) setConnectionStatus:(FayeClientConnectionStatus)connectionStatus
+{
+    if (connectionStatus != _connectionStatus) {
+        [self willChangeValueForKey: @"connectionStatus"];
+        _connectionStatus = connectionStatus;
+        [self didChangeValueForKey: @"connectionStatus"];
+        if (connectionStatus == FayeClientConnectionStatusConnected) {
+            [self sendRestoredPublications];
+        } else if (connectionStatus == FayeClientConnectionStatusDisconnected) {
+            // Cancels whatever was still running, and closes its connections.
+            dispatch_async(self.networkQueue, ^{
+                [_urlSession invalidateAndCancel];
+                _urlSession = nil;
+            });
+        }
+        FayeClientConnectionStatusHandlerBlock handler = self.connectionStatusHandler;
+        BOOL notifyDelegate = _delegateRespondsTo.statusChanged;
+        dispatch_async(self.callbackQueue, ^{
+            if (handler != NULL) {
+                handler(self, nil);
+            }
+            if (notifyDelegate) {
+                [self.delegate fayeClientDidChangeConnectionStatus: self];
+            }
+        });
+    }
+}
+
+// Network queue only.  Received batches go through the interceptors, then
+// on to the read queue in the order they arrived.
+- (void) receiveData: (NSData*) data
 {
-    if (connectionStatus != _connectionStatus) {
-        [self willChangeValueForKey: @"connectionStatus"];
-        _connectionStatus = connectionStatus;
-        [self didChangeValueForKey: @"connectionStatus"];
-        if (self.connectionStatusHandler != NULL) {
-            self.connectionStatusHandler(self, nil);
-        }
-        if (_delegateRespondsTo.statusChanged) {
-            [self.delegate fayeClientDidChangeConnectionStatus: self];
+    [self.incomingChain processData: data output: ^(NSData *interceptedData) {
+        if (interceptedData != nil) {
+            dispatch_async(self.readQueue, ^{
+                [self handleReceivedData: interceptedData];
+            });
         }
-    }
+    }];
+}
+
+// Network queue only.  Runs `block` on the read queue after every batch
+// received so far has been handled.
+- (void) afterReceivedData: (dispatch_block_t) block
+{
+    [self.incomingChain enqueueBlock: ^{
+        dispatch_async(self.readQueue, block);
+    }];
 }
 
 - (void) handleReceivedData: (NSData*) data
 {
+    // Routing only needs a few small members of each message, so plain JSON
+    // batches are scanned rather than parsed and each message's data is left
+    // encoded until its subscription says how it wants it.  Anything that
+    // wants to see the whole decoded batch takes the long way.
+    if (!self.debug && !_dataDelegateRespondsTo.willReceive &&
+        ![FayeMessagePack dataLooksLikeMessagePack: data] &&
+        [self handleReceivedJSONData: data])
+    {
+        return;
+    }
+    
     NSError *error = nil;
-    NSArray *messages = [NSJSONSerialization JSONObjectWithData: data options: 0 error: &error];
-    if (error) {
+    NSArray *messages = [self messagesWithData: data error: &error];
+    if (messages == nil) {
         [self _failWithError: error];
         return;
     }
@@ -859,41 +2622,272 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     [self resetTimeoutTimer];
     
     for (NSDictionary *proposedMessageJSON in messages) {
-        NSDictionary *messageJSON = proposedMessageJSON;
-        if (_dataDelegateRespondsTo.willReceive) {
-            messageJSON = [self.dataDelegate fayeClient: self willReceiveMessage: proposedMessageJSON];
-        }
-        // At this time, I'm going to allow returning nil to mean "ignore the message completely".
-        if (messageJSON == nil) {
-            continue;
-        }
-        FayeMessage *message = [[FayeMessage alloc] initWithDict: messageJSON];
-        if (message.advice) {
-            [self handleAdvice: message.advice];
-            // Advice can cause a disconnect... we shouldn't proceed if we've been disconnected.
-            if (self.connectionStatus == FayeClientConnectionStatusDisconnected) {
+        @autoreleasepool {
+            NSDictionary *messageJSON = proposedMessageJSON;
+            if (_dataDelegateRespondsTo.willReceive) {
+                messageJSON = [self.dataDelegate fayeClient: self willReceiveMessage: proposedMessageJSON];
+            }
+            // At this time, I'm going to allow returning nil to mean "ignore the message completely".
+            if (messageJSON == nil) {
+                continue;
+            }
+            FayeMessage *message = [self.messagePool messageWithDict: messageJSON];
+            if (![self handleMessage: message]) {
                 return;
             }
+            [self.messagePool recycleMessage: message];
         }
-        if (message.successful != nil && message.successful.boolValue == NO) {
-            [self _debugMessage: @"Unsuccessful faye message: %@", message];
-            continue;
+    }
+}
+
+typedef struct {
+    __unsafe_unretained NSData *data;
+    __unsafe_unretained NSMutableDictionary *members;
+    __unsafe_unretained FayeChannelNameTable *names;
+    FayeJSONSpan payload;
+    BOOL hasPayload;
+} FayeClientMessageScan;
+
+static inline BOOL FayeClientKeyIs(const uint8_t *bytes, FayeJSONSpan key, const char *name, size_t length)
+{
+    return key.length == length && memcmp(bytes + key.location, name, length) == 0;
+}
+
+static BOOL FayeClientScanMessageMember(void *context, FayeJSONSpan key, FayeJSONSpan value)
+{
+    FayeClientMessageScan *scan = context;
+    const uint8_t *bytes = scan->data.bytes;
+    if (FayeClientKeyIs(bytes, key, "data", 4)) {
+        scan->payload = value;
+        scan->hasPayload = YES;
+        return YES;
+    }
+    if (FayeClientKeyIs(bytes, key, "channel", 7)) {
+        // Already interned by the caller.
+        return YES;
+    }
+    if (FayeClientKeyIs(bytes, key, "clientId", 8) && FayeJSONSpanHasPrefix(bytes, value, '"') &&
+        memchr(bytes + value.location, '\\', value.length) == NULL)
+    {
+        // The same on every message; no sense allocating it each time.
+        NSString *clientId = [scan->names stringWithUTF8Bytes: bytes + value.location + 1
+                                                       length: value.length - 2
+                                                          tag: NULL];
+        if (clientId != nil) {
+            scan->members[@"clientId"] = clientId;
+        }
+        return YES;
+    }
+    NSString *keyString = [FayeJSONScanner stringWithSpan: (FayeJSONSpan) { key.location - 1, key.length + 2 }
+                                                   inData: scan->data];
+    id object = [FayeJSONScanner objectWithSpan: value inData: scan->data];
+    if (keyString != nil && object != nil) {
+        scan->members[keyString] = object;
+    }
+    return YES;
+}
+
+typedef struct {
+    FayeJSONSpan *spans;
+    size_t count;
+    size_t capacity;
+} FayeClientElementList;
+
+static BOOL FayeClientCollectElement(void *context, FayeJSONSpan element)
+{
+    FayeClientElementList *list = context;
+    if (list->count == list->capacity) {
+        list->capacity = MAX(16, list->capacity * 2);
+        list->spans = reallocf(list->spans, list->capacity * sizeof(FayeJSONSpan));
+    }
+    list->spans[list->count++] = element;
+    return YES;
+}
+
+// Returns NO, having done nothing, if the batch doesn't look like an array of
+// objects; the caller then parses it properly and reports the error.
+- (BOOL) handleReceivedJSONData: (NSData*) data
+{
+    const uint8_t *bytes = data.bytes;
+    FayeJSONSpan root;
+    if (!FayeJSONRootSpan(bytes, data.length, &root) || !FayeJSONSpanHasPrefix(bytes, root, '[')) {
+        return NO;
+    }
+    // Split the whole batch up front so a malformed one is rejected before
+    // any of it has been acted on.
+    FayeClientElementList elements = { NULL, 0, 0 };
+    if (!FayeJSONEnumerateElements(bytes, root, FayeClientCollectElement, &elements)) {
+        free(elements.spans);
+        return NO;
+    }
+    for (size_t i = 0; i < elements.count; i++) {
+        if (!FayeJSONSpanHasPrefix(bytes, elements.spans[i], '{')) {
+            free(elements.spans);
+            return NO;
         }
+    }
+    
+    [self resetTimeoutTimer];
+    
+    // Each message gets its own pool and reuses the same scratch members
+    // dictionary and (usually) the same FayeMessage, so a huge batch only
+    // ever has about one message's worth of objects alive at a time.
+    NSMutableDictionary *members = [NSMutableDictionary new];
+    for (size_t i = 0; i < elements.count; i++) {
+        @autoreleasepool {
+            FayeJSONSpan element = elements.spans[i];
+            FayeJSONSpan span;
+            NSString *channelPath = nil;
+            FayeChannelTag channelTag = FayeChannelTagUnknown;
+            if (FayeJSONFindMember(bytes, element, "channel", &span) && FayeJSONSpanHasPrefix(bytes, span, '"')) {
+                if (memchr(bytes + span.location, '\\', span.length) == NULL) {
+                    channelPath = [self.channelNames stringWithUTF8Bytes: bytes + span.location + 1
+                                                                  length: span.length - 2
+                                                                     tag: &channelTag];
+                } else {
+                    channelPath = [self.channelNames internString: [FayeJSONScanner stringWithSpan: span inData: data]
+                                                              tag: &channelTag];
+                }
+            }
+            // No subscription means handleOtherMessage: drops it anyway, so
+            // its data is never decoded at all.
+            FayeChannel *subscription = nil;
+            if (channelTag == FayeChannelTagOther && ![channelPath hasPrefix: @"/meta/"]) {
+                subscription = [self subscriptionForChannelPath: channelPath];
+            }
+            BOOL passedFilter = NO;
+            if (subscription.filter != nil &&
+                !(subscription.options & FayeChannelSubscriptionOptionSequenced) &&
+                FayeJSONFindMember(bytes, element, "data", &span) &&
+                !(FayeJSONFindMember(bytes, element, "ext", &span) &&
+                  FayeJSONFindMember(bytes, span, FayeMessageChunkExtensionKey.UTF8String, &span)))
+            {
+                // Sequenced messages are filtered after reordering instead,
+                // or every rejected one would look like a gap.  Chunks are
+                // filtered once they've been put back together.
+                if (![subscription.filter matchesJSONData: data range: NSMakeRange(element.location, element.length)]) {
+                    self.filteredMessageCount++;
+                    continue;
+                }
+                passedFilter = YES;
+            }
         
-        if ([message.channel isEqualToString: FayeClientConnectChannel]) {
+            [members removeAllObjects];
+            FayeClientMessageScan scan = { data, members, self.channelNames, { 0, 0 }, NO };
+            if (!FayeJSONEnumerateMembers(bytes, element, FayeClientScanMessageMember, &scan)) {
+                [self _debugMessage: @"Skipping malformed message in batch"];
+                continue;
+            }
+            FayeMessage *message = [self.messagePool messageWithDict: members];
+            message.channel = channelPath;
+            message.channelTag = channelTag;
+            message.passedFilter = passedFilter;
+            if (scan.hasPayload) {
+                if (subscription != nil) {
+                    [self attachPayload: scan.payload inData: data toMessage: message forSubscription: subscription];
+                } else if (channelTag != FayeChannelTagOther || [message.channel hasPrefix: @"/meta/"]) {
+                    message.data = [FayeJSONScanner objectWithSpan: scan.payload inData: data];
+                }
+            }
+            if (![self handleMessage: message]) {
+                break;
+            }
+            [self.messagePool recycleMessage: message];
+        }
+    }
+    free(elements.spans);
+    return YES;
+}
+
+- (void) attachPayload: (FayeJSONSpan) payload
+                inData: (NSData*) data
+             toMessage: (FayeMessage*) message
+       forSubscription: (FayeChannel*) channel
+{
+    if ([FayeMessageChunker messageIsChunk: message]) {
+        // A base64 string; the reassembled message gets the real data.
+        message.data = [FayeJSONScanner objectWithSpan: payload inData: data];
+    } else if (channel.options & FayeChannelSubscriptionOptionRawData) {
+        message.rawData = [FayeJSONScanner dataWithSpan: payload inData: data];
+    } else if ((channel.options & FayeChannelSubscriptionOptionLazyDecode) &&
+               FayeJSONSpanHasPrefix(data.bytes, payload, '{'))
+    {
+        message.data = [[FayeLazyJSONDictionary alloc] initWithData: data span: payload];
+    } else {
+        message.data = [FayeJSONScanner objectWithSpan: payload inData: data];
+    }
+}
+
+// Returns NO if the message left us disconnected and the rest of the batch
+// should be dropped.
+- (BOOL) handleMessage: (FayeMessage*) message
+{
+    if (message.advice) {
+        [self handleAdvice: message.advice];
+        // Advice can cause a disconnect... we shouldn't proceed if we've been disconnected.
+        if (self.connectionStatus == FayeClientConnectionStatusDisconnected) {
+            return NO;
+        }
+    }
+    if (message.successful != nil && message.successful.boolValue == NO) {
+        [self _debugMessage: @"Unsuccessful faye message: %@", message];
+        [self handleRefusedSubscriptionMessage: message];
+        return YES;
+    }
+    
+    if (message.channelTag == FayeChannelTagUnknown) {
+        FayeChannelTag tag = FayeChannelTagUnknown;
+        message.channel = [self.channelNames internString: message.channel tag: &tag];
+        message.channelTag = tag;
+    }
+    // WebSocket connects are held, so anything else the server accepts (or
+    // delivers) is taken as proof the session survived, too.
+    if (self.resumingSession &&
+        (message.channelTag == FayeChannelTagConnect || message.successful.boolValue ||
+         message.channelTag == FayeChannelTagOther))
+    {
+        [self _debugMessage: @"Session resumed."];
+        self.resumingSession = NO;
+        @synchronized (self.unconfirmedPublications) {
+            [self.unconfirmedPublications removeAllObjects];
+        }
+        if (self.connectionStatus == FayeClientConnectionStatusConnecting) {
+            self.connectionStatus = FayeClientConnectionStatusConnected;
+        }
+        [self queueSubscriptionsIncludingSubscribed: NO];
+        if ([self.currentServer connectsWithWebSockets]) {
+            // Whatever was queued while the resume was unconfirmed was held
+            // back, and the connect that confirmed it won't be answered for
+            // a while yet.
+            [self sendMessagesAndEmptyQueueDelayed];
+        }
+    }
+    switch (message.channelTag) {
+        case FayeChannelTagConnect:
             [self handleConnectMessage: message];
-        } else if ([message.channel isEqualToString: FayeClientDisconnectChannel]) {
+            break;
+        case FayeChannelTagDisconnect:
             [self handleDisconnectMessage: message];
-        } else if ([message.channel isEqualToString: FayeClientHandshakeChannel]) {
+            break;
+        case FayeChannelTagHandshake:
             [self handleHandshakeMessage: message];
-        } else if ([message.channel isEqualToString: FayeClientSubscribeChannel]) {
+            break;
+        case FayeChannelTagSubscribe:
             [self handleSubscribeMessage: message];
-        } else if ([message.channel isEqualToString: FayeClientUnsubscribeChannel]) {
+            break;
+        case FayeChannelTagUnsubscribe:
             [self handleUnsubscribeMessage: message];
-        } else {
-            [self handleOtherMessage: message];
-        }
+            break;
+        default:
+            if (self.heldMessages.count > 0 || [self deliveryIsThrottled]) {
+                // Meta traffic carries on; only deliveries wait.
+                [self holdMessage: message];
+            } else {
+                [self handleOtherMessage: message];
+            }
+            break;
     }
+    return YES;
 }
 
 - (void) handleConnectMessage: (FayeMessage*) message
@@ -933,42 +2927,139 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
     self.currentServer.clientID = message.clientId;
     [self _debugMessage: @"Handshake complete.  New client ID: '%@'", message.clientId];
     
+    if ([self.currentServer connectsWithWebSockets] &&
+        [message.ext[@"encoding"] isEqual: FayeClientMessagePackEncodingName])
+    {
+        self.currentServer.messageEncoding = FayeClientMessageEncodingMessagePack;
+        [self _debugMessage: @"Server agreed to MessagePack encoding."];
+    } else {
+        self.currentServer.messageEncoding = FayeClientMessageEncodingJSON;
+    }
+    
+    self.currentServer.streamsWithEventSource = (self.prefersEventSource &&
+                                                 [self.currentServer connectsWithLongPolling] &&
+                                                 [message.supportedConnectionTypes containsObject: @"eventsource"]);
+    if (self.currentServer.streamsWithEventSource) {
+        [self _debugMessage: @"Server agreed to EventSource streaming."];
+        [self startEventSourceConnection];
+    }
+    
     if ([self.currentServer connectsWithWebSockets]) {
         if (self.alternateQueue) {
             [self.queuedMessages addObjectsFromArray: self.alternateQueue];
             self.alternateQueue = nil;
         }
         [self queueConnectMessage];
+        if (self.queuedMessages.count > 0) {
+            // Publishes left over from a failed resume, say.
+            [self sendMessagesAndEmptyQueueDelayed];
+        }
     }
     
     if (self.connectionStatus == FayeClientConnectionStatusConnecting) {
         self.connectionStatus = FayeClientConnectionStatusConnected;
     }
     
+    [self queueSubscriptionsIncludingSubscribed: YES];
+}
+
+// The server turned those publishes away along with the old client ID, so
+// they go back to the front of the queue, in order, for after the handshake.
+- (void) requeueUnconfirmedPublications
+{
+    NSArray *items = nil;
+    @synchronized (self.unconfirmedPublications) {
+        items = self.unconfirmedPublications.copy;
+        [self.unconfirmedPublications removeAllObjects];
+    }
+    if (items.count == 0) {
+        return;
+    }
+    [self _debugMessage: @"Requeueing %lu publishes sent to the expired session.", (unsigned long) items.count];
+    [items enumerateObjectsUsingBlock:^(FayeMessageQueueItem *item, NSUInteger index, BOOL *stop) {
+        [self queueMessage: item atIndex: index];
+    }];
+}
+
+// A new session knows none of our channels; a resumed one still has the
+// ones it had.
+- (void) queueSubscriptionsIncludingSubscribed: (BOOL) includeSubscribed
+{
+    NSMutableArray *channels = [NSMutableArray new];
     for (NSString *channelPath in self.subscriptions) {
         FayeChannelSubscriptionStatus channelStatus = [self subscriptionStatusForChannel: channelPath];
-        if (channelStatus != FayeChannelSubscriptionStatusSubscribing &&
-            channelStatus != FayeChannelSubscriptionStatusUnsubscribing)
+        if (channelStatus == FayeChannelSubscriptionStatusSubscribing ||
+            channelStatus == FayeChannelSubscriptionStatusUnsubscribing ||
+            (channelStatus == FayeChannelSubscriptionStatusSubscribed && !includeSubscribed))
         {
-            [self queueChannelSubscription: channelPath];
+            continue;
         }
+        [channels addObject: channelPath];
+    }
+    [self queueChannelSubscriptions: channels];
+}
+
+- (void) forgetSubscriptionMessage: (FayeMessage*) message
+{
+    if (message.fayeId == nil) {
+        return;
+    }
+    @synchronized (self.subscriptionRequests) {
+        [self.subscriptionRequests removeObjectForKey: message.fayeId];
     }
 }
 
 - (void) handleSubscribeMessage: (FayeMessage*) message
 {
-    FayeChannel *channel = self.subscriptions[message.subscription];
-    NSAssert(channel != nil, @"Received subscribe message for channel: '%@' but I don't remember subscribing to it.", message.subscription);
-    NSAssert([self subscriptionStatusForChannel: channel.channelPath] == FayeChannelSubscriptionStatusSubscribing, @"Received subscribe message for channel: '%@' but its subscription status is in the wrong state.", message.subscription);
+    [self forgetSubscriptionMessage: message];
+    if (message.subscriptions != nil) {
+        // A batch; nothing in it has anything to replay.
+        for (NSString *channelPath in message.subscriptions) {
+            [self didSubscribeToChannel: channelPath];
+        }
+        return;
+    }
+    FayeChannel *channel = [self didSubscribeToChannel: message.subscription];
+    
+    // Sequenced subscriptions get what they missed back in the reply.
+    NSArray *replay = message.ext[@"replay"];
+    if ([replay isKindOfClass: [NSArray class]] && replay.count > 0) {
+        [self _debugMessage: @"Replaying %lu missed messages for '%@'", (unsigned long) replay.count, channel.channelPath];
+        for (NSDictionary *replayedMessage in replay) {
+            if ([replayedMessage isKindOfClass: [NSDictionary class]]) {
+                [self handleOtherMessage: [[FayeMessage alloc] initWithDict: replayedMessage]];
+            }
+        }
+    }
+}
+
+- (FayeChannel*) didSubscribeToChannel: (NSString*) channelPath
+{
+    FayeChannel *channel = self.subscriptions[channelPath];
+    NSAssert(channel != nil, @"Received subscribe message for channel: '%@' but I don't remember subscribing to it.", channelPath);
+    NSAssert([self subscriptionStatusForChannel: channel.channelPath] == FayeChannelSubscriptionStatusSubscribing, @"Received subscribe message for channel: '%@' but its subscription status is in the wrong state.", channelPath);
     [self setSubscriptionStatus: FayeChannelSubscriptionStatusSubscribed forChannel: channel.channelPath];
     [self _debugMessage: @"Subscribed to: '%@'", channel.channelPath];
+    return channel;
 }
 
 - (void) handleUnsubscribeMessage: (FayeMessage*) message
 {
-    FayeChannel *channel = self.subscriptions[message.subscription];
-    NSAssert(channel != nil, @"Received unsubscribe message for channel: '%@' but I don't remember subscribing to it.", message.subscription);
-    NSAssert([self subscriptionStatusForChannel: channel.channelPath] == FayeChannelSubscriptionStatusUnsubscribing, @"Received unsubscribe message for channel: '%@' but its subscription status is in the wrong state.", message.subscription);
+    [self forgetSubscriptionMessage: message];
+    if (message.subscriptions != nil) {
+        for (NSString *channelPath in message.subscriptions) {
+            [self didUnsubscribeFromChannel: channelPath];
+        }
+    } else {
+        [self didUnsubscribeFromChannel: message.subscription];
+    }
+}
+
+- (void) didUnsubscribeFromChannel: (NSString*) channelPath
+{
+    FayeChannel *channel = self.subscriptions[channelPath];
+    NSAssert(channel != nil, @"Received unsubscribe message for channel: '%@' but I don't remember subscribing to it.", channelPath);
+    NSAssert([self subscriptionStatusForChannel: channel.channelPath] == FayeChannelSubscriptionStatusUnsubscribing, @"Received unsubscribe message for channel: '%@' but its subscription status is in the wrong state.", channelPath);
     [self setSubscriptionStatus: FayeChannelSubscriptionStatusUnsubscribed forChannel: channel.channelPath];
     [self _debugMessage: @"Unsubscribed from: '%@'", channel.channelPath];
 }
@@ -977,34 +3068,203 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
 {
     dispatch_block_t sentHandler = self.sentMessageHandlers[message.fayeId];
     if (sentHandler) {
-        dispatch_async(dispatch_get_main_queue(), sentHandler);
+        dispatch_async(self.callbackQueue, sentHandler);
         [self.sentMessageHandlers removeObjectForKey: message.fayeId];
     }
     
-    FayeChannel *channel = self.subscriptions[message.channel];
+    if ([message hasData] && self.echoWindow != nil) {
+        NSString *messageID = [message.fayeId description];
+        NSDictionary *chunk = message.ext[FayeMessageChunkExtensionKey];
+        if ([chunk isKindOfClass: [NSDictionary class]] && chunk[@"id"] != nil) {
+            // Chunks go out as "<id>.<index>"; the echo was recorded as <id>.
+            messageID = [chunk[@"id"] description];
+        }
+        if ([messageID hasPrefix: self.echoIDPrefix] &&
+            ![self.echoWindow recordChannel: message.channel messageID: messageID extra: nil])
+        {
+            // Our own publish, already delivered when it was sent.
+            return;
+        }
+    }
+    
+    if ([message hasData] && message.fayeId != nil && self.duplicateWindow != nil) {
+        // Only messages carrying data: a publish acknowledgement has the same
+        // channel and id as the copy of the message the server sends back to us.
+        // Ids are per publishing client, so without something that says which
+        // client sent it, one client's message could pass for another's.
+        id extra = nil;
+        if (self.duplicateSuppressionExtensionKey != nil) {
+            extra = message.ext[self.duplicateSuppressionExtensionKey];
+            if (extra != nil && ![extra isKindOfClass: [NSString class]]) {
+                extra = [extra description];
+            }
+        }
+        if (message.clientId != nil) {
+            extra = extra != nil ? [NSString stringWithFormat: @"%@\n%@", message.clientId, extra] : message.clientId;
+        }
+        if (extra != nil &&
+            ![self.duplicateWindow recordChannel: message.channel messageID: [message.fayeId description] extra: extra])
+        {
+            self.suppressedDuplicateCount++;
+            [self _debugMessage: @"Dropping duplicate message %@ on %@", message.fayeId, message.channel];
+            return;
+        }
+    }
+    
+    NSString *replyChannel = self.replyChannel;
+    if (replyChannel != nil && [message hasData] && [message.channel isEqualToString: replyChannel]) {
+        [self handleReply: message];
+        return;
+    }
+    
+    FayeChannel *channel = [self subscriptionForChannelPath: message.channel];
+    if (channel == nil) {
+        [self _debugMessage: @"NO MATCH FOR CHANNEL %@", message.channel];
+        return;
+    }
+    
+    NSNumber *sequence = message.ext[@"seq"];
+    if ((channel.options & FayeChannelSubscriptionOptionSequenced) && [sequence isKindOfClass: [NSNumber class]]) {
+        // The tracker may hold on to it until the gap fills.
+        message.retained = YES;
+        NSArray *ready = [self.sequenceTracker messagesReadyAfterReceiving: message
+                                                                   sequence: sequence.longLongValue
+                                                                  onChannel: message.channel];
+        for (FayeMessage *readyMessage in ready) {
+            [self deliverMessage: readyMessage toSubscription: channel];
+        }
+    } else {
+        [self deliverMessage: message toSubscription: channel];
+    }
+}
+
+// Called wherever `subscriptions` gains or loses an entry, from any thread.
+- (void) subscriptionsDidChange
+{
+    atomic_fetch_add(&_subscriptionsGeneration, 1);
+}
+
+- (FayeChannel*) subscriptionForChannelPath: (NSString*) channelPath
+{
+    if (channelPath == nil) {
+        return nil;
+    }
+    int32_t subscriptionsGeneration = atomic_load(&_subscriptionsGeneration);
+    if (_routingCacheSubscriptionsGeneration != subscriptionsGeneration ||
+        _routingCacheNamesGeneration != self.channelNames.generation ||
+        self.routingCache.count >= FayeClientRoutingCacheLimit)
+    {
+        [self.routingCache removeAllObjects];
+        _routingCacheSubscriptionsGeneration = subscriptionsGeneration;
+        _routingCacheNamesGeneration = self.channelNames.generation;
+    }
+    id cached = [self.routingCache objectForKey: channelPath];
+    if (cached != nil) {
+        return cached == [NSNull null] ? nil : cached;
+    }
+    FayeChannel *channel = [self subscriptionForChannelPathUncached: channelPath];
+    [self.routingCache setObject: channel ?: [NSNull null] forKey: channelPath];
+    return channel;
+}
+
+- (FayeChannel*) subscriptionForChannelPathUncached: (NSString*) channelPath
+{
+    FayeChannel *channel = self.subscriptions[channelPath];
     if (channel == nil) {
         // Try to match a wildcard channel
-        NSMutableArray *messageChannelComponents = [message.channel componentsSeparatedByString:@"/"].mutableCopy;
+        NSMutableArray *messageChannelComponents = [channelPath componentsSeparatedByString:@"/"].mutableCopy;
         [messageChannelComponents removeLastObject];
         [messageChannelComponents addObject: @"*"];
         NSString *channelKey = [messageChannelComponents componentsJoinedByString: @"/"];
         channel = self.subscriptions[channelKey];
     }
-    if (channel != nil) {
-        if(message.data) {
-            if (_delegateRespondsTo.receivedMessage) {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    [self.delegate fayeClient: self didReceiveMessage: message.data onChannel: message.channel];
-                });
+    return channel;
+}
+
+- (void) deliverSequencedMessages: (NSArray*) messages
+{
+    for (FayeMessage *message in messages) {
+        FayeChannel *channel = [self subscriptionForChannelPath: message.channel];
+        if (channel != nil) {
+            [self deliverMessage: message toSubscription: channel];
+        }
+    }
+}
+
+- (void) deliverMessage: (FayeMessage*) message toSubscription: (FayeChannel*) channel
+{
+    if ([FayeMessageChunker messageIsChunk: message]) {
+        // After sequencing, which numbers each chunk separately.
+        message = [self.chunker messageByAddingChunk: message];
+        if (message == nil) {
+            return;
+        }
+    }
+    NSDictionary *data = message.data;
+    NSData *rawData = message.rawData;
+    if (data == nil && rawData != nil) {
+        // Raw subscriptions still feed the cache, the delegate and any
+        // conflation key path; those see a lazy view over the same bytes.
+        FayeJSONSpan span = { 0, rawData.length };
+        data = [[FayeLazyJSONDictionary alloc] initWithData: rawData span: span] ?:
+            [FayeJSONScanner objectWithSpan: span inData: rawData];
+    }
+    if (channel.filter != nil && data != nil && !message.passedFilter) {
+        // The whole message, as the raw path sees it.
+        if (![channel.filter matchesMessage: [message dictionaryWithData: data]]) {
+            self.filteredMessageCount++;
+            return;
+        }
+    }
+    FayeClientChannelRawMessageHandlerBlock rawHandler = channel.rawMessageHandlerBlock;
+    if (rawHandler != NULL && rawData == nil && [NSJSONSerialization isValidJSONObject: data]) {
+        // Arrived as MessagePack, or was decoded in full on the way in.
+        rawData = [NSJSONSerialization dataWithJSONObject: data
+                                                  options: 0
+                                                    error: NULL];
+    }
+    
+    if (data && (channel.options & FayeChannelSubscriptionOptionCacheLastValue)) {
+        [self.lastValueCache setData: data forChannel: message.channel];
+    }
+    BOOL notifyDelegate = data && _delegateRespondsTo.receivedMessage;
+    FayeClientChannelMessageHandlerBlock handler = channel.messageHandlerBlock;
+    NSArray *handlers = channel.handlers;
+    NSArray *localHandlers = channel.localHandlers[message.channel];
+    if (localHandlers != nil) {
+        handlers = handlers != nil ? [handlers arrayByAddingObjectsFromArray: localHandlers] : localHandlers;
+    }
+    if (!notifyDelegate && handler == NULL && rawHandler == NULL && handlers.count == 0) {
+        return;
+    }
+    NSString *channelPath = message.channel;
+    dispatch_block_t delivery = ^{
+        if (notifyDelegate) {
+            [self.delegate fayeClient: self didReceiveMessage: data onChannel: channelPath];
+        }
+        if (handler != NULL) {
+            handler(self, channelPath, data);
+        }
+        if (rawHandler != NULL) {
+            rawHandler(self, channelPath, rawData);
+        }
+        for (FayeChannelHandler *channelHandler in handlers) {
+            if (channelHandler.messageHandlerBlock != NULL) {
+                channelHandler.messageHandlerBlock(self, channelPath, data);
             }
         }
-        if (channel.messageHandlerBlock != NULL) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                channel.messageHandlerBlock(self, message.channel, message.data);
-            });
+    };
+    if ((channel.options & FayeChannelSubscriptionOptionConflate) && data != nil) {
+        NSString *conflationKey = channelPath;
+        if (channel.conflationKeyPath != nil) {
+            id value = [data valueForKeyPath: channel.conflationKeyPath];
+            conflationKey = [NSString stringWithFormat: @"%@\n%@", channelPath, value];
         }
+        [self.messageDispatcher dispatchBlock: delivery
+                            conflatingWithKey: conflationKey
+                                   counterKey: channel.channelPath];
     } else {
-        [self _debugMessage: @"NO MATCH FOR CHANNEL %@", message.channel];
+        [self.messageDispatcher dispatchBlock: delivery];
     }
 }
 
@@ -1012,35 +3272,57 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
 {
     self.currentServer.advice = advice;
     if ([self.currentServer.reconnectAdvice isEqualToString: @"handshake"] && self.connectionStatus != FayeClientConnectionStatusDisconnected) {
-        [self _debugMessage: @"Re-handshaking with server on server's advice."];
         self.currentServer.clientID = nil;
+        if (self.resumingSession) {
+            // The server didn't recognise the old client ID, but the
+            // connection itself is fine, so handshake over it right away.
+            [self _debugMessage: @"Session expired.  Handshaking instead."];
+            self.resumingSession = NO;
+            [self requeueUnconfirmedPublications];
+            if ([self.currentServer connectsWithWebSockets]) {
+                [self sendHandshakeToWebSocket];
+            } else {
+                [self startHTTPConnection];
+            }
+            return;
+        }
+        [self _debugMessage: @"Re-handshaking with server on server's advice."];
         [self cycleConnection];
     }
 }
 
 - (FayeChannelSubscriptionStatus) subscriptionStatusForChannel: (NSString*) channel
 {
-    NSNumber *num = self.currentServer.channelStatus[channel];
-    if (num == nil) {
-        return FayeChannelSubscriptionStatusUnsubscribed;
-    } else {
-        return [num integerValue];
-    }
+    return [self.currentServer.channelStatus statusForChannel: channel];
 }
 
 - (void) setSubscriptionStatus: (FayeChannelSubscriptionStatus) status forChannel: (NSString*) channel
 {
     FayeChannelSubscriptionStatus oldStatus = [self subscriptionStatusForChannel: channel];
     if (status != oldStatus) {
-        self.currentServer.channelStatus[channel] = @(status);
+        [self.currentServer.channelStatus setStatus: status forChannel: channel];
         FayeChannel *fayeChannel = self.subscriptions[channel];
         if (fayeChannel.statusHandlerBlock != NULL) {
             fayeChannel.statusHandlerBlock(self, channel, status);
         }
+        if (status == FayeChannelSubscriptionStatusSubscribed) {
+            for (FayeChannelHandler *handler in fayeChannel.handlers) {
+                [self completeHandler: handler];
+            }
+            for (NSArray *handlers in fayeChannel.localHandlers.allValues) {
+                for (FayeChannelHandler *handler in handlers) {
+                    [self completeHandler: handler];
+                }
+            }
+        }
         if (status == FayeChannelSubscriptionStatusSubscribed && _delegateRespondsTo.subscribed) {
-            [self.delegate fayeClient: self didSubscribeToChannel: channel];
+            dispatch_async(self.callbackQueue, ^{
+                [self.delegate fayeClient: self didSubscribeToChannel: channel];
+            });
         } else if (status == FayeChannelSubscriptionStatusUnsubscribed && _delegateRespondsTo.unsubscribed) {
-            [self.delegate fayeClient: self didUnsubscribeFromChannel: channel];
+            dispatch_async(self.callbackQueue, ^{
+                [self.delegate fayeClient: self didUnsubscribeFromChannel: channel];
+            });
         }
         
         if (status == FayeChannelSubscriptionStatusSubscribed && fayeChannel.markedForUnsubscription) {
@@ -1065,7 +3347,7 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
         delayInSeconds = 3;
     }
     dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delayInSeconds * NSEC_PER_SEC));
-    dispatch_after(popTime, dispatch_get_main_queue(), ^(void){
+    dispatch_after(popTime, self.networkQueue, ^(void){
         [self connectWithConnectionStatusChangedHandler: self.connectionStatusHandler];
     });
 }
@@ -1077,22 +3359,173 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
         [self.queuedMessages addObjectsFromArray: self.alternateQueue];
         self.alternateQueue = nil;
     }
-    if (self.httpConnection) {
-        [self.httpConnection cancel];
-        self.httpConnection = nil;
-    }
     if (self.webSocket) {
         [self.webSocket close];
     }
-    [self _closeLogFile];
-    dispatch_async(dispatch_get_main_queue(), ^{
-        [NSObject cancelPreviousPerformRequestsWithTarget: self selector: @selector(failWithTimeout) object: nil];
+    FayeClientCancelTimer(_timeoutTimer);
+    FayeClientCancelTimer(_connectTimer);
+    FayeClientCancelTimer(_pingTimer);
+    FayeClientCancelTimer(_pongTimer);
+    dispatch_async(self.networkQueue, ^{
+        [self.connectionRace cancel];
+        self.connectionRace = nil;
+        // The session itself stays, so reconnecting can reuse its pooled
+        // connections instead of starting over with DNS, TCP and TLS.
+        [self.httpTask cancel];
+        [self.eventSourceTask cancel];
+        [self.publishTask cancel];
+        self.httpTask = nil;
+        self.eventSourceTask = nil;
+        self.publishTask = nil;
+        self.publishData = nil;
+        _publishInFlight = NO;
+        _awaitingPong = NO;
+        _missedPongs = 0;
+        // Nothing still going through belongs to a connection we have.
+        [self.incomingChain reset];
+        [self.outgoingChain reset];
+    });
+    dispatch_async(self.readQueue, ^{
+        // Ahead of the drain that unthrottling starts.
+        [self.heldMessages removeAllObjects];
+        [self.conflatableHeldMessages removeAllObjects];
     });
+    [self.messageDispatcher resetThrottle];
+    [self setDeliveryThrottled: NO];
+    @synchronized (self.subscriptionRequests) {
+        // Nothing more will be heard about these.
+        [self.subscriptionRequests removeAllObjects];
+    }
+    dispatch_async(self.writeQueue, ^{
+        [self.pendingUploadFrames removeAllObjects];
+    });
+    dispatch_async(self.readQueue, ^{
+        [self.chunker removeAllChunks];
+    });
+    [self _closeLogFile];
+}
+
+- (void) setDeliveryThrottled: (BOOL) throttled
+{
+    BOOL resumeDelivery = NO;
+    BOOL resumePolling = NO;
+    pthread_mutex_lock(&_throttleLock);
+    if (throttled != _throttle.active) {
+        _throttle.active = throttled;
+        if (throttled) {
+            _throttle.count++;
+            _throttle.startTime = CFAbsoluteTimeGetCurrent();
+        } else {
+            _throttle.totalTime += CFAbsoluteTimeGetCurrent() - _throttle.startTime;
+            resumeDelivery = YES;
+            resumePolling = _throttle.pollDeferred;
+            _throttle.pollDeferred = NO;
+        }
+    }
+    pthread_mutex_unlock(&_throttleLock);
+    if (resumeDelivery) {
+        dispatch_async(self.readQueue, ^{
+            [self deliverHeldMessages];
+        });
+    }
+    if (resumePolling && [self.currentServer connectsWithLongPolling] && self.currentServer.clientID) {
+        [self startHTTPConnection];
+    }
+}
+
+- (BOOL) deliveryIsThrottled
+{
+    pthread_mutex_lock(&_throttleLock);
+    BOOL throttled = _throttle.active;
+    pthread_mutex_unlock(&_throttleLock);
+    return throttled;
+}
+
+// Read queue only.  A held message may be replaced by a later one only where
+// the conflating dispatch would have replaced it anyway, and nothing on the
+// way there (filters, sequencing, chunks, echo and duplicate checks, replies)
+// could turn the later one away instead.
+- (NSString*) heldConflationKeyForMessage: (FayeMessage*) message
+{
+    if (![message hasData] || [FayeMessageChunker messageIsChunk: message] ||
+        self.echoWindow != nil || self.duplicateWindow != nil ||
+        [message.channel isEqualToString: self.replyChannel])
+    {
+        return nil;
+    }
+    FayeChannel *channel = [self subscriptionForChannelPath: message.channel];
+    if (!(channel.options & FayeChannelSubscriptionOptionConflate) ||
+        (channel.options & FayeChannelSubscriptionOptionSequenced) ||
+        channel.filter != nil || channel.conflationKeyPath != nil)
+    {
+        return nil;
+    }
+    return message.channel;
+}
+
+// Read queue only.
+- (void) holdMessage: (FayeMessage*) message
+{
+    message.retained = YES;
+    NSString *key = [self heldConflationKeyForMessage: message];
+    if (key != nil) {
+        FayeMessage *older = self.conflatableHeldMessages[key];
+        NSUInteger index = older != nil ? [self.heldMessages indexOfObjectIdenticalTo: older] : NSNotFound;
+        self.conflatableHeldMessages[key] = message;
+        if (index != NSNotFound) {
+            // The newer message takes the older one's place in line.
+            [self.heldMessages replaceObjectAtIndex: index withObject: message];
+            [self.messageDispatcher countConflationForCounterKey: [self subscriptionForChannelPath: key].channelPath];
+            return;
+        }
+    }
+    [self.heldMessages addObject: message];
+    NSUInteger limit = self.heldMessageLimit;
+    while (limit > 0 && self.heldMessages.count > limit) {
+        [self removeFirstHeldMessage];
+        self.droppedMessageCount++;
+    }
+}
+
+// Read queue only.
+- (FayeMessage*) removeFirstHeldMessage
+{
+    FayeMessage *message = self.heldMessages.firstObject;
+    [self.heldMessages removeObjectAtIndex: 0];
+    if (self.heldMessages.count == 0) {
+        [self.conflatableHeldMessages removeAllObjects];
+    } else if (message.channel != nil && self.conflatableHeldMessages[message.channel] == message) {
+        [self.conflatableHeldMessages removeObjectForKey: message.channel];
+    }
+    return message;
+}
+
+// Read queue only.  Stops early if delivering them throttles us again.
+- (void) deliverHeldMessages
+{
+    while (self.heldMessages.count > 0 && ![self deliveryIsThrottled]) {
+        [self handleOtherMessage: [self removeFirstHeldMessage]];
+    }
 }
 
 - (NSArray*) sortedServers
 {
-    return [self.servers.allValues sortedArrayUsingSelector: @selector(compareServer:)];
+    NSArray *servers = [self.servers.allValues sortedArrayUsingSelector: @selector(compareServer:)];
+    NSSet *unresolvable = self.unresolvableHosts;
+    if (unresolvable.count == 0) {
+        return servers;
+    }
+    // Servers whose names didn't resolve last time go to the back.
+    NSMutableArray *resolvable = [NSMutableArray new];
+    NSMutableArray *rest = [NSMutableArray new];
+    for (FayeServer *server in servers) {
+        if ([unresolvable containsObject: server.url.host]) {
+            [rest addObject: server];
+        } else {
+            [resolvable addObject: server];
+        }
+    }
+    return [resolvable arrayByAddingObjectsFromArray: rest];
 }
 
 - (void) failWithTimeout
@@ -1103,10 +3536,12 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
 
 - (void) resetTimeoutTimer
 {
-    dispatch_async(dispatch_get_main_queue(), ^{
-        [NSObject cancelPreviousPerformRequestsWithTarget: self selector: @selector(failWithTimeout) object: nil];
-        [self performSelector: @selector(failWithTimeout) withObject: nil afterDelay: self.currentServer.timeoutAdvice + 10.0];
-    });
+    // EventSource connects come back at once, then nothing until the interval.
+    NSTimeInterval wait = self.currentServer.timeoutAdvice + 10.0;
+    if (self.currentServer.streamsWithEventSource) {
+        wait += self.currentServer.intervalAdvice;
+    }
+    FayeClientScheduleTimer(_timeoutTimer, wait);
 }
 
 - (void) _debugMessage:(NSString *)format, ...
@@ -1123,7 +3558,7 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
 
 - (void) _debugFayeMessage: (NSArray*) messageArray
 {
-    if (self.debug == NO) {
+    if (self.debug == NO || ![NSJSONSerialization isValidJSONObject: messageArray]) {
         return;
     }
     NSString *logLine = [[NSString alloc] initWithData: [NSJSONSerialization dataWithJSONObject: messageArray options: NSJSONWritingPrettyPrinted error: NULL] encoding: NSUTF8StringEncoding];
@@ -1161,10 +3596,13 @@ typedef NSDictionary*(^FayeMessageQueueItemGetMessageBlock)(void);
 
 - (void) dealloc
 {
-    dispatch_release(self.readQueue);
-    dispatch_release(self.writeQueue);
-    self.readQueue = nil;
-    self.writeQueue = nil;
+    pthread_mutex_destroy(&_throttleLock);
+    dispatch_source_cancel(_timeoutTimer);
+    dispatch_source_cancel(_sendTimer);
+    dispatch_source_cancel(_connectTimer);
+    dispatch_source_cancel(_pingTimer);
+    dispatch_source_cancel(_pongTimer);
+    [_urlSession invalidateAndCancel];
 }
 
 @end
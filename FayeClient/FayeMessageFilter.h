@@ -0,0 +1,57 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessageFilter.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+/*
+ A predicate on incoming messages, attached to a subscription with
+ -[FayeClient setFilter:forChannel:].  Key paths start at the message itself,
+ so @"data.symbol" or @"ext.region".  Filters are compiled once and run
+ against the message's JSON bytes before anything is decoded, so messages
+ they reject cost a scan and nothing else.  A missing key never matches.
+ */
+
+@interface FayeMessageFilter : NSObject
+
+// `value` is an NSString, NSNumber (booleans included) or NSNull.  A boolean
+// never equals a number, so @YES doesn't match 1.
++ (FayeMessageFilter*) filterWithKeyPath: (NSString*) keyPath equalTo: (id) value;
+// Any of `values`, as for equalTo:.
++ (FayeMessageFilter*) filterWithKeyPath: (NSString*) keyPath inSet: (NSSet*) values;
+// Numeric and inclusive; either bound may be nil.
++ (FayeMessageFilter*) filterWithKeyPath: (NSString*) keyPath
+                                 minimum: (NSNumber*) minimum
+                                 maximum: (NSNumber*) maximum;
++ (FayeMessageFilter*) filterMatchingAllOf: (NSArray*) filters;
+
+// `range` covers one JSON object, the whole message.
+- (BOOL) matchesJSONData: (NSData*) data range: (NSRange) range;
+// For messages that have already been decoded.
+- (BOOL) matchesMessage: (NSDictionary*) message;
+
+@end
@@ -0,0 +1,260 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessageFilter.m
+//  FayeObjC
+//
+
+#import "FayeMessageFilter.h"
+#import "FayeJSONScanner.h"
+#import <xlocale.h>
+
+typedef NS_ENUM(NSInteger, FayeMessageFilterKind) {
+    FayeMessageFilterKindEqual,
+    FayeMessageFilterKindSet,
+    FayeMessageFilterKindRange,
+    FayeMessageFilterKindAll
+};
+
+@interface FayeMessageFilter ()
+@property (nonatomic, assign) FayeMessageFilterKind kind;
+@property (nonatomic, copy) NSArray *keys;
+// NUL-terminated UTF-8 copies of `keys`, for the scanner.
+@property (nonatomic, copy) NSArray *keyBytes;
+@property (nonatomic, strong) id value;
+@property (nonatomic, copy) NSData *valueBytes;
+@property (nonatomic, copy) NSSet *values;
+// Kept apart from `values`, where @YES would hash and compare equal to @1.
+@property (nonatomic, copy) NSSet *booleanValues;
+@property (nonatomic, strong) NSNumber *minimum;
+@property (nonatomic, strong) NSNumber *maximum;
+@property (nonatomic, copy) NSArray *filters;
+@end
+
+static BOOL FayeMessageFilterIsBoolean(id value)
+{
+    return [value isKindOfClass: [NSNumber class]] && CFGetTypeID((__bridge CFTypeRef) value) == CFBooleanGetTypeID();
+}
+
+// JSON numbers always use '.', whatever the user's locale says.
+static locale_t FayeMessageFilterCLocale(void)
+{
+    static locale_t locale;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        locale = newlocale(LC_NUMERIC_MASK, "C", NULL);
+    });
+    return locale;
+}
+
+@implementation FayeMessageFilter
+
++ (FayeMessageFilter*) filterWithKeyPath: (NSString*) keyPath kind: (FayeMessageFilterKind) kind
+{
+    FayeMessageFilter *filter = [FayeMessageFilter new];
+    filter.kind = kind;
+    filter.keys = [keyPath componentsSeparatedByString: @"."];
+    NSMutableArray *keyBytes = [NSMutableArray arrayWithCapacity: filter.keys.count];
+    for (NSString *key in filter.keys) {
+        [keyBytes addObject: [NSData dataWithBytes: key.UTF8String length: strlen(key.UTF8String) + 1]];
+    }
+    filter.keyBytes = keyBytes;
+    return filter;
+}
+
++ (FayeMessageFilter*) filterWithKeyPath:(NSString *)keyPath equalTo:(id)value
+{
+    FayeMessageFilter *filter = [self filterWithKeyPath: keyPath kind: FayeMessageFilterKindEqual];
+    filter.value = value;
+    if ([value isKindOfClass: [NSString class]]) {
+        filter.valueBytes = [value dataUsingEncoding: NSUTF8StringEncoding];
+    }
+    return filter;
+}
+
++ (FayeMessageFilter*) filterWithKeyPath:(NSString *)keyPath inSet:(NSSet *)values
+{
+    FayeMessageFilter *filter = [self filterWithKeyPath: keyPath kind: FayeMessageFilterKindSet];
+    NSMutableSet *others = [NSMutableSet new];
+    NSMutableSet *booleans = [NSMutableSet new];
+    for (id value in values) {
+        [(FayeMessageFilterIsBoolean(value) ? booleans : others) addObject: value];
+    }
+    filter.values = others;
+    filter.booleanValues = booleans;
+    return filter;
+}
+
++ (FayeMessageFilter*) filterWithKeyPath:(NSString *)keyPath minimum:(NSNumber *)minimum maximum:(NSNumber *)maximum
+{
+    FayeMessageFilter *filter = [self filterWithKeyPath: keyPath kind: FayeMessageFilterKindRange];
+    filter.minimum = minimum;
+    filter.maximum = maximum;
+    return filter;
+}
+
++ (FayeMessageFilter*) filterMatchingAllOf:(NSArray *)filters
+{
+    FayeMessageFilter *filter = [FayeMessageFilter new];
+    filter.kind = FayeMessageFilterKindAll;
+    filter.filters = filters;
+    return filter;
+}
+
+#pragma mark - Decoded
+
+- (BOOL) matchesMessage:(NSDictionary *)message
+{
+    if (self.kind == FayeMessageFilterKindAll) {
+        for (FayeMessageFilter *filter in self.filters) {
+            if (![filter matchesMessage: message]) {
+                return NO;
+            }
+        }
+        return YES;
+    }
+    id object = message;
+    for (NSString *key in self.keys) {
+        if (![object isKindOfClass: [NSDictionary class]]) {
+            return NO;
+        }
+        object = object[key];
+    }
+    return object != nil && [self matchesValue: object];
+}
+
+- (BOOL) matchesValue: (id) object
+{
+    switch (self.kind) {
+        case FayeMessageFilterKindEqual:
+            return [self value: object isEqualToValue: self.value];
+        case FayeMessageFilterKindSet:
+            // Booleans only match booleans, as for equalTo:.
+            if (FayeMessageFilterIsBoolean(object)) {
+                return [self.booleanValues containsObject: object];
+            }
+            if ([object isKindOfClass: [NSNumber class]]) {
+                // Sets hash 1.0 and 1 the same, but be explicit about it.
+                object = @([object doubleValue]);
+            }
+            return [self.values containsObject: object];
+        case FayeMessageFilterKindRange: {
+            if (![object isKindOfClass: [NSNumber class]] || FayeMessageFilterIsBoolean(object)) {
+                return NO;
+            }
+            return [self numberIsInRange: [object doubleValue]];
+        }
+        case FayeMessageFilterKindAll:
+            break;
+    }
+    return NO;
+}
+
+- (BOOL) value: (id) object isEqualToValue: (id) expected
+{
+    if (FayeMessageFilterIsBoolean(expected) != FayeMessageFilterIsBoolean(object)) {
+        return NO;
+    }
+    return [expected isEqual: object];
+}
+
+- (BOOL) numberIsInRange: (double) number
+{
+    if (self.minimum != nil && number < self.minimum.doubleValue) {
+        return NO;
+    }
+    if (self.maximum != nil && number > self.maximum.doubleValue) {
+        return NO;
+    }
+    return YES;
+}
+
+#pragma mark - Raw
+
+- (BOOL) matchesJSONData:(NSData *)data range:(NSRange)range
+{
+    if (self.kind == FayeMessageFilterKindAll) {
+        for (FayeMessageFilter *filter in self.filters) {
+            if (![filter matchesJSONData: data range: range]) {
+                return NO;
+            }
+        }
+        return YES;
+    }
+    const uint8_t *bytes = data.bytes;
+    FayeJSONSpan span = { range.location, range.length };
+    for (NSData *key in self.keyBytes) {
+        if (!FayeJSONFindMember(bytes, span, key.bytes, &span)) {
+            return NO;
+        }
+    }
+    if (span.length == 0) {
+        return NO;
+    }
+    
+    uint8_t first = bytes[span.location];
+    if (first == '"') {
+        BOOL escaped = memchr(bytes + span.location + 1, '\\', span.length - 2) != NULL;
+        if (self.kind == FayeMessageFilterKindEqual && self.valueBytes != nil && !escaped) {
+            return span.length - 2 == self.valueBytes.length &&
+                memcmp(bytes + span.location + 1, self.valueBytes.bytes, span.length - 2) == 0;
+        } else if (self.kind == FayeMessageFilterKindSet && !escaped) {
+            // Borrow the bytes for the lookup rather than copying them out.
+            CFStringRef string = CFStringCreateWithBytesNoCopy(NULL, bytes + span.location + 1, span.length - 2,
+                                                               kCFStringEncodingUTF8, false, kCFAllocatorNull);
+            if (string == NULL) {
+                return NO;
+            }
+            BOOL contains = [self.values containsObject: (__bridge NSString*) string];
+            CFRelease(string);
+            return contains;
+        } else if (self.kind == FayeMessageFilterKindRange) {
+            return NO;
+        }
+    } else if (first == '-' || (first >= '0' && first <= '9')) {
+        char buffer[64];
+        if (span.length >= sizeof(buffer)) {
+            return NO;
+        }
+        memcpy(buffer, bytes + span.location, span.length);
+        buffer[span.length] = '\0';
+        char *end = NULL;
+        double number = strtod_l(buffer, &end, FayeMessageFilterCLocale());
+        if (end != buffer + span.length) {
+            return NO;
+        }
+        if (self.kind == FayeMessageFilterKindRange) {
+            return [self numberIsInRange: number];
+        }
+        return [self matchesValue: @(number)];
+    } else if (first == '{' || first == '[') {
+        // Containers never equal a scalar.
+        return NO;
+    }
+    // Escaped strings and literals are rare enough to just decode.
+    id object = [FayeJSONScanner objectWithSpan: span inData: data];
+    return object != nil && [self matchesValue: object];
+}
+
+@end
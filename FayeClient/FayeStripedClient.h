@@ -0,0 +1,60 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeStripedClient.h
+//  FayeObjC
+//
+
+
+#import "FayeClient.h"
+
+/*
+ A client that spreads its subscriptions over several connections ("stripes"),
+ each a FayeClient of its own with its own socket and read queue, so that one
+ busy channel doesn't hold up the rest and parsing runs on as many cores as
+ there are stripes.  Every channel is hashed to a single stripe, which does all
+ of that channel's subscribing and publishing, so messages on a channel still
+ arrive in order.  Nothing is promised about ordering between channels.
+
+ The API is FayeClient's.  Handlers and delegate methods are passed this client
+ rather than the stripe, though interceptors see the stripe.  Each stripe has its own client ID, so clientID is
+ nil, and a message that matches subscriptions on two stripes (say /foo/bar
+ and /foo/*) reaches the delegate twice.  Sessions can't be saved.
+
+ Configure the client before the first connect or subscribe: that's when the
+ stripes are created, and each takes a copy of the settings.  Servers added
+ later are passed on.
+ */
+
+@interface FayeStripedClient : FayeClient
+
+// Zero is treated as one.  -init uses one stripe per active processor.
+- (instancetype) initWithStripeCount: (NSUInteger) stripeCount;
+
+@property (nonatomic, readonly) NSUInteger stripeCount;
+@property (nonatomic, readonly) NSArray *stripes;
+
+- (FayeClient*) stripeForChannel: (NSString*) channel;
+
+@end
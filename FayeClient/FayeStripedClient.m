@@ -0,0 +1,486 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeStripedClient.m
+//  FayeObjC
+//
+
+
+#import "FayeStripedClient.h"
+#import "FayeChannel.h"
+#import <stdatomic.h>
+
+// FNV-1a.  NSString's -hash only looks at the ends of long strings, and
+// channel paths tend to differ in the middle.
+static NSUInteger FayeStripedClientHashChannel(NSString *channel)
+{
+    const char *bytes = channel.UTF8String;
+    uint32_t hash = 2166136261u;
+    for (; *bytes != '\0'; bytes++) {
+        hash ^= (uint8_t) *bytes;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+@interface FayeStripedClient () <FayeClientDelegate>
+@property (nonatomic, strong) NSMutableArray *serverURLs;
+@property (nonatomic, copy) FayeClientConnectionStatusHandlerBlock stripedStatusHandler;
+@end
+
+@implementation FayeStripedClient {
+    NSArray *_stripes;
+    FayeClientConnectionStatus _stripedConnectionStatus;
+}
+
+- (id) init
+{
+    return [self initWithStripeCount: [NSProcessInfo processInfo].activeProcessorCount];
+}
+
+- (instancetype) initWithStripeCount: (NSUInteger) stripeCount
+{
+    self = [super init];
+    if (self) {
+        _stripeCount = MAX(stripeCount, 1);
+        _stripedConnectionStatus = FayeClientConnectionStatusDisconnected;
+        self.serverURLs = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (NSArray*) stripes
+{
+    if (_stripes == nil) {
+        NSMutableArray *stripes = [NSMutableArray arrayWithCapacity: self.stripeCount];
+        for (NSUInteger i = 0; i < self.stripeCount; i++) {
+            FayeClient *stripe = [FayeClient new];
+            [self configureStripe: stripe index: i];
+            for (NSURL *url in self.serverURLs) {
+                [stripe addServerWithURL: url];
+            }
+            [stripes addObject: stripe];
+        }
+        _stripes = stripes.copy;
+    }
+    return _stripes;
+}
+
+- (void) configureStripe: (FayeClient*) stripe index: (NSUInteger) index
+{
+    stripe.delegate = self;
+    stripe.dataDelegate = self.dataDelegate;
+    stripe.callbackQueue = self.callbackQueue;
+    stripe.extension = self.extension;
+    stripe.handshakeExtension = self.handshakeExtension;
+    stripe.connectExtension = self.connectExtension;
+    stripe.timeout = self.timeout;
+    stripe.preferredMessageEncoding = self.preferredMessageEncoding;
+    stripe.maximumFrameSize = self.maximumFrameSize;
+    stripe.prefersEventSource = self.prefersEventSource;
+    stripe.heartbeatInterval = self.heartbeatInterval;
+    stripe.racesServers = self.racesServers;
+    stripe.raceStaggerInterval = self.raceStaggerInterval;
+    stripe.lastValueCacheCountLimit = self.lastValueCacheCountLimit;
+    stripe.lastValueCacheMemoryLimit = self.lastValueCacheMemoryLimit;
+    stripe.deliveryHighWatermark = self.deliveryHighWatermark;
+    stripe.deliveryLowWatermark = self.deliveryLowWatermark;
+    stripe.duplicateSuppressionHorizon = self.duplicateSuppressionHorizon;
+    stripe.duplicateSuppressionExtensionKey = self.duplicateSuppressionExtensionKey;
+    stripe.sequenceGapTimeout = self.sequenceGapTimeout;
+    stripe.sequenceReorderLimit = self.sequenceReorderLimit;
+    stripe.deliversPublishesLocally = self.deliversPublishesLocally;
+    stripe.reusesClientID = self.reusesClientID;
+    stripe.maximumConcurrentRequests = self.maximumConcurrentRequests;
+    for (id <FayeClientInterceptor> interceptor in self.interceptors) {
+        [stripe addInterceptor: interceptor];
+    }
+    stripe.debug = self.debug;
+    NSString *logName = [self.debugLogFileName stringByDeletingPathExtension];
+    NSString *logExtension = [self.debugLogFileName pathExtension];
+    logName = [logName stringByAppendingFormat: @"-%lu", (unsigned long) index];
+    stripe.debugLogFileName = logExtension.length > 0 ? [logName stringByAppendingPathExtension: logExtension] : logName;
+}
+
+- (FayeClient*) stripeForChannel: (NSString*) channel
+{
+    NSArray *stripes = self.stripes;
+    return stripes[FayeStripedClientHashChannel(channel) % stripes.count];
+}
+
+- (void) addServerWithURL:(NSURL *)url
+{
+    if ([self.serverURLs containsObject: url]) {
+        return;
+    }
+    [self.serverURLs addObject: url];
+    for (FayeClient *stripe in _stripes) {
+        [stripe addServerWithURL: url];
+    }
+}
+
+- (void) addInterceptor:(id<FayeClientInterceptor>)interceptor
+{
+    [super addInterceptor: interceptor];
+    for (FayeClient *stripe in _stripes) {
+        [stripe addInterceptor: interceptor];
+    }
+}
+
+- (void) removeInterceptor:(id<FayeClientInterceptor>)interceptor
+{
+    [super removeInterceptor: interceptor];
+    for (FayeClient *stripe in _stripes) {
+        [stripe removeInterceptor: interceptor];
+    }
+}
+
+#pragma mark - Connection / Disconnection
+
+- (FayeClientConnectionStatus) connectionStatus
+{
+    return _stripedConnectionStatus;
+}
+
+- (void) prewarm
+{
+    for (FayeClient *stripe in self.stripes) {
+        [stripe prewarm];
+    }
+}
+
+- (void) connectWithConnectionStatusChangedHandler:(FayeClientConnectionStatusHandlerBlock)handler
+{
+    self.stripedStatusHandler = handler;
+    for (FayeClient *stripe in self.stripes) {
+        [stripe connect];
+    }
+}
+
+- (void) disconnect
+{
+    for (FayeClient *stripe in _stripes) {
+        [stripe disconnect];
+    }
+}
+
+// Connected once every stripe is, disconnected once every stripe is.
+- (FayeClientConnectionStatus) stripedConnectionStatus
+{
+    NSUInteger connected = 0, disconnected = 0, disconnecting = 0;
+    for (FayeClient *stripe in _stripes) {
+        switch (stripe.connectionStatus) {
+            case FayeClientConnectionStatusConnected: connected++; break;
+            case FayeClientConnectionStatusDisconnected: disconnected++; break;
+            case FayeClientConnectionStatusDisconnecting: disconnecting++; break;
+            default: break;
+        }
+    }
+    if (connected == _stripes.count) {
+        return FayeClientConnectionStatusConnected;
+    } else if (disconnected == _stripes.count) {
+        return FayeClientConnectionStatusDisconnected;
+    } else if (disconnecting > 0) {
+        return FayeClientConnectionStatusDisconnecting;
+    }
+    return FayeClientConnectionStatusConnecting;
+}
+
+#pragma mark - Channels
+
+- (void) subscribeToChannel:(NSString *)channel
+                    options:(FayeChannelSubscriptionOptions)options
+             messageHandler:(FayeClientChannelMessageHandlerBlock)messageHandler
+          completionHandler:(dispatch_block_t)completionHandler
+{
+    FayeClientChannelMessageHandlerBlock handler = NULL;
+    if (messageHandler != NULL) {
+        __weak FayeStripedClient *weakSelf = self;
+        handler = ^(FayeClient *client, NSString *channelPath, NSDictionary *message) {
+            messageHandler(weakSelf, channelPath, message);
+        };
+    }
+    [[self stripeForChannel: channel] subscribeToChannel: channel
+                                                 options: options
+                                          messageHandler: handler
+                                       completionHandler: completionHandler];
+}
+
+- (void) subscribeToChannel:(NSString *)channel
+                    options:(FayeChannelSubscriptionOptions)options
+          rawMessageHandler:(FayeClientChannelRawMessageHandlerBlock)messageHandler
+          completionHandler:(dispatch_block_t)completionHandler
+{
+    FayeClientChannelRawMessageHandlerBlock handler = NULL;
+    if (messageHandler != NULL) {
+        __weak FayeStripedClient *weakSelf = self;
+        handler = ^(FayeClient *client, NSString *channelPath, NSData *message) {
+            messageHandler(weakSelf, channelPath, message);
+        };
+    }
+    [[self stripeForChannel: channel] subscribeToChannel: channel
+                                                 options: options
+                                       rawMessageHandler: handler
+                                       completionHandler: completionHandler];
+}
+
+- (void) unsubscribeFromChannel:(NSString *)channel completionHandler:(dispatch_block_t)handler
+{
+    [[self stripeForChannel: channel] unsubscribeFromChannel: channel completionHandler: handler];
+}
+
+- (void) setSubscribedChannels:(NSSet *)channels
+                messageHandler:(FayeClientChannelMessageHandlerBlock)messageHandler
+             completionHandler:(dispatch_block_t)completionHandler
+{
+    FayeClientChannelMessageHandlerBlock handler = NULL;
+    if (messageHandler != NULL) {
+        __weak FayeStripedClient *weakSelf = self;
+        handler = ^(FayeClient *client, NSString *channelPath, NSDictionary *message) {
+            messageHandler(weakSelf, channelPath, message);
+        };
+    }
+    // Every stripe gets its share, even an empty one, so each drops whatever
+    // it had that isn't in the new set.
+    NSArray *stripes = self.stripes;
+    NSMutableArray *shares = [NSMutableArray arrayWithCapacity: stripes.count];
+    for (NSUInteger i = 0; i < stripes.count; i++) {
+        [shares addObject: [NSMutableSet new]];
+    }
+    for (NSString *channel in channels) {
+        [shares[FayeStripedClientHashChannel(channel) % stripes.count] addObject: channel];
+    }
+    __block atomic_uint remaining = (unsigned int) stripes.count;
+    dispatch_block_t arrive = ^{
+        if (atomic_fetch_sub(&remaining, 1) == 1 && completionHandler != NULL) {
+            completionHandler();
+        }
+    };
+    for (NSUInteger i = 0; i < stripes.count; i++) {
+        [stripes[i] setSubscribedChannels: shares[i] messageHandler: handler completionHandler: arrive];
+    }
+}
+
+- (id) addHandlerToChannel:(NSString *)channel
+            messageHandler:(FayeClientChannelMessageHandlerBlock)messageHandler
+         completionHandler:(dispatch_block_t)completionHandler
+{
+    FayeClientChannelMessageHandlerBlock handler = NULL;
+    if (messageHandler != NULL) {
+        __weak FayeStripedClient *weakSelf = self;
+        handler = ^(FayeClient *client, NSString *channelPath, NSDictionary *message) {
+            messageHandler(weakSelf, channelPath, message);
+        };
+    }
+    return [[self stripeForChannel: channel] addHandlerToChannel: channel
+                                                  messageHandler: handler
+                                               completionHandler: completionHandler];
+}
+
+- (void) removeHandler:(id)token
+{
+    if (![token isKindOfClass: [FayeChannelHandler class]]) {
+        return;
+    }
+    // Tokens come from the stripe their channel hashes to.
+    NSString *channel = [(FayeChannelHandler*) token channelPath];
+    [[self stripeForChannel: channel] removeHandler: token];
+}
+
+- (void) setExtension:(NSDictionary *)extension forChannel:(NSString *)channel
+{
+    [[self stripeForChannel: channel] setExtension: extension forChannel: channel];
+}
+
+- (NSDictionary*) lastMessageOnChannel:(NSString *)channel
+{
+    return [[self stripeForChannel: channel] lastMessageOnChannel: channel];
+}
+
+- (void) setConflationKeyPath:(NSString *)keyPath forChannel:(NSString *)channel
+{
+    [[self stripeForChannel: channel] setConflationKeyPath: keyPath forChannel: channel];
+}
+
+- (NSUInteger) conflatedMessageCountForChannel:(NSString *)channel
+{
+    return [[self stripeForChannel: channel] conflatedMessageCountForChannel: channel];
+}
+
+- (void) setFilter:(FayeMessageFilter *)filter forChannel:(NSString *)channel
+{
+    [[self stripeForChannel: channel] setFilter: filter forChannel: channel];
+}
+
+- (NSSet*) subscribedChannels
+{
+    NSMutableSet *channels = [NSMutableSet new];
+    for (FayeClient *stripe in _stripes) {
+        [channels unionSet: stripe.subscribedChannels];
+    }
+    return channels.copy;
+}
+
+#pragma mark - Publishing Messages
+
+- (void) sendMessage:(NSDictionary *)message
+           toChannel:(NSString *)channel
+           extension:(NSDictionary *)extension
+   completionHandler:(dispatch_block_t)handler
+{
+    [[self stripeForChannel: channel] sendMessage: message
+                                        toChannel: channel
+                                        extension: extension
+                                completionHandler: handler];
+}
+
+#pragma mark - Requests
+
+- (void) sendRequest:(NSDictionary *)message
+           toChannel:(NSString *)channel
+             timeout:(NSTimeInterval)timeout
+   completionHandler:(FayeClientRequestCompletionHandlerBlock)handler
+{
+    FayeClientRequestCompletionHandlerBlock completion = NULL;
+    if (handler != NULL) {
+        __weak FayeStripedClient *weakSelf = self;
+        completion = ^(FayeClient *client, NSDictionary *response, NSError *error) {
+            handler(weakSelf, response, error);
+        };
+    }
+    [[self stripeForChannel: channel] sendRequest: message
+                                        toChannel: channel
+                                          timeout: timeout
+                                completionHandler: completion];
+}
+
+#pragma mark - Session Persistence
+
+- (BOOL) writeSessionToURL:(NSURL *)url error:(NSError **)error
+{
+    if (error != NULL) {
+        *error = [NSError errorWithDomain: kFayeErrorDomain code: 0 userInfo: @{
+            NSLocalizedDescriptionKey: @"Striped clients can't save sessions."
+        }];
+    }
+    return NO;
+}
+
+- (BOOL) restoreSessionFromURL:(NSURL *)url error:(NSError **)error
+{
+    return [self writeSessionToURL: url error: error];
+}
+
+#pragma mark - Statistics
+
+- (NSTimeInterval) roundTripTime
+{
+    return [[_stripes valueForKeyPath: @"@max.roundTripTime"] doubleValue];
+}
+
+- (NSUInteger) conflatedMessageCount
+{
+    return [[_stripes valueForKeyPath: @"@sum.conflatedMessageCount"] unsignedIntegerValue];
+}
+
+- (NSTimeInterval) throttledTimeInterval
+{
+    return [[_stripes valueForKeyPath: @"@sum.throttledTimeInterval"] doubleValue];
+}
+
+- (NSUInteger) throttleCount
+{
+    return [[_stripes valueForKeyPath: @"@sum.throttleCount"] unsignedIntegerValue];
+}
+
+- (NSUInteger) suppressedDuplicateCount
+{
+    return [[_stripes valueForKeyPath: @"@sum.suppressedDuplicateCount"] unsignedIntegerValue];
+}
+
+- (NSUInteger) lostSequencedMessageCount
+{
+    return [[_stripes valueForKeyPath: @"@sum.lostSequencedMessageCount"] unsignedIntegerValue];
+}
+
+- (NSUInteger) filteredMessageCount
+{
+    return [[_stripes valueForKeyPath: @"@sum.filteredMessageCount"] unsignedIntegerValue];
+}
+
+#pragma mark - Stripe Delegate
+
+// These all arrive on the callback queue.
+
+- (void) fayeClientDidChangeConnectionStatus:(FayeClient *)client
+{
+    FayeClientConnectionStatus status = [self stripedConnectionStatus];
+    if (status == _stripedConnectionStatus) {
+        return;
+    }
+    [self willChangeValueForKey: @"connectionStatus"];
+    _stripedConnectionStatus = status;
+    [self didChangeValueForKey: @"connectionStatus"];
+    if (self.stripedStatusHandler != NULL) {
+        self.stripedStatusHandler(self, nil);
+    }
+    id <FayeClientDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector: @selector(fayeClientDidChangeConnectionStatus:)]) {
+        [delegate fayeClientDidChangeConnectionStatus: self];
+    }
+}
+
+- (void) fayeClient:(FayeClient *)client didReceiveMessage:(NSDictionary *)message onChannel:(NSString *)channelPath
+{
+    id <FayeClientDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector: @selector(fayeClient:didReceiveMessage:onChannel:)]) {
+        [delegate fayeClient: self didReceiveMessage: message onChannel: channelPath];
+    }
+}
+
+- (void) fayeClient:(FayeClient *)client didSubscribeToChannel:(NSString *)channel
+{
+    id <FayeClientDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector: @selector(fayeClient:didSubscribeToChannel:)]) {
+        [delegate fayeClient: self didSubscribeToChannel: channel];
+    }
+}
+
+- (void) fayeClient:(FayeClient *)client didUnsubscribeFromChannel:(NSString *)channel
+{
+    id <FayeClientDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector: @selector(fayeClient:didUnsubscribeFromChannel:)]) {
+        [delegate fayeClient: self didUnsubscribeFromChannel: channel];
+    }
+}
+
+- (void) fayeClient:(FayeClient *)client didSendMessage:(NSDictionary *)message toChannel:(NSString *)channel
+{
+    id <FayeClientDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector: @selector(fayeClient:didSendMessage:toChannel:)]) {
+        [delegate fayeClient: self didSendMessage: message toChannel: channel];
+    }
+}
+
+@end
@@ -29,15 +29,42 @@
 #import <Foundation/Foundation.h>
 #import "FayeClient.h"
 
+@class FayeChannel;
+
+// A token from -[FayeClient addHandlerToChannel:messageHandler:completionHandler:]
+@interface FayeChannelHandler : NSObject
+@property (nonatomic, copy) NSString *channelPath;
+@property (nonatomic, copy) FayeClientChannelMessageHandlerBlock messageHandlerBlock;
+// The subscription it hangs off: its own, or a wildcard covering it.
+@property (nonatomic, weak) FayeChannel *channel;
+
+// Hands the completion handler over at most once.
+- (dispatch_block_t) takeCompletionHandler;
+- (void) setCompletionHandler: (dispatch_block_t) completionHandler;
+@end
+
 @interface FayeChannel : NSObject
 @property (nonatomic, copy) NSString *channelPath;
 // NOTE, this message handler happens OFF THE MAIN THREAD
 @property (nonatomic, copy) FayeClientChannelMessageHandlerBlock messageHandlerBlock;
+@property (nonatomic, copy) FayeClientChannelRawMessageHandlerBlock rawMessageHandlerBlock;
 @property (nonatomic, copy) FayeClientChannelSubscriptionStatusHandlerBlock statusHandlerBlock;
 @property (nonatomic, copy) NSDictionary *extension;
+@property (nonatomic, assign) FayeChannelSubscriptionOptions options;
+@property (nonatomic, copy) NSString *conflationKeyPath;
+@property (nonatomic, strong) FayeMessageFilter *filter;
 @property (nonatomic, assign) BOOL markedForSubscription;
 @property (nonatomic, assign) BOOL markedForUnsubscription;
+// Held by subscribeToChannel: until unsubscribeFromChannel:.  The server
+// subscription stays while this or any handler token does.
+@property (nonatomic, assign) BOOL subscribedDirectly;
+// Read on the receive queue, so both are replaced rather than mutated.
+@property (atomic, copy) NSArray *handlers;
+// Wildcards only: handler tokens for channels they cover, by channel path.
+@property (atomic, copy) NSDictionary *localHandlers;
 
 + (FayeChannel*) channelWithPath: (NSString*) path;
+// Exact match, or a trailing '*' matching a single path segment.
++ (BOOL) subscription: (NSString*) subscription matchesChannel: (NSString*) channelPath;
 
 @end
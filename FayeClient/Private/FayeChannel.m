@@ -28,6 +28,28 @@
 
 #import "FayeChannel.h"
 
+@implementation FayeChannelHandler {
+    dispatch_block_t _completionHandler;
+}
+
+- (dispatch_block_t) takeCompletionHandler
+{
+    @synchronized (self) {
+        dispatch_block_t completionHandler = _completionHandler;
+        _completionHandler = NULL;
+        return completionHandler;
+    }
+}
+
+- (void) setCompletionHandler: (dispatch_block_t) completionHandler
+{
+    @synchronized (self) {
+        _completionHandler = [completionHandler copy];
+    }
+}
+
+@end
+
 @implementation FayeChannel
 
 - (id) init
@@ -46,4 +68,19 @@
     return channel;
 }
 
++ (BOOL) subscription:(NSString *)subscription matchesChannel:(NSString *)channelPath
+{
+    if (![subscription hasSuffix: @"/*"]) {
+        return [subscription isEqualToString: channelPath];
+    }
+    NSUInteger prefixLength = subscription.length - 1;
+    if (channelPath.length <= prefixLength ||
+        ![channelPath hasPrefix: [subscription substringToIndex: prefixLength]])
+    {
+        return NO;
+    }
+    NSRange remainder = NSMakeRange(prefixLength, channelPath.length - prefixLength);
+    return [channelPath rangeOfString: @"/" options: NSLiteralSearch range: remainder].location == NSNotFound;
+}
+
 @end
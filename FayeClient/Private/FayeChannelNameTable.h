@@ -0,0 +1,63 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeChannelNameTable.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(uint8_t, FayeChannelTag) {
+    FayeChannelTagUnknown = 0,
+    FayeChannelTagOther,
+    FayeChannelTagHandshake,
+    FayeChannelTagConnect,
+    FayeChannelTagDisconnect,
+    FayeChannelTagSubscribe,
+    FayeChannelTagUnsubscribe
+};
+
+/*
+ Interning for channel names (and the client id, which is just as repetitive).
+ The same few names turn up in nearly every message, so rather than allocate
+ a string for each one the table hands back a single canonical instance per
+ name, found straight from the encoded bytes.  The meta channels are seeded
+ with the FayeClient*Channel constants themselves, so the canonical strings
+ for those are pointer-equal to the constants and carry a tag to switch on.
+
+ Open addressing over a fixed number of slots; when it fills up, everything
+ but the seeds is thrown away and `generation` goes up, so anyone keeping
+ per-name state keyed on the canonical pointers knows to drop it.
+ Not thread-safe.
+ */
+
+@interface FayeChannelNameTable : NSObject
+@property (nonatomic, readonly) NSUInteger generation;
+@property (nonatomic, readonly) NSUInteger count;
+
+// `tag` may be NULL.  Returns nil for invalid UTF-8.
+- (NSString*) stringWithUTF8Bytes: (const void*) bytes length: (NSUInteger) length tag: (FayeChannelTag*) tag;
+- (NSString*) internString: (NSString*) string tag: (FayeChannelTag*) tag;
+
+@end
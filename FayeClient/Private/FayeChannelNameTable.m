@@ -0,0 +1,212 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeChannelNameTable.m
+//  FayeObjC
+//
+
+#import "FayeChannelNameTable.h"
+#import "FayeClient.h"
+
+// Enough for a busy client's channels, small enough to throw away.
+static const uint32_t FayeChannelNameTableCapacity = 1024;
+static const uint32_t FayeChannelNameTableMaximumCount = FayeChannelNameTableCapacity * 3 / 4;
+// Longer names are rare, and not worth the memory.
+static const NSUInteger FayeChannelNameMaximumLength = 256;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t length;
+    uint8_t *bytes;
+    CFStringRef string;
+    FayeChannelTag tag;
+    BOOL seed;
+} FayeChannelNameEntry;
+
+static inline uint32_t FayeChannelNameHash(const uint8_t *bytes, NSUInteger length)
+{
+    // FNV-1a; zero is kept for empty slots.
+    uint32_t hash = 2166136261u;
+    for (NSUInteger i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash ?: 1;
+}
+
+@implementation FayeChannelNameTable {
+    FayeChannelNameEntry *_entries;
+    uint32_t _count;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self) {
+        _entries = calloc(FayeChannelNameTableCapacity, sizeof(FayeChannelNameEntry));
+        [self addSeed: FayeClientHandshakeChannel tag: FayeChannelTagHandshake];
+        [self addSeed: FayeClientConnectChannel tag: FayeChannelTagConnect];
+        [self addSeed: FayeClientDisconnectChannel tag: FayeChannelTagDisconnect];
+        [self addSeed: FayeClientSubscribeChannel tag: FayeChannelTagSubscribe];
+        [self addSeed: FayeClientUnsubscribeChannel tag: FayeChannelTagUnsubscribe];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    for (uint32_t i = 0; i < FayeChannelNameTableCapacity; i++) {
+        [self clearEntry: &_entries[i]];
+    }
+    free(_entries);
+}
+
+- (NSUInteger) count
+{
+    return _count;
+}
+
+- (void) addSeed: (NSString*) string tag: (FayeChannelTag) tag
+{
+    NSData *bytes = [string dataUsingEncoding: NSUTF8StringEncoding];
+    uint32_t hash = FayeChannelNameHash(bytes.bytes, bytes.length);
+    FayeChannelNameEntry *entry = [self entryForBytes: bytes.bytes length: bytes.length hash: hash];
+    [self fillEntry: entry bytes: bytes.bytes length: bytes.length hash: hash string: (__bridge CFStringRef) string tag: tag];
+    entry->seed = YES;
+}
+
+- (void) clearEntry: (FayeChannelNameEntry*) entry
+{
+    if (entry->hash != 0) {
+        free(entry->bytes);
+        CFRelease(entry->string);
+        memset(entry, 0, sizeof(FayeChannelNameEntry));
+    }
+}
+
+- (void) fillEntry: (FayeChannelNameEntry*) entry
+             bytes: (const uint8_t*) bytes
+            length: (NSUInteger) length
+              hash: (uint32_t) hash
+            string: (CFStringRef) string
+               tag: (FayeChannelTag) tag
+{
+    entry->hash = hash;
+    entry->length = (uint32_t) length;
+    entry->bytes = malloc(length);
+    memcpy(entry->bytes, bytes, length);
+    entry->string = CFRetain(string);
+    entry->tag = tag;
+    _count++;
+}
+
+// The matching entry, or the empty slot where it belongs.
+- (FayeChannelNameEntry*) entryForBytes: (const uint8_t*) bytes length: (NSUInteger) length hash: (uint32_t) hash
+{
+    uint32_t mask = FayeChannelNameTableCapacity - 1;
+    for (uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+        FayeChannelNameEntry *entry = &_entries[i];
+        if (entry->hash == 0 ||
+            (entry->hash == hash && entry->length == length && memcmp(entry->bytes, bytes, length) == 0))
+        {
+            return entry;
+        }
+    }
+}
+
+- (void) removeAllButSeeds
+{
+    // Entries can't just be cleared in place without breaking probe chains,
+    // so pull the seeds out and put them back.
+    NSMutableArray *seeds = [NSMutableArray new];
+    NSMutableArray *tags = [NSMutableArray new];
+    for (uint32_t i = 0; i < FayeChannelNameTableCapacity; i++) {
+        if (_entries[i].seed) {
+            [seeds addObject: (__bridge NSString*) _entries[i].string];
+            [tags addObject: @(_entries[i].tag)];
+        }
+        [self clearEntry: &_entries[i]];
+    }
+    _count = 0;
+    for (NSUInteger i = 0; i < seeds.count; i++) {
+        [self addSeed: seeds[i] tag: (FayeChannelTag) [tags[i] unsignedCharValue]];
+    }
+    _generation++;
+}
+
+- (NSString*) lookUpBytes: (const uint8_t*) bytes
+                   length: (NSUInteger) length
+                   string: (NSString*) string
+                      tag: (FayeChannelTag*) tag
+{
+    uint32_t hash = FayeChannelNameHash(bytes, length);
+    FayeChannelNameEntry *entry = [self entryForBytes: bytes length: length hash: hash];
+    if (entry->hash != 0) {
+        if (tag) {
+            *tag = entry->tag;
+        }
+        return (__bridge NSString*) entry->string;
+    }
+    if (string == nil) {
+        string = [[NSString alloc] initWithBytes: bytes length: length encoding: NSUTF8StringEncoding];
+        if (string == nil) {
+            return nil;
+        }
+    }
+    if (tag) {
+        *tag = FayeChannelTagOther;
+    }
+    if (length > FayeChannelNameMaximumLength) {
+        return string;
+    }
+    if (_count >= FayeChannelNameTableMaximumCount) {
+        [self removeAllButSeeds];
+        entry = [self entryForBytes: bytes length: length hash: hash];
+    }
+    [self fillEntry: entry bytes: bytes length: length hash: hash string: (__bridge CFStringRef) string tag: FayeChannelTagOther];
+    return string;
+}
+
+- (NSString*) stringWithUTF8Bytes:(const void *)bytes length:(NSUInteger)length tag:(FayeChannelTag *)tag
+{
+    return [self lookUpBytes: bytes length: length string: nil tag: tag];
+}
+
+- (NSString*) internString:(NSString *)string tag:(FayeChannelTag *)tag
+{
+    if (string == nil) {
+        return nil;
+    }
+    const char *bytes = CFStringGetCStringPtr((__bridge CFStringRef) string, kCFStringEncodingUTF8);
+    if (bytes == NULL) {
+        bytes = string.UTF8String;
+    }
+    if (bytes == NULL) {
+        return string;
+    }
+    // Immutable copy, in case we were handed a mutable string.
+    return [self lookUpBytes: (const uint8_t*) bytes length: strlen(bytes) string: [string copy] tag: tag];
+}
+
+@end
@@ -0,0 +1,102 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeChannelStatusTable.m
+//  FayeObjC
+//
+
+#import "FayeChannelStatusTable.h"
+
+@implementation FayeChannelStatusTable {
+    CFMutableDictionaryRef _statuses;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self) {
+        // Keys are retained strings; values are the status itself.
+        _statuses = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    CFRelease(_statuses);
+}
+
+- (NSUInteger) count
+{
+    return (NSUInteger) CFDictionaryGetCount(_statuses);
+}
+
+- (FayeChannelSubscriptionStatus) statusForChannel:(NSString *)channel
+{
+    const void *value = NULL;
+    if (channel == nil || !CFDictionaryGetValueIfPresent(_statuses, (__bridge CFStringRef) channel, &value)) {
+        return FayeChannelSubscriptionStatusUnsubscribed;
+    }
+    return (FayeChannelSubscriptionStatus) (intptr_t) value;
+}
+
+- (void) setStatus:(FayeChannelSubscriptionStatus)status forChannel:(NSString *)channel
+{
+    if (channel == nil) {
+        return;
+    }
+    if (status == FayeChannelSubscriptionStatusUnsubscribed) {
+        CFDictionaryRemoveValue(_statuses, (__bridge CFStringRef) channel);
+    } else {
+        // Copied so a mutable string can't change underneath the table.
+        CFDictionarySetValue(_statuses, (__bridge CFStringRef) [channel copy], (const void *) (intptr_t) status);
+    }
+}
+
+- (NSArray*) channelsWithStatus:(FayeChannelSubscriptionStatus)status
+{
+    CFIndex count = CFDictionaryGetCount(_statuses);
+    if (count == 0) {
+        return @[];
+    }
+    const void **keys = malloc(sizeof(void *) * count);
+    const void **values = malloc(sizeof(void *) * count);
+    CFDictionaryGetKeysAndValues(_statuses, keys, values);
+    NSMutableArray *channels = [NSMutableArray new];
+    for (CFIndex i = 0; i < count; i++) {
+        if ((FayeChannelSubscriptionStatus) (intptr_t) values[i] == status) {
+            [channels addObject: (__bridge NSString *) keys[i]];
+        }
+    }
+    free(keys);
+    free(values);
+    return channels;
+}
+
+- (void) removeAllStatuses
+{
+    CFDictionaryRemoveAllValues(_statuses);
+}
+
+@end
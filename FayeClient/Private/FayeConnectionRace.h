@@ -0,0 +1,72 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeConnectionRace.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+@class FayeServer;
+@class SRWebSocket;
+
+/*
+ "Happy eyeballs" for Faye servers.  Handshakes with the given servers in
+ order, starting the next one whenever the previous hasn't answered within
+ `staggerInterval` (or has already failed), and reports whichever completes a
+ successful handshake first.  Everything else is cancelled, except that
+ losers whose handshakes are already out are left to finish, and any client ID
+ they're given is disconnected straight away rather than left for the server
+ to time out.
+
+ The winner is handed over as-is: the handshake response data, plus the open
+ socket for WebSocket servers (whose delegate the new owner must take over).
+ Servers that fail have their failure counts bumped.  All work and the
+ completion handler run on `queue`.
+ */
+
+typedef NSData*(^FayeConnectionRaceHandshakeBlock)(FayeServer *server);
+typedef NSData*(^FayeConnectionRaceDisconnectBlock)(FayeServer *server, NSString *clientID);
+typedef void(^FayeConnectionRaceCompletionHandler)(FayeServer *server, NSData *handshakeResponse, SRWebSocket *webSocket);
+
+@interface FayeConnectionRace : NSObject
+@property (nonatomic, assign) NSTimeInterval staggerInterval;
+// How long each server gets to open and answer the handshake.
+@property (nonatomic, assign) NSTimeInterval timeout;
+// Encoded handshake batch to send to `server`.
+@property (nonatomic, copy) FayeConnectionRaceHandshakeBlock handshakeData;
+// Encoded /meta/disconnect batch for a losing server's client ID.  Without it
+// losers are simply cancelled.
+@property (nonatomic, copy) FayeConnectionRaceDisconnectBlock disconnectData;
+// HTTP handshakes (and disconnects) go through this session, which must
+// deliver to `queue` and is left open afterwards.  Set it before starting.
+@property (nonatomic, strong) NSURLSession *session;
+
+- (id) initWithServers: (NSArray*) servers queue: (dispatch_queue_t) queue;
+
+// `server` is nil if every one of them failed.
+- (void) startWithCompletionHandler: (FayeConnectionRaceCompletionHandler) handler;
+- (void) cancel;
+
+@end
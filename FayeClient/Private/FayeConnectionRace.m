@@ -0,0 +1,331 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeConnectionRace.m
+//  FayeObjC
+//
+
+#import "FayeConnectionRace.h"
+#import "FayeServer.h"
+#import "SRWebSocket.h"
+
+@interface FayeConnectionRaceCandidate : NSObject
+@property (nonatomic, strong) FayeServer *server;
+@property (nonatomic, strong) NSURLSessionDataTask *task;
+@property (nonatomic, strong) SRWebSocket *webSocket;
+@property (nonatomic, strong) NSData *handshake;
+@property (nonatomic, assign) BOOL sentHandshake;
+@end
+
+@implementation FayeConnectionRaceCandidate
+@end
+
+@interface FayeConnectionRace () <SRWebSocketDelegate>
+@property (nonatomic, copy) FayeConnectionRaceCompletionHandler completionHandler;
+@end
+
+@implementation FayeConnectionRace {
+    NSArray *_servers;
+    dispatch_queue_t _queue;
+    NSMutableArray *_candidates;
+    // Beaten candidates still waiting on their handshakes.
+    NSMutableArray *_losers;
+    NSUInteger _nextIndex;
+    BOOL _finished;
+}
+
+- (id) initWithServers:(NSArray *)servers queue:(dispatch_queue_t)queue
+{
+    self = [super init];
+    if (self) {
+        _servers = [servers copy];
+        _queue = queue;
+        _candidates = [NSMutableArray new];
+        _losers = [NSMutableArray new];
+        _staggerInterval = 0.25;
+        _timeout = 10;
+    }
+    return self;
+}
+
+- (void) startWithCompletionHandler:(FayeConnectionRaceCompletionHandler)handler
+{
+    dispatch_async(_queue, ^{
+        self.completionHandler = handler;
+        [self startNextCandidate];
+    });
+}
+
+- (void) cancel
+{
+    dispatch_async(_queue, ^{
+        if (!_finished) {
+            _finished = YES;
+            [self cancelCandidatesExcept: nil];
+            self.completionHandler = nil;
+        }
+    });
+}
+
+#pragma mark - Candidates (queue only)
+
+- (void) startNextCandidate
+{
+    if (_finished || _nextIndex >= _servers.count) {
+        return;
+    }
+    NSUInteger index = _nextIndex++;
+    FayeConnectionRaceCandidate *candidate = [FayeConnectionRaceCandidate new];
+    candidate.server = _servers[index];
+    [_candidates addObject: candidate];
+    
+    candidate.handshake = self.handshakeData(candidate.server);
+    if ([candidate.server connectsWithWebSockets]) {
+        NSURLRequest *request = [NSURLRequest requestWithURL: candidate.server.url
+                                                 cachePolicy: NSURLRequestReloadIgnoringLocalCacheData
+                                             timeoutInterval: self.timeout];
+        candidate.webSocket = [[SRWebSocket alloc] initWithURLRequest: request];
+        candidate.webSocket.delegate = self;
+        [candidate.webSocket setDelegateDispatchQueue: _queue];
+        [candidate.webSocket open];
+    } else {
+        NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL: candidate.server.url
+                                                               cachePolicy: NSURLRequestReloadIgnoringLocalCacheData
+                                                           timeoutInterval: self.timeout];
+        [request setHTTPMethod: @"POST"];
+        [request setHTTPBody: candidate.handshake];
+        [request setValue: @"application/json" forHTTPHeaderField: @"Content-Type"];
+        __weak FayeConnectionRaceCandidate *weakCandidate = candidate;
+        candidate.task = [self.session dataTaskWithRequest: request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+            FayeConnectionRaceCandidate *strongCandidate = weakCandidate;
+            if (strongCandidate == nil) {
+                return;
+            }
+            NSInteger statusCode = [response isKindOfClass: [NSHTTPURLResponse class]] ? ((NSHTTPURLResponse*) response).statusCode : 0;
+            NSString *clientID = (error == nil && statusCode < 400) ? [self clientIDFromHandshakeResponse: data] : nil;
+            [self candidate: strongCandidate didHandshakeWithClientID: clientID response: data];
+        }];
+        candidate.sentHandshake = YES;
+        [candidate.task resume];
+    }
+    
+    __weak FayeConnectionRaceCandidate *weakCandidate = candidate;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.timeout * NSEC_PER_SEC)), _queue, ^{
+        FayeConnectionRaceCandidate *strongCandidate = weakCandidate;
+        if (strongCandidate != nil && [_candidates containsObject: strongCandidate]) {
+            [self candidateDidFail: strongCandidate];
+        } else if (strongCandidate != nil) {
+            [self loserDidFinish: strongCandidate];
+        }
+    });
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.staggerInterval * NSEC_PER_SEC)), _queue, ^{
+        // Unless a failure has already moved things along.
+        if (_nextIndex == index + 1) {
+            [self startNextCandidate];
+        }
+    });
+}
+
+- (FayeConnectionRaceCandidate*) candidateForWebSocket: (SRWebSocket*) webSocket
+{
+    for (FayeConnectionRaceCandidate *candidate in [_candidates arrayByAddingObjectsFromArray: _losers]) {
+        if (candidate.webSocket == webSocket) {
+            return candidate;
+        }
+    }
+    return nil;
+}
+
+// Nil unless `data` holds a successful /meta/handshake reply.  The race's
+// handshakes are plain JSON, so anything else is a broken server (or a proxy
+// page), not a winner.
+- (NSString*) clientIDFromHandshakeResponse: (NSData*) data
+{
+    id batch = data.length > 0 ? [NSJSONSerialization JSONObjectWithData: data options: 0 error: NULL] : nil;
+    if (![batch isKindOfClass: [NSArray class]]) {
+        return nil;
+    }
+    for (NSDictionary *message in batch) {
+        if ([message isKindOfClass: [NSDictionary class]] &&
+            [message[@"channel"] isEqual: @"/meta/handshake"])
+        {
+            id successful = message[@"successful"];
+            id clientID = message[@"clientId"];
+            if ([successful respondsToSelector: @selector(boolValue)] && [successful boolValue] &&
+                [clientID isKindOfClass: [NSString class]])
+            {
+                return clientID;
+            }
+            return nil;
+        }
+    }
+    return nil;
+}
+
+- (void) candidate: (FayeConnectionRaceCandidate*) candidate
+didHandshakeWithClientID: (NSString*) clientID
+          response: (NSData*) data
+{
+    if ([_losers containsObject: candidate]) {
+        [self loser: candidate didHandshakeWithClientID: clientID];
+    } else if (clientID != nil) {
+        [self candidate: candidate didWinWithResponse: data];
+    } else {
+        [self candidateDidFail: candidate];
+    }
+}
+
+- (void) candidate: (FayeConnectionRaceCandidate*) candidate didWinWithResponse: (NSData*) data
+{
+    if (_finished) {
+        return;
+    }
+    _finished = YES;
+    SRWebSocket *webSocket = candidate.webSocket;
+    webSocket.delegate = nil;
+    [_candidates removeObject: candidate];
+    [self cancelCandidatesExcept: candidate];
+    FayeConnectionRaceCompletionHandler handler = self.completionHandler;
+    self.completionHandler = nil;
+    if (handler != NULL) {
+        handler(candidate.server, data, webSocket);
+    }
+}
+
+- (void) candidateDidFail: (FayeConnectionRaceCandidate*) candidate
+{
+    if (_finished || ![_candidates containsObject: candidate]) {
+        return;
+    }
+    candidate.server.failures += 1;
+    [self stopCandidate: candidate];
+    [_candidates removeObject: candidate];
+    if (_nextIndex < _servers.count) {
+        [self startNextCandidate];
+    } else if (_candidates.count == 0) {
+        _finished = YES;
+        FayeConnectionRaceCompletionHandler handler = self.completionHandler;
+        self.completionHandler = nil;
+        if (handler != NULL) {
+            handler(nil, nil, nil);
+        }
+    }
+}
+
+- (void) stopCandidate: (FayeConnectionRaceCandidate*) candidate
+{
+    [candidate.task cancel];
+    candidate.webSocket.delegate = nil;
+    [candidate.webSocket close];
+}
+
+- (void) cancelCandidatesExcept: (FayeConnectionRaceCandidate*) winner
+{
+    for (FayeConnectionRaceCandidate *candidate in _candidates) {
+        if (candidate == winner) {
+            continue;
+        }
+        if (candidate.sentHandshake && self.disconnectData != NULL) {
+            // The server may already have handed it a client ID.
+            [_losers addObject: candidate];
+        } else {
+            [self stopCandidate: candidate];
+        }
+    }
+    [_candidates removeAllObjects];
+}
+
+- (void) loser: (FayeConnectionRaceCandidate*) loser didHandshakeWithClientID: (NSString*) clientID
+{
+    NSData *disconnect = clientID != nil ? self.disconnectData(loser.server, clientID) : nil;
+    if (disconnect != nil) {
+        if (loser.webSocket != nil) {
+            [loser.webSocket send: disconnect];
+        } else {
+            NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL: loser.server.url
+                                                                   cachePolicy: NSURLRequestReloadIgnoringLocalCacheData
+                                                               timeoutInterval: self.timeout];
+            [request setHTTPMethod: @"POST"];
+            [request setHTTPBody: disconnect];
+            [request setValue: @"application/json" forHTTPHeaderField: @"Content-Type"];
+            [[self.session dataTaskWithRequest: request] resume];
+        }
+    }
+    [self loserDidFinish: loser];
+}
+
+- (void) loserDidFinish: (FayeConnectionRaceCandidate*) loser
+{
+    if (![_losers containsObject: loser]) {
+        return;
+    }
+    [self stopCandidate: loser];
+    [_losers removeObject: loser];
+}
+
+#pragma mark - SRWebSocketDelegate
+
+- (void) webSocketDidOpen:(SRWebSocket *)webSocket
+{
+    FayeConnectionRaceCandidate *candidate = [self candidateForWebSocket: webSocket];
+    candidate.sentHandshake = YES;
+    [webSocket send: candidate.handshake];
+}
+
+- (void) webSocket:(SRWebSocket *)webSocket didReceiveMessage:(id)message
+{
+    FayeConnectionRaceCandidate *candidate = [self candidateForWebSocket: webSocket];
+    if (candidate == nil) {
+        return;
+    }
+    NSData *data = message;
+    if ([message isKindOfClass: [NSString class]]) {
+        data = [(NSString*) message dataUsingEncoding: NSUTF8StringEncoding];
+    }
+    [self candidate: candidate
+didHandshakeWithClientID: [self clientIDFromHandshakeResponse: data]
+           response: data];
+}
+
+- (void) webSocket:(SRWebSocket *)webSocket didFailWithError:(NSError *)error
+{
+    FayeConnectionRaceCandidate *candidate = [self candidateForWebSocket: webSocket];
+    if ([_losers containsObject: candidate]) {
+        [self loserDidFinish: candidate];
+    } else if (candidate != nil) {
+        [self candidateDidFail: candidate];
+    }
+}
+
+- (void) webSocket:(SRWebSocket *)webSocket didCloseWithCode:(NSInteger)code reason:(NSString *)reason wasClean:(BOOL)wasClean
+{
+    FayeConnectionRaceCandidate *candidate = [self candidateForWebSocket: webSocket];
+    if ([_losers containsObject: candidate]) {
+        [self loserDidFinish: candidate];
+    } else if (candidate != nil) {
+        [self candidateDidFail: candidate];
+    }
+}
+
+@end
@@ -0,0 +1,44 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeEventSourceParser.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+/*
+ Incremental text/event-stream parser.  Feed it the response body as it
+ arrives and it hands back the data of each complete event; Faye sends one
+ JSON batch per event.  Only `data` fields matter here: event names, ids,
+ retry hints and comments are skipped.
+ */
+
+@interface FayeEventSourceParser : NSObject
+
+// Data of every event completed by `data`, as UTF-8 bytes.  May be empty.
+- (NSArray*) eventsByAppendingData: (NSData*) data;
+- (void) reset;
+
+@end
@@ -0,0 +1,125 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeEventSourceParser.m
+//  FayeObjC
+//
+
+#import "FayeEventSourceParser.h"
+
+@implementation FayeEventSourceParser {
+    NSMutableData *_line;
+    NSMutableData *_eventData;
+    BOOL _hasData;
+    BOOL _skipLineFeed;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self) {
+        _line = [NSMutableData new];
+        _eventData = [NSMutableData new];
+    }
+    return self;
+}
+
+- (void) reset
+{
+    [_line setLength: 0];
+    [_eventData setLength: 0];
+    _hasData = NO;
+    _skipLineFeed = NO;
+}
+
+- (NSArray*) eventsByAppendingData:(NSData *)data
+{
+    NSMutableArray *events = [NSMutableArray new];
+    const uint8_t *bytes = data.bytes;
+    NSUInteger length = data.length;
+    NSUInteger start = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        uint8_t c = bytes[i];
+        if (c != '\n' && c != '\r') {
+            continue;
+        }
+        if (c == '\n' && _skipLineFeed && i == start && _line.length == 0) {
+            // Second half of a CRLF split across calls (or just seen).
+            _skipLineFeed = NO;
+            start = i + 1;
+            continue;
+        }
+        [_line appendBytes: bytes + start length: i - start];
+        [self processLineInto: events];
+        [_line setLength: 0];
+        _skipLineFeed = (c == '\r');
+        start = i + 1;
+    }
+    if (start < length) {
+        [_line appendBytes: bytes + start length: length - start];
+        _skipLineFeed = NO;
+    }
+    return events;
+}
+
+- (void) processLineInto: (NSMutableArray*) events
+{
+    const uint8_t *line = _line.bytes;
+    NSUInteger length = _line.length;
+    if (length == 0) {
+        if (_hasData) {
+            [events addObject: [_eventData copy]];
+        }
+        [_eventData setLength: 0];
+        _hasData = NO;
+        return;
+    }
+    if (line[0] == ':') {
+        return;
+    }
+    static const char field[] = "data";
+    const NSUInteger fieldLength = sizeof(field) - 1;
+    if (length < fieldLength || memcmp(line, field, fieldLength) != 0) {
+        return;
+    }
+    NSUInteger valueStart;
+    if (length == fieldLength) {
+        valueStart = length;
+    } else if (line[fieldLength] == ':') {
+        valueStart = fieldLength + 1;
+        if (valueStart < length && line[valueStart] == ' ') {
+            valueStart++;
+        }
+    } else {
+        // Some other field that happens to start with "data".
+        return;
+    }
+    if (_hasData) {
+        [_eventData appendBytes: "\n" length: 1];
+    }
+    [_eventData appendBytes: line + valueStart length: length - valueStart];
+    _hasData = YES;
+}
+
+@end
@@ -0,0 +1,55 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeHostCache.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+/*
+ Resolved addresses per host name, kept for as long as the DNS records say
+ (and failures for `negativeTimeToLive`).  Resolving ahead of connecting
+ warms the system resolver too, so the real connection doesn't wait on DNS.
+ Not thread-safe; callbacks run on the queue given at init.
+ */
+
+typedef void(^FayeHostCacheCompletionHandler)(NSArray *addresses);
+
+@interface FayeHostCache : NSObject
+@property (nonatomic, assign) NSTimeInterval negativeTimeToLive;
+@property (nonatomic, assign) NSTimeInterval timeout;
+
+- (id) initWithQueue: (dispatch_queue_t) queue;
+
+// sockaddr structures wrapped in NSData.  nil if there's no fresh entry.
+- (NSArray*) addressesForHost: (NSString*) host;
+// YES if the host recently failed to resolve at all.
+- (BOOL) hostIsUnresolvable: (NSString*) host;
+// Calls back with the cached addresses if they're still fresh, otherwise
+// resolves the host first.  An empty array means it didn't resolve.
+- (void) resolveHost: (NSString*) host completionHandler: (FayeHostCacheCompletionHandler) handler;
+- (void) removeAllEntries;
+
+@end
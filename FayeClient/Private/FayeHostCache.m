@@ -0,0 +1,207 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeHostCache.m
+//  FayeObjC
+//
+
+#import "FayeHostCache.h"
+#import <dns_sd.h>
+
+@interface FayeHostCacheEntry : NSObject
+@property (nonatomic, copy) NSArray *addresses;
+@property (nonatomic, assign) CFAbsoluteTime expiry;
+@end
+
+@implementation FayeHostCacheEntry
+@end
+
+// One DNSServiceGetAddrInfo in flight, collecting answers until the last one.
+@interface FayeHostCacheLookup : NSObject
+@property (nonatomic, copy) NSString *host;
+@property (nonatomic, strong) NSMutableArray *addresses;
+@property (nonatomic, strong) NSMutableArray *handlers;
+@property (nonatomic, assign) uint32_t minimumTimeToLive;
+@property (nonatomic, assign) DNSServiceRef service;
+@property (nonatomic, weak) FayeHostCache *cache;
+@property (nonatomic, assign) BOOL finished;
+@end
+
+@implementation FayeHostCacheLookup
+@end
+
+@interface FayeHostCache ()
+- (void) finishLookup: (FayeHostCacheLookup*) lookup;
+@end
+
+static void FayeHostCacheAddrInfoReply(DNSServiceRef service,
+                                       DNSServiceFlags flags,
+                                       uint32_t interfaceIndex,
+                                       DNSServiceErrorType errorCode,
+                                       const char *hostname,
+                                       const struct sockaddr *address,
+                                       uint32_t ttl,
+                                       void *context)
+{
+    FayeHostCacheLookup *lookup = (__bridge FayeHostCacheLookup*) context;
+    if (errorCode == kDNSServiceErr_NoError && (flags & kDNSServiceFlagsAdd) && address != NULL) {
+        [lookup.addresses addObject: [NSData dataWithBytes: address length: address->sa_len]];
+        if (lookup.minimumTimeToLive == 0 || ttl < lookup.minimumTimeToLive) {
+            lookup.minimumTimeToLive = ttl;
+        }
+    }
+    if (errorCode != kDNSServiceErr_NoError || !(flags & kDNSServiceFlagsMoreComing)) {
+        [lookup.cache finishLookup: lookup];
+    }
+}
+
+@implementation FayeHostCache {
+    dispatch_queue_t _queue;
+    NSMutableDictionary *_entries;
+    NSMutableDictionary *_lookups;
+}
+
+- (id) initWithQueue:(dispatch_queue_t)queue
+{
+    self = [super init];
+    if (self) {
+        _queue = queue;
+        _entries = [NSMutableDictionary new];
+        _lookups = [NSMutableDictionary new];
+        _negativeTimeToLive = 30;
+        _timeout = 5;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    for (FayeHostCacheLookup *lookup in _lookups.allValues) {
+        DNSServiceRefDeallocate(lookup.service);
+    }
+}
+
+- (FayeHostCacheEntry*) freshEntryForHost: (NSString*) host
+{
+    FayeHostCacheEntry *entry = _entries[host.lowercaseString];
+    if (entry != nil && entry.expiry <= CFAbsoluteTimeGetCurrent()) {
+        [_entries removeObjectForKey: host.lowercaseString];
+        return nil;
+    }
+    return entry;
+}
+
+- (NSArray*) addressesForHost:(NSString *)host
+{
+    FayeHostCacheEntry *entry = [self freshEntryForHost: host];
+    return entry.addresses.count > 0 ? entry.addresses : nil;
+}
+
+- (BOOL) hostIsUnresolvable:(NSString *)host
+{
+    FayeHostCacheEntry *entry = [self freshEntryForHost: host];
+    return entry != nil && entry.addresses.count == 0;
+}
+
+- (void) removeAllEntries
+{
+    [_entries removeAllObjects];
+}
+
+- (void) resolveHost:(NSString *)host completionHandler:(FayeHostCacheCompletionHandler)handler
+{
+    NSString *key = host.lowercaseString;
+    FayeHostCacheEntry *entry = [self freshEntryForHost: key];
+    if (entry != nil) {
+        if (handler != NULL) {
+            handler(entry.addresses);
+        }
+        return;
+    }
+    FayeHostCacheLookup *lookup = _lookups[key];
+    if (lookup != nil) {
+        if (handler != NULL) {
+            [lookup.handlers addObject: [handler copy]];
+        }
+        return;
+    }
+    
+    lookup = [FayeHostCacheLookup new];
+    lookup.host = key;
+    lookup.addresses = [NSMutableArray new];
+    lookup.handlers = [NSMutableArray new];
+    lookup.cache = self;
+    if (handler != NULL) {
+        [lookup.handlers addObject: [handler copy]];
+    }
+    DNSServiceRef service = NULL;
+    DNSServiceErrorType error = DNSServiceGetAddrInfo(&service, 0, 0,
+                                                      kDNSServiceProtocol_IPv4 | kDNSServiceProtocol_IPv6,
+                                                      key.UTF8String,
+                                                      FayeHostCacheAddrInfoReply,
+                                                      (__bridge void*) lookup);
+    if (error != kDNSServiceErr_NoError) {
+        [self finishLookup: lookup];
+        return;
+    }
+    lookup.service = service;
+    _lookups[key] = lookup;
+    DNSServiceSetDispatchQueue(service, _queue);
+    
+    __weak FayeHostCacheLookup *weakLookup = lookup;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.timeout * NSEC_PER_SEC)), _queue, ^{
+        FayeHostCacheLookup *strongLookup = weakLookup;
+        if (strongLookup != nil) {
+            [self finishLookup: strongLookup];
+        }
+    });
+}
+
+- (void) finishLookup: (FayeHostCacheLookup*) lookup
+{
+    // The last answer and the timeout can both get here.
+    if (lookup.finished) {
+        return;
+    }
+    lookup.finished = YES;
+    if (lookup.service != NULL) {
+        DNSServiceRefDeallocate(lookup.service);
+        lookup.service = NULL;
+    }
+    [_lookups removeObjectForKey: lookup.host];
+    
+    FayeHostCacheEntry *entry = [FayeHostCacheEntry new];
+    entry.addresses = lookup.addresses;
+    NSTimeInterval ttl = lookup.addresses.count > 0 ? lookup.minimumTimeToLive : self.negativeTimeToLive;
+    entry.expiry = CFAbsoluteTimeGetCurrent() + ttl;
+    _entries[lookup.host] = entry;
+    
+    NSArray *handlers = lookup.handlers.copy;
+    [lookup.handlers removeAllObjects];
+    for (FayeHostCacheCompletionHandler handler in handlers) {
+        handler(entry.addresses);
+    }
+}
+
+@end
@@ -0,0 +1,68 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeInterceptorChain.h
+//  FayeObjC
+//
+
+
+#import <Foundation/Foundation.h>
+
+typedef void(^FayeInterceptorChainNextBlock)(NSData *data);
+// Hands `data` to one interceptor, which calls `next` when it's done with it.
+typedef void(^FayeInterceptorChainStage)(id interceptor, NSData *data, FayeInterceptorChainNextBlock next);
+typedef void(^FayeInterceptorChainOutput)(NSData *data);
+
+/*
+ One direction of the client's interceptors, for the ones that respond to
+ `selector`.  Each batch goes through them in turn, and batches (and blocks
+ queued between them) come out in the order they went in, however long a
+ stage takes.  While there are no interceptors and nothing is in flight,
+ batches go straight through.  Everything but adding and removing happens on
+ the chain's queue.
+ */
+
+@interface FayeInterceptorChain : NSObject
+
+- (id) initWithQueue: (dispatch_queue_t) queue
+            selector: (SEL) selector
+               stage: (FayeInterceptorChainStage) stage;
+
+// Seconds a stage has to call `next` before the batch is dropped; zero for no
+// limit.
+@property (atomic, assign) NSTimeInterval stageTimeout;
+
+// Any thread.
+- (void) addInterceptor: (id) interceptor;
+- (void) removeInterceptor: (id) interceptor;
+
+// `output` gets the result on the chain's queue, or nil if a stage dropped it.
+- (void) processData: (NSData*) data output: (FayeInterceptorChainOutput) output;
+// Runs `block` once everything submitted before it has come out.
+- (void) enqueueBlock: (dispatch_block_t) block;
+// Forgets everything submitted so far without running it.  Whatever a stage
+// is still working on never comes out, and its `next` does nothing.
+- (void) reset;
+
+@end
@@ -0,0 +1,168 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeInterceptorChain.m
+//  FayeObjC
+//
+
+
+#import "FayeInterceptorChain.h"
+
+@interface FayeInterceptorChainItem : NSObject
+@property (nonatomic, strong) NSData *data;
+@property (nonatomic, copy) FayeInterceptorChainOutput output;
+@property (nonatomic, copy) dispatch_block_t block;
+@end
+
+@implementation FayeInterceptorChainItem
+@end
+
+@interface FayeInterceptorChain ()
+@property (atomic, copy) NSArray *interceptors;
+@end
+
+@implementation FayeInterceptorChain {
+    dispatch_queue_t _queue;
+    SEL _selector;
+    FayeInterceptorChainStage _stage;
+    NSMutableArray *_backlog;
+    BOOL _running;
+    NSUInteger _generation;
+}
+
+- (id) initWithQueue:(dispatch_queue_t)queue selector:(SEL)selector stage:(FayeInterceptorChainStage)stage
+{
+    self = [super init];
+    if (self) {
+        _queue = queue;
+        _selector = selector;
+        _stage = [stage copy];
+        _backlog = [NSMutableArray new];
+        self.interceptors = @[];
+    }
+    return self;
+}
+
+- (void) addInterceptor:(id)interceptor
+{
+    if (![interceptor respondsToSelector: _selector]) {
+        return;
+    }
+    @synchronized (self) {
+        self.interceptors = [self.interceptors arrayByAddingObject: interceptor];
+    }
+}
+
+- (void) removeInterceptor:(id)interceptor
+{
+    @synchronized (self) {
+        NSMutableArray *interceptors = self.interceptors.mutableCopy;
+        [interceptors removeObjectIdenticalTo: interceptor];
+        self.interceptors = interceptors;
+    }
+}
+
+- (void) processData:(NSData *)data output:(FayeInterceptorChainOutput)output
+{
+    if (!_running && _backlog.count == 0 && self.interceptors.count == 0) {
+        output(data);
+        return;
+    }
+    FayeInterceptorChainItem *item = [FayeInterceptorChainItem new];
+    item.data = data;
+    item.output = output;
+    [_backlog addObject: item];
+    [self pump];
+}
+
+- (void) enqueueBlock:(dispatch_block_t)block
+{
+    if (!_running && _backlog.count == 0) {
+        block();
+        return;
+    }
+    FayeInterceptorChainItem *item = [FayeInterceptorChainItem new];
+    item.block = block;
+    [_backlog addObject: item];
+}
+
+- (void) pump
+{
+    while (!_running && _backlog.count > 0) {
+        FayeInterceptorChainItem *item = _backlog[0];
+        [_backlog removeObjectAtIndex: 0];
+        if (item.block != NULL) {
+            item.block();
+            continue;
+        }
+        _running = YES;
+        [self runItem: item stages: self.interceptors index: 0 data: item.data];
+    }
+}
+
+- (void) reset
+{
+    _generation++;
+    _running = NO;
+    [_backlog removeAllObjects];
+}
+
+// Finishes the item on the spot once there are no stages left; otherwise the
+// next stage's continuation picks it up again.
+- (void) runItem: (FayeInterceptorChainItem*) item
+          stages: (NSArray*) stages
+           index: (NSUInteger) index
+            data: (NSData*) data
+{
+    if (data == nil || index >= stages.count) {
+        item.output(data);
+        _running = NO;
+        return;
+    }
+    // Whichever comes first of the stage's answer and the timeout; nothing
+    // at all if the chain's been reset in the meantime.
+    NSUInteger generation = _generation;
+    __block BOOL answered = NO;
+    void (^advance)(NSData*) = ^(NSData *result) {
+        if (answered || generation != _generation) {
+            return;
+        }
+        answered = YES;
+        [self runItem: item stages: stages index: index + 1 data: result];
+        [self pump];
+    };
+    _stage(stages[index], data, ^(NSData *result) {
+        dispatch_async(_queue, ^{
+            advance(result);
+        });
+    });
+    NSTimeInterval timeout = self.stageTimeout;
+    if (timeout > 0) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC)), _queue, ^{
+            advance(nil);
+        });
+    }
+}
+
+@end
@@ -0,0 +1,75 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeJSONScanner.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+/*
+ Structural scanning of JSON bytes without building any objects.  This is what
+ lets the client route a Bayeux batch by looking only at each message's
+ `channel`, `id` etc. and leave `data` undecoded until (and unless) somebody
+ wants it.  The scanner doesn't validate; anything it hands out still goes
+ through NSJSONSerialization before it becomes an object.
+ */
+
+typedef struct {
+    size_t location;
+    size_t length;
+} FayeJSONSpan;
+
+extern const size_t FayeJSONNotFound;
+
+// Return NO to stop enumerating.  `key` is the raw key between its quotes.
+typedef BOOL (*FayeJSONMemberVisitor)(void *context, FayeJSONSpan key, FayeJSONSpan value);
+typedef BOOL (*FayeJSONElementVisitor)(void *context, FayeJSONSpan element);
+
+size_t FayeJSONSkipWhitespace(const uint8_t *bytes, size_t index, size_t end);
+// Both return the index just past the string/value, or FayeJSONNotFound.
+size_t FayeJSONSkipString(const uint8_t *bytes, size_t index, size_t end);
+size_t FayeJSONSkipValue(const uint8_t *bytes, size_t index, size_t end);
+
+// Span of the top-level value in `bytes`, trimmed of whitespace.
+BOOL FayeJSONRootSpan(const uint8_t *bytes, size_t length, FayeJSONSpan *root);
+BOOL FayeJSONEnumerateElements(const uint8_t *bytes, FayeJSONSpan array, FayeJSONElementVisitor visitor, void *context);
+BOOL FayeJSONEnumerateMembers(const uint8_t *bytes, FayeJSONSpan object, FayeJSONMemberVisitor visitor, void *context);
+BOOL FayeJSONFindMember(const uint8_t *bytes, FayeJSONSpan object, const char *key, FayeJSONSpan *value);
+
+static inline BOOL FayeJSONSpanHasPrefix(const uint8_t *bytes, FayeJSONSpan span, char character)
+{
+    return span.length > 0 && bytes[span.location] == (uint8_t) character;
+}
+
+@interface FayeJSONScanner : NSObject
+
+// Decodes a string span (quotes included).  Strings without escapes are made
+// straight from the bytes.
++ (NSString*) stringWithSpan: (FayeJSONSpan) span inData: (NSData*) data;
+// Decodes any value span.
++ (id) objectWithSpan: (FayeJSONSpan) span inData: (NSData*) data;
++ (NSData*) dataWithSpan: (FayeJSONSpan) span inData: (NSData*) data;
+
+@end
@@ -0,0 +1,369 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeJSONScanner.m
+//  FayeObjC
+//
+
+#import "FayeJSONScanner.h"
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #include <arm_neon.h>
+  #define FAYE_JSON_NEON 1
+#endif
+
+const size_t FayeJSONNotFound = SIZE_MAX;
+
+#pragma mark - Block search
+
+/*
+ Nearly all of the scanner's time goes into running through string contents
+ and nested data looking for the few bytes that matter, so those searches look
+ at 16 bytes at a time where the CPU allows.  Both return `end` (or whatever
+ was passed in, if that's already past it) when there's no match.
+ */
+
+#if FAYE_JSON_NEON
+// One nibble per lane: the lowest set nibble is the first matching byte.
+static inline uint64_t FayeJSONNEONMask(uint8x16_t matches)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+}
+#endif
+
+// First '"' or '\\' at or after `index`.
+static inline size_t FayeJSONNextStringSpecial(const uint8_t *bytes, size_t index, size_t end)
+{
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while (index + 16 <= end) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (bytes + index));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, quote),
+                                                  _mm_cmpeq_epi8(block, backslash)));
+        if (mask != 0) {
+            return index + __builtin_ctz(mask);
+        }
+        index += 16;
+    }
+#elif FAYE_JSON_NEON
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    while (index + 16 <= end) {
+        uint8x16_t block = vld1q_u8(bytes + index);
+        uint64_t mask = FayeJSONNEONMask(vorrq_u8(vceqq_u8(block, quote), vceqq_u8(block, backslash)));
+        if (mask != 0) {
+            return index + (__builtin_ctzll(mask) >> 2);
+        }
+        index += 16;
+    }
+#endif
+    while (index < end && bytes[index] != '"' && bytes[index] != '\\') {
+        index++;
+    }
+    return index;
+}
+
+// First '"', '{', '}', '[' or ']' at or after `index`.  Setting bit 5 folds
+// the square brackets onto the curly ones, so it's three compares, not five.
+static inline size_t FayeJSONNextStructural(const uint8_t *bytes, size_t index, size_t end)
+{
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i fold = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    while (index + 16 <= end) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (bytes + index));
+        __m128i folded = _mm_or_si128(block, fold);
+        __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(block, quote),
+                                       _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)));
+        int mask = _mm_movemask_epi8(matches);
+        if (mask != 0) {
+            return index + __builtin_ctz(mask);
+        }
+        index += 16;
+    }
+#elif FAYE_JSON_NEON
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t fold = vdupq_n_u8(0x20);
+    const uint8x16_t open = vdupq_n_u8('{');
+    const uint8x16_t close = vdupq_n_u8('}');
+    while (index + 16 <= end) {
+        uint8x16_t block = vld1q_u8(bytes + index);
+        uint8x16_t folded = vorrq_u8(block, fold);
+        uint8x16_t matches = vorrq_u8(vceqq_u8(block, quote),
+                                      vorrq_u8(vceqq_u8(folded, open), vceqq_u8(folded, close)));
+        uint64_t mask = FayeJSONNEONMask(matches);
+        if (mask != 0) {
+            return index + (__builtin_ctzll(mask) >> 2);
+        }
+        index += 16;
+    }
+#endif
+    while (index < end) {
+        uint8_t c = bytes[index];
+        if (c == '"' || (c | 0x20) == '{' || (c | 0x20) == '}') {
+            break;
+        }
+        index++;
+    }
+    return index;
+}
+
+#pragma mark - Scanner
+
+static inline BOOL FayeJSONIsWhitespace(uint8_t c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+size_t FayeJSONSkipWhitespace(const uint8_t *bytes, size_t index, size_t end)
+{
+    while (index < end && FayeJSONIsWhitespace(bytes[index])) {
+        index++;
+    }
+    return index;
+}
+
+size_t FayeJSONSkipString(const uint8_t *bytes, size_t index, size_t end)
+{
+    if (index >= end || bytes[index] != '"') {
+        return FayeJSONNotFound;
+    }
+    index++;
+    for (;;) {
+        index = FayeJSONNextStringSpecial(bytes, index, end);
+        if (index >= end) {
+            return FayeJSONNotFound;
+        }
+        if (bytes[index] == '"') {
+            return index + 1;
+        }
+        // Backslash: whatever it escapes can't end the string.
+        index += 2;
+    }
+}
+
+static size_t FayeJSONSkipContainer(const uint8_t *bytes, size_t index, size_t end)
+{
+    // Only brackets and strings matter here; anything malformed inside gets
+    // caught when (if) the value is actually decoded.
+    size_t depth = 0;
+    for (;;) {
+        index = FayeJSONNextStructural(bytes, index, end);
+        if (index >= end) {
+            return FayeJSONNotFound;
+        }
+        uint8_t c = bytes[index];
+        if (c == '"') {
+            index = FayeJSONSkipString(bytes, index, end);
+            if (index == FayeJSONNotFound) {
+                return FayeJSONNotFound;
+            }
+            continue;
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) {
+                return FayeJSONNotFound;
+            }
+            if (--depth == 0) {
+                return index + 1;
+            }
+        }
+        index++;
+    }
+}
+
+size_t FayeJSONSkipValue(const uint8_t *bytes, size_t index, size_t end)
+{
+    if (index >= end) {
+        return FayeJSONNotFound;
+    }
+    uint8_t c = bytes[index];
+    if (c == '"') {
+        return FayeJSONSkipString(bytes, index, end);
+    } else if (c == '{' || c == '[') {
+        return FayeJSONSkipContainer(bytes, index, end);
+    }
+    // Number or literal: runs up to the next delimiter.
+    size_t start = index;
+    while (index < end) {
+        c = bytes[index];
+        if (c == ',' || c == '}' || c == ']' || FayeJSONIsWhitespace(c)) {
+            break;
+        }
+        index++;
+    }
+    return index == start ? FayeJSONNotFound : index;
+}
+
+BOOL FayeJSONRootSpan(const uint8_t *bytes, size_t length, FayeJSONSpan *root)
+{
+    size_t start = FayeJSONSkipWhitespace(bytes, 0, length);
+    size_t end = FayeJSONSkipValue(bytes, start, length);
+    if (end == FayeJSONNotFound || FayeJSONSkipWhitespace(bytes, end, length) != length) {
+        return NO;
+    }
+    root->location = start;
+    root->length = end - start;
+    return YES;
+}
+
+BOOL FayeJSONEnumerateElements(const uint8_t *bytes, FayeJSONSpan array, FayeJSONElementVisitor visitor, void *context)
+{
+    size_t end = array.location + array.length;
+    if (array.length < 2 || bytes[array.location] != '[' || bytes[end - 1] != ']') {
+        return NO;
+    }
+    size_t index = FayeJSONSkipWhitespace(bytes, array.location + 1, end - 1);
+    if (index == end - 1) {
+        return YES;
+    }
+    while (index < end - 1) {
+        size_t valueEnd = FayeJSONSkipValue(bytes, index, end - 1);
+        if (valueEnd == FayeJSONNotFound) {
+            return NO;
+        }
+        FayeJSONSpan element = { index, valueEnd - index };
+        if (!visitor(context, element)) {
+            return YES;
+        }
+        index = FayeJSONSkipWhitespace(bytes, valueEnd, end - 1);
+        if (index == end - 1) {
+            return YES;
+        }
+        if (bytes[index] != ',') {
+            return NO;
+        }
+        index = FayeJSONSkipWhitespace(bytes, index + 1, end - 1);
+    }
+    return NO;
+}
+
+BOOL FayeJSONEnumerateMembers(const uint8_t *bytes, FayeJSONSpan object, FayeJSONMemberVisitor visitor, void *context)
+{
+    size_t end = object.location + object.length;
+    if (object.length < 2 || bytes[object.location] != '{' || bytes[end - 1] != '}') {
+        return NO;
+    }
+    size_t index = FayeJSONSkipWhitespace(bytes, object.location + 1, end - 1);
+    if (index == end - 1) {
+        return YES;
+    }
+    while (index < end - 1) {
+        size_t keyEnd = FayeJSONSkipString(bytes, index, end - 1);
+        if (keyEnd == FayeJSONNotFound) {
+            return NO;
+        }
+        FayeJSONSpan key = { index + 1, keyEnd - index - 2 };
+        index = FayeJSONSkipWhitespace(bytes, keyEnd, end - 1);
+        if (index >= end - 1 || bytes[index] != ':') {
+            return NO;
+        }
+        index = FayeJSONSkipWhitespace(bytes, index + 1, end - 1);
+        size_t valueEnd = FayeJSONSkipValue(bytes, index, end - 1);
+        if (valueEnd == FayeJSONNotFound) {
+            return NO;
+        }
+        FayeJSONSpan value = { index, valueEnd - index };
+        if (!visitor(context, key, value)) {
+            return YES;
+        }
+        index = FayeJSONSkipWhitespace(bytes, valueEnd, end - 1);
+        if (index == end - 1) {
+            return YES;
+        }
+        if (bytes[index] != ',') {
+            return NO;
+        }
+        index = FayeJSONSkipWhitespace(bytes, index + 1, end - 1);
+    }
+    return NO;
+}
+
+typedef struct {
+    const uint8_t *bytes;
+    const char *key;
+    size_t keyLength;
+    FayeJSONSpan *value;
+    BOOL found;
+} FayeJSONFindMemberContext;
+
+static BOOL FayeJSONFindMemberVisitor(void *context, FayeJSONSpan key, FayeJSONSpan value)
+{
+    FayeJSONFindMemberContext *find = context;
+    // Keys are compared as raw bytes, so an escaped spelling of the key won't match.
+    if (key.length == find->keyLength && memcmp(find->bytes + key.location, find->key, key.length) == 0) {
+        *find->value = value;
+        find->found = YES;
+        return NO;
+    }
+    return YES;
+}
+
+BOOL FayeJSONFindMember(const uint8_t *bytes, FayeJSONSpan object, const char *key, FayeJSONSpan *value)
+{
+    FayeJSONFindMemberContext context = { bytes, key, strlen(key), value, NO };
+    if (!FayeJSONEnumerateMembers(bytes, object, FayeJSONFindMemberVisitor, &context)) {
+        return NO;
+    }
+    return context.found;
+}
+
+#pragma mark - Decoding
+
+@implementation FayeJSONScanner
+
++ (NSString*) stringWithSpan:(FayeJSONSpan)span inData:(NSData *)data
+{
+    id object = [self objectWithSpan: span inData: data];
+    return [object isKindOfClass: [NSString class]] ? object : nil;
+}
+
++ (id) objectWithSpan:(FayeJSONSpan)span inData:(NSData *)data
+{
+    const uint8_t *bytes = data.bytes;
+    if (span.length >= 2 && bytes[span.location] == '"' &&
+        memchr(bytes + span.location + 1, '\\', span.length - 2) == NULL)
+    {
+        // Channel names, ids and most keys: no escapes, so no parser needed.
+        return [[NSString alloc] initWithBytes: bytes + span.location + 1
+                                        length: span.length - 2
+                                      encoding: NSUTF8StringEncoding];
+    }
+    return [NSJSONSerialization JSONObjectWithData: [self dataWithSpan: span inData: data]
+                                           options: NSJSONReadingAllowFragments
+                                             error: NULL];
+}
+
++ (NSData*) dataWithSpan:(FayeJSONSpan)span inData:(NSData *)data
+{
+    return [data subdataWithRange: NSMakeRange(span.location, span.length)];
+}
+
+@end
@@ -0,0 +1,54 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeLastValueCache.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+/*
+ Thread-safe LRU cache of the most recent message data seen on each channel.
+ Written from the client's read queue, read from anywhere: it has its own lock
+ so readers never wait on message delivery.
+ */
+
+@interface FayeLastValueCache : NSObject
+// Zero means unlimited.
+@property (nonatomic, assign) NSUInteger countLimit;
+// Approximate bytes, see +costOfObject:.  Zero means unlimited.
+@property (nonatomic, assign) NSUInteger costLimit;
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic, readonly) NSUInteger totalCost;
+
+- (NSDictionary*) dataForChannel: (NSString*) channel;
+- (void) setData: (NSDictionary*) data forChannel: (NSString*) channel;
+// Removes every cached channel that the given (possibly wildcard) subscription matches.
+- (void) removeDataForSubscription: (NSString*) subscription;
+- (void) removeAllData;
+
+// Rough in-memory footprint of a decoded JSON object graph.
++ (NSUInteger) costOfObject: (id) object;
+
+@end
@@ -0,0 +1,272 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeLastValueCache.m
+//  FayeObjC
+//
+
+#import "FayeLastValueCache.h"
+#import "FayeChannel.h"
+#import "FayeLazyJSONDictionary.h"
+#import <pthread.h>
+
+@interface FayeLastValueCacheEntry : NSObject {
+@public
+    NSString *_channel;
+    NSDictionary *_data;
+    NSUInteger _cost;
+    FayeLastValueCacheEntry *_next;
+    __unsafe_unretained FayeLastValueCacheEntry *_previous;
+}
+@end
+
+@implementation FayeLastValueCacheEntry
+@end
+
+@implementation FayeLastValueCache {
+    pthread_mutex_t _lock;
+    NSMutableDictionary *_entries;
+    // Most recently used at the head.
+    FayeLastValueCacheEntry *_head;
+    __unsafe_unretained FayeLastValueCacheEntry *_tail;
+    NSUInteger _totalCost;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self) {
+        pthread_mutex_init(&_lock, NULL);
+        _entries = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    // Unlink iteratively; letting ARC release a long _next chain recurses.
+    FayeLastValueCacheEntry *entry = _head;
+    _head = nil;
+    while (entry) {
+        FayeLastValueCacheEntry *next = entry->_next;
+        entry->_next = nil;
+        entry = next;
+    }
+    pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark - List Maintenance (lock held)
+
+- (void) unlinkEntry: (FayeLastValueCacheEntry*) entry
+{
+    FayeLastValueCacheEntry *strongEntry = entry;
+    if (entry->_previous) {
+        entry->_previous->_next = entry->_next;
+    } else {
+        _head = entry->_next;
+    }
+    if (entry->_next) {
+        entry->_next->_previous = entry->_previous;
+    } else {
+        _tail = entry->_previous;
+    }
+    entry->_next = nil;
+    entry->_previous = nil;
+    strongEntry = nil;
+}
+
+- (void) pushEntryToFront: (FayeLastValueCacheEntry*) entry
+{
+    entry->_previous = nil;
+    entry->_next = _head;
+    if (_head) {
+        _head->_previous = entry;
+    }
+    _head = entry;
+    if (_tail == nil) {
+        _tail = entry;
+    }
+}
+
+- (void) removeEntry: (FayeLastValueCacheEntry*) entry
+{
+    _totalCost -= entry->_cost;
+    [_entries removeObjectForKey: entry->_channel];
+    [self unlinkEntry: entry];
+}
+
+- (void) trimToLimits
+{
+    while (_tail != nil &&
+           ((_countLimit > 0 && _entries.count > _countLimit) ||
+            (_costLimit > 0 && _totalCost > _costLimit)))
+    {
+        [self removeEntry: _tail];
+    }
+}
+
+#pragma mark - Public
+
+- (NSDictionary*) dataForChannel:(NSString *)channel
+{
+    NSDictionary *data = nil;
+    pthread_mutex_lock(&_lock);
+    FayeLastValueCacheEntry *entry = _entries[channel];
+    if (entry) {
+        data = entry->_data;
+        if (entry != _head) {
+            FayeLastValueCacheEntry *strongEntry = entry;
+            [self unlinkEntry: strongEntry];
+            [self pushEntryToFront: strongEntry];
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+    return data;
+}
+
+- (void) setData:(NSDictionary *)data forChannel:(NSString *)channel
+{
+    if (data == nil || channel == nil) {
+        return;
+    }
+    if ([data isKindOfClass: [FayeLazyJSONDictionary class]]) {
+        FayeLazyJSONDictionary *lazy = (FayeLazyJSONDictionary*) data;
+        if (lazy.encodedLength < lazy.backingDataLength) {
+            // A view into a batch frame would keep the whole frame alive for
+            // as long as it's cached, so keep a copy of its own bytes instead.
+            NSData *own = lazy.JSONData;
+            FayeJSONSpan span = { 0, own.length };
+            data = [[FayeLazyJSONDictionary alloc] initWithData: own span: span] ?: data;
+        }
+    }
+    NSUInteger cost = [FayeLastValueCache costOfObject: data] + [FayeLastValueCache costOfObject: channel];
+    pthread_mutex_lock(&_lock);
+    FayeLastValueCacheEntry *entry = _entries[channel];
+    if (entry) {
+        _totalCost -= entry->_cost;
+        [self unlinkEntry: entry];
+    } else {
+        entry = [FayeLastValueCacheEntry new];
+        entry->_channel = [channel copy];
+        _entries[entry->_channel] = entry;
+    }
+    entry->_data = data;
+    entry->_cost = cost;
+    _totalCost += cost;
+    [self pushEntryToFront: entry];
+    [self trimToLimits];
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void) removeDataForSubscription:(NSString *)subscription
+{
+    pthread_mutex_lock(&_lock);
+    if (![subscription hasSuffix: @"/*"]) {
+        FayeLastValueCacheEntry *entry = _entries[subscription];
+        if (entry) {
+            [self removeEntry: entry];
+        }
+    } else {
+        for (NSString *channel in _entries.allKeys) {
+            if ([FayeChannel subscription: subscription matchesChannel: channel]) {
+                [self removeEntry: _entries[channel]];
+            }
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void) removeAllData
+{
+    pthread_mutex_lock(&_lock);
+    while (_tail) {
+        [self removeEntry: _tail];
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void) setCountLimit:(NSUInteger)countLimit
+{
+    pthread_mutex_lock(&_lock);
+    _countLimit = countLimit;
+    [self trimToLimits];
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void) setCostLimit:(NSUInteger)costLimit
+{
+    pthread_mutex_lock(&_lock);
+    _costLimit = costLimit;
+    [self trimToLimits];
+    pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger) count
+{
+    pthread_mutex_lock(&_lock);
+    NSUInteger count = _entries.count;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+- (NSUInteger) totalCost
+{
+    pthread_mutex_lock(&_lock);
+    NSUInteger cost = _totalCost;
+    pthread_mutex_unlock(&_lock);
+    return cost;
+}
+
+#pragma mark - Cost Estimation
+
++ (NSUInteger) costOfObject:(id)object
+{
+    // Per-object overhead is a guess at malloc + isa + refcount; it only needs
+    // to be roughly proportional for the cost limit to be useful.
+    static const NSUInteger objectOverhead = 16;
+    if ([object isKindOfClass: [NSString class]]) {
+        return objectOverhead + [(NSString*) object length] * sizeof(unichar);
+    } else if ([object isKindOfClass: [FayeLazyJSONDictionary class]]) {
+        // Walking it would decode everything; what it really costs is the
+        // buffer it holds on to, which setData:forChannel: keeps to its own bytes.
+        return objectOverhead + [(FayeLazyJSONDictionary*) object backingDataLength];
+    } else if ([object isKindOfClass: [NSDictionary class]]) {
+        __block NSUInteger cost = objectOverhead + [(NSDictionary*) object count] * 2 * sizeof(id);
+        [(NSDictionary*) object enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            cost += [self costOfObject: key] + [self costOfObject: value];
+        }];
+        return cost;
+    } else if ([object isKindOfClass: [NSArray class]]) {
+        NSUInteger cost = objectOverhead + [(NSArray*) object count] * sizeof(id);
+        for (id element in (NSArray*) object) {
+            cost += [self costOfObject: element];
+        }
+        return cost;
+    } else if ([object isKindOfClass: [NSData class]]) {
+        return objectOverhead + [(NSData*) object length];
+    }
+    return objectOverhead;
+}
+
+@end
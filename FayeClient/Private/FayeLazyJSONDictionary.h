@@ -0,0 +1,48 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeLazyJSONDictionary.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+#import "FayeJSONScanner.h"
+
+// An NSDictionary over the undecoded bytes of a JSON object.  Keys are found
+// on first use and each value is only decoded when it is asked for, so a
+// handler that reads one field out of a big payload only pays for that field.
+// Nested objects are lazy too.
+@interface FayeLazyJSONDictionary : NSDictionary
+
+// Returns nil if `span` isn't an object.
+- (id) initWithData: (NSData*) data span: (FayeJSONSpan) span;
+// The object's own bytes, still encoded.
+@property (nonatomic, readonly) NSData *JSONData;
+// Length of the object's own bytes, which may be only part of the buffer
+// being kept alive.
+@property (nonatomic, readonly) NSUInteger encodedLength;
+// Size of the buffer being kept alive, which is usually the whole frame.
+@property (nonatomic, readonly) NSUInteger backingDataLength;
+
+@end
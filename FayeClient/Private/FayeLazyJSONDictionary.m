@@ -0,0 +1,197 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeLazyJSONDictionary.m
+//  FayeObjC
+//
+
+#import "FayeLazyJSONDictionary.h"
+#import <pthread.h>
+
+@interface FayeLazyJSONDictionary () {
+    NSData *_data;
+    FayeJSONSpan _span;
+    pthread_mutex_t _lock;
+    BOOL _scanned;
+    NSUInteger _count;
+    // Key -> index into the parallel span/value arrays; values fill in as
+    // they're decoded.
+    NSMutableDictionary *_indexes;
+    FayeJSONSpan *_valueSpans;
+    NSMutableArray *_values;
+}
+@end
+
+typedef struct {
+    __unsafe_unretained NSData *data;
+    __unsafe_unretained NSMutableDictionary *indexes;
+    FayeJSONSpan *spans;
+    NSUInteger count;
+    NSUInteger capacity;
+} FayeLazyJSONScanContext;
+
+static BOOL FayeLazyJSONScanMember(void *context, FayeJSONSpan key, FayeJSONSpan value)
+{
+    FayeLazyJSONScanContext *scan = context;
+    NSString *keyString = [FayeJSONScanner stringWithSpan: (FayeJSONSpan) { key.location - 1, key.length + 2 }
+                                                   inData: scan->data];
+    if (keyString == nil) {
+        return YES;
+    }
+    NSNumber *existing = scan->indexes[keyString];
+    if (existing != nil) {
+        // Later duplicates win, as they do with NSJSONSerialization.
+        scan->spans[existing.unsignedIntegerValue] = value;
+        return YES;
+    }
+    if (scan->count == scan->capacity) {
+        scan->capacity = MAX(8, scan->capacity * 2);
+        scan->spans = reallocf(scan->spans, scan->capacity * sizeof(FayeJSONSpan));
+    }
+    scan->indexes[keyString] = @(scan->count);
+    scan->spans[scan->count++] = value;
+    return YES;
+}
+
+@implementation FayeLazyJSONDictionary
+
+- (id) initWithData:(NSData *)data span:(FayeJSONSpan)span
+{
+    if (!FayeJSONSpanHasPrefix(data.bytes, span, '{')) {
+        return nil;
+    }
+    self = [super init];
+    if (self) {
+        _data = data;
+        _span = span;
+        pthread_mutex_init(&_lock, NULL);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    free(_valueSpans);
+    pthread_mutex_destroy(&_lock);
+}
+
+- (NSData*) JSONData
+{
+    if (_span.location == 0 && _span.length == _data.length) {
+        return _data;
+    }
+    return [FayeJSONScanner dataWithSpan: _span inData: _data];
+}
+
+- (NSUInteger) encodedLength
+{
+    return _span.length;
+}
+
+- (NSUInteger) backingDataLength
+{
+    return _data.length;
+}
+
+// Must hold _lock.
+- (void) scanIfNeeded
+{
+    if (_scanned) {
+        return;
+    }
+    _scanned = YES;
+    _indexes = [NSMutableDictionary new];
+    FayeLazyJSONScanContext context = { _data, _indexes, NULL, 0, 0 };
+    FayeJSONEnumerateMembers(_data.bytes, _span, FayeLazyJSONScanMember, &context);
+    _valueSpans = context.spans;
+    _count = context.count;
+    _values = [NSMutableArray arrayWithCapacity: _count];
+    for (NSUInteger i = 0; i < _count; i++) {
+        [_values addObject: [NSNull null]];
+    }
+}
+
+// Must hold _lock.  Decoded values are stored in place of their NSNull
+// placeholder; a JSON null decodes to NSNull too, which is harmless to redo.
+- (id) valueAtIndex: (NSUInteger) index
+{
+    id value = _values[index];
+    if (value != [NSNull null]) {
+        return value;
+    }
+    FayeJSONSpan span = _valueSpans[index];
+    if (FayeJSONSpanHasPrefix(_data.bytes, span, '{')) {
+        value = [[FayeLazyJSONDictionary alloc] initWithData: _data span: span];
+    } else if (FayeJSONSpanHasPrefix(_data.bytes, span, '"')) {
+        value = [FayeJSONScanner stringWithSpan: span inData: _data];
+    } else {
+        value = [FayeJSONScanner objectWithSpan: span inData: _data];
+    }
+    if (value == nil) {
+        value = [NSNull null];
+    }
+    _values[index] = value;
+    return value;
+}
+
+#pragma mark - NSDictionary
+
+- (NSUInteger) count
+{
+    pthread_mutex_lock(&_lock);
+    [self scanIfNeeded];
+    NSUInteger count = _count;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+- (id) objectForKey:(id)aKey
+{
+    pthread_mutex_lock(&_lock);
+    [self scanIfNeeded];
+    id value = nil;
+    NSNumber *index = _indexes[aKey];
+    if (index != nil) {
+        value = [self valueAtIndex: index.unsignedIntegerValue];
+    }
+    pthread_mutex_unlock(&_lock);
+    return value;
+}
+
+- (NSEnumerator*) keyEnumerator
+{
+    pthread_mutex_lock(&_lock);
+    [self scanIfNeeded];
+    NSArray *keys = [_indexes allKeys];
+    pthread_mutex_unlock(&_lock);
+    return [keys objectEnumerator];
+}
+
+- (id) copyWithZone:(NSZone *)zone
+{
+    // Immutable; copying would only force everything to decode.
+    return self;
+}
+
+@end
@@ -31,6 +31,7 @@
 #else
   #import <UIKit/UIKit.h>
 #endif
+#import "FayeChannelNameTable.h"
 /*
  Represents the faye message structure
  */
@@ -47,11 +48,30 @@
 @property (nonatomic, copy) NSDictionary *advice;
 @property (nonatomic, copy) NSString *error;
 @property (nonatomic, copy) NSString *subscription;
+// Set instead of `subscription` when replying to a batched (un)subscribe.
+@property (nonatomic, copy) NSArray *subscriptions;
 @property (nonatomic, strong) NSDate *timestamp;
 @property (nonatomic, copy) NSDictionary *data;
 @property (nonatomic, copy) NSDictionary *ext;
 @property (nonatomic, copy) NSString *fayeId;
+// The still-encoded `data` member, for subscriptions that take raw bytes.
+// `data` is left nil when this is set.
+@property (nonatomic, strong) NSData *rawData;
+// Already checked against its subscription's filter while still encoded.
+@property (nonatomic, assign) BOOL passedFilter;
+// Set once `channel` is the interned instance.
+@property (nonatomic, assign) FayeChannelTag channelTag;
+// Held on to past the receive loop, so it mustn't be recycled.
+@property (nonatomic, assign) BOOL retained;
 
 - (id) initWithDict:(NSDictionary *)dict;
+// Overwrites every property that initWithDict: sets, present in `dict` or not.
+- (void) setPropertiesWithDict:(NSDictionary *)dict;
+- (void) reset;
+- (BOOL) hasData;
+// The message's members as they arrived, for anything that has to see the
+// same message the raw bytes would show.  `data` stands in for the data
+// member, which may only be held as bytes.
+- (NSDictionary*) dictionaryWithData: (NSDictionary*) data;
 
 @end
@@ -57,41 +57,98 @@
     return dateFormatter;
 }
 
+static inline id FayeMessageValue(NSDictionary *dict, NSString *key)
+{
+    id object = dict[key];
+    return object == [NSNull null] ? nil : object;
+}
+
+static inline void FayeMessageSetValue(NSMutableDictionary *dict, NSString *key, id value)
+{
+    if (value != nil) {
+        dict[key] = value;
+    }
+}
+
 - (id) initWithDict:(NSDictionary *)dict
 {
     self = [super init];
     if (self != nil) {
-        NSArray *properties = @[@"channel",
-                                @"clientId",
-                                @"successful",
-                                @"authSuccessful",
-                                @"version",
-                                @"minimumVersion",
-                                @"supportedConnectionTypes",
-                                @"advice",
-                                @"error",
-                                @"subscription",
-                                @"data",
-                                @"ext"];
-        for (NSString *propertyName in properties) {
-            id object = dict[propertyName];
-            if (object != [NSNull null]) {
-                [self setValue: object forKey: propertyName];
-            }
-        }
-        self.fayeId = dict[@"id"];
-        NSString *timestamp = dict[@"timestamp"];
-        if (timestamp) {
-            if ([timestamp hasSuffix: @"Z"]) {
-                self.timestamp = [[FayeMessage dateTimeFormatter] dateFromString: timestamp];
-            } else {
-                self.timestamp = [[FayeMessage dateTimeZoneFormatter] dateFromString: timestamp];
-            }
-        }
+        [self setPropertiesWithDict: dict];
     }
     return self;
 }
 
+- (void) setPropertiesWithDict:(NSDictionary *)dict
+{
+    // Plain setters rather than KVC: this runs for every message received.
+    self.channel = FayeMessageValue(dict, @"channel");
+    self.clientId = FayeMessageValue(dict, @"clientId");
+    self.successful = FayeMessageValue(dict, @"successful");
+    self.authSuccessful = FayeMessageValue(dict, @"authSuccessful");
+    self.version = FayeMessageValue(dict, @"version");
+    self.minimumVersion = FayeMessageValue(dict, @"minimumVersion");
+    self.supportedConnectionTypes = FayeMessageValue(dict, @"supportedConnectionTypes");
+    self.advice = FayeMessageValue(dict, @"advice");
+    self.error = FayeMessageValue(dict, @"error");
+    id subscription = FayeMessageValue(dict, @"subscription");
+    if ([subscription isKindOfClass: [NSArray class]]) {
+        self.subscription = nil;
+        self.subscriptions = subscription;
+    } else {
+        self.subscription = subscription;
+        self.subscriptions = nil;
+    }
+    self.data = FayeMessageValue(dict, @"data");
+    self.ext = FayeMessageValue(dict, @"ext");
+    self.fayeId = dict[@"id"];
+    self.timestamp = nil;
+    NSString *timestamp = dict[@"timestamp"];
+    if (timestamp) {
+        if ([timestamp hasSuffix: @"Z"]) {
+            self.timestamp = [[FayeMessage dateTimeFormatter] dateFromString: timestamp];
+        } else {
+            self.timestamp = [[FayeMessage dateTimeZoneFormatter] dateFromString: timestamp];
+        }
+    }
+}
+
+- (void) reset
+{
+    [self setPropertiesWithDict: nil];
+    self.rawData = nil;
+    self.passedFilter = NO;
+    self.channelTag = FayeChannelTagUnknown;
+    self.retained = NO;
+}
+
+- (BOOL) hasData
+{
+    return self.data != nil || self.rawData != nil;
+}
+
+- (NSDictionary*) dictionaryWithData:(NSDictionary *)data
+{
+    NSMutableDictionary *dict = [NSMutableDictionary new];
+    FayeMessageSetValue(dict, @"channel", self.channel);
+    FayeMessageSetValue(dict, @"clientId", self.clientId);
+    FayeMessageSetValue(dict, @"successful", self.successful);
+    FayeMessageSetValue(dict, @"authSuccessful", self.authSuccessful);
+    FayeMessageSetValue(dict, @"version", self.version);
+    FayeMessageSetValue(dict, @"minimumVersion", self.minimumVersion);
+    FayeMessageSetValue(dict, @"supportedConnectionTypes", self.supportedConnectionTypes);
+    FayeMessageSetValue(dict, @"advice", self.advice);
+    FayeMessageSetValue(dict, @"error", self.error);
+    FayeMessageSetValue(dict, @"subscription", self.subscriptions ?: self.subscription);
+    FayeMessageSetValue(dict, @"data", data);
+    FayeMessageSetValue(dict, @"ext", self.ext);
+    FayeMessageSetValue(dict, @"id", self.fayeId);
+    if (self.timestamp != nil) {
+        dict[@"timestamp"] = [[FayeMessage dateTimeFormatter] stringFromDate: self.timestamp];
+    }
+    return dict;
+}
+
 - (NSString*)description {
     NSMutableString *desc = [NSMutableString stringWithString: @"\n"];
     unsigned int propCount = 0;
@@ -0,0 +1,62 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessageChunker.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+@class FayeMessage;
+
+/*
+ Publishes too big for one frame are sent as several smaller publishes on the
+ same channel, each carrying a base64 slice of the JSON-encoded data and
+ ext.chunk = { id, index, count }.  The chunk ids are the original id with
+ ".<index>" appended; `id` in ext.chunk is the original.  Subscribers put
+ them back together; the server just passes them along.
+
+ Reassembly holds at most `maximumPendingMessages` incomplete messages, and
+ gives up on any that haven't completed within `timeout`.  Not thread-safe.
+ */
+
+extern NSString * const FayeMessageChunkExtensionKey;
+
+@interface FayeMessageChunker : NSObject
+@property (nonatomic, assign) NSTimeInterval timeout;
+@property (nonatomic, assign) NSUInteger maximumPendingMessages;
+@property (nonatomic, readonly) NSUInteger droppedMessageCount;
+
+// `envelopeLength` is how many bytes of each chunk message aren't data.
+// Returns nil if `message` can't be chunked to fit in `maximumLength`.
++ (NSArray*) chunksOfPublishMessage: (NSDictionary*) message
+                      maximumLength: (NSUInteger) maximumLength
+                     envelopeLength: (NSUInteger (^)(NSDictionary *chunk)) envelopeLength;
++ (BOOL) messageIsChunk: (FayeMessage*) message;
+
+// Returns the whole message once its last chunk arrives, otherwise nil.
+- (FayeMessage*) messageByAddingChunk: (FayeMessage*) chunk;
+- (void) removeAllChunks;
+
+@end
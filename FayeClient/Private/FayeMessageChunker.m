@@ -0,0 +1,188 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessageChunker.m
+//  FayeObjC
+//
+
+#import "FayeMessageChunker.h"
+#import "FayeMessage.h"
+
+NSString * const FayeMessageChunkExtensionKey = @"chunk";
+
+@interface FayeMessageChunkSet : NSObject
+@property (nonatomic, strong) NSMutableArray *pieces;
+@property (nonatomic, assign) NSUInteger received;
+@property (nonatomic, assign) CFAbsoluteTime startTime;
+@end
+
+@implementation FayeMessageChunkSet
+@end
+
+@implementation FayeMessageChunker {
+    NSMutableDictionary *_sets;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self) {
+        _sets = [NSMutableDictionary new];
+        _timeout = 30;
+        _maximumPendingMessages = 32;
+    }
+    return self;
+}
+
++ (NSArray*) chunksOfPublishMessage:(NSDictionary *)message
+                      maximumLength:(NSUInteger)maximumLength
+                     envelopeLength:(NSUInteger (^)(NSDictionary *))envelopeLength
+{
+    NSString *messageID = [message[@"id"] description];
+    NSData *data = [NSJSONSerialization isValidJSONObject: @[message[@"data"] ?: [NSNull null]]] ?
+        [NSJSONSerialization dataWithJSONObject: message[@"data"] options: 0 error: NULL] : nil;
+    if (messageID == nil || data == nil) {
+        return nil;
+    }
+    
+    NSMutableDictionary *ext = [NSMutableDictionary dictionaryWithDictionary: message[@"ext"] ?: @{}];
+    NSMutableDictionary *chunk = [message mutableCopy];
+    // Room for the largest index and count this could possibly need.
+    ext[FayeMessageChunkExtensionKey] = @{ @"id": messageID, @"index": @(data.length), @"count": @(data.length) };
+    chunk[@"ext"] = ext;
+    chunk[@"id"] = [NSString stringWithFormat: @"%@.%lu", messageID, (unsigned long) data.length];
+    chunk[@"data"] = @"";
+    NSUInteger envelope = envelopeLength(chunk);
+    if (envelope >= maximumLength) {
+        return nil;
+    }
+    NSUInteger pieceLength = (maximumLength - envelope) / 4 * 3;
+    if (pieceLength == 0) {
+        return nil;
+    }
+    
+    NSUInteger count = (data.length + pieceLength - 1) / pieceLength;
+    NSMutableArray *chunks = [NSMutableArray arrayWithCapacity: count];
+    for (NSUInteger index = 0; index < count; index++) {
+        NSUInteger offset = index * pieceLength;
+        NSUInteger length = MIN(pieceLength, data.length - offset);
+        ext[FayeMessageChunkExtensionKey] = @{ @"id": messageID, @"index": @(index), @"count": @(count) };
+        chunk[@"ext"] = [ext copy];
+        chunk[@"id"] = [NSString stringWithFormat: @"%@.%lu", messageID, (unsigned long) index];
+        NSData *piece = [[NSData alloc] initWithBytesNoCopy: (uint8_t*) data.bytes + offset length: length freeWhenDone: NO];
+        chunk[@"data"] = [piece base64EncodedStringWithOptions: 0];
+        [chunks addObject: [chunk copy]];
+    }
+    return chunks;
+}
+
++ (BOOL) messageIsChunk:(FayeMessage *)message
+{
+    return [message.ext[FayeMessageChunkExtensionKey] isKindOfClass: [NSDictionary class]];
+}
+
+- (void) removeExpiredSets
+{
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    for (NSString *key in _sets.allKeys) {
+        FayeMessageChunkSet *set = _sets[key];
+        if (now - set.startTime > self.timeout) {
+            [_sets removeObjectForKey: key];
+            _droppedMessageCount++;
+        }
+    }
+}
+
+- (FayeMessage*) messageByAddingChunk:(FayeMessage *)chunk
+{
+    NSDictionary *info = chunk.ext[FayeMessageChunkExtensionKey];
+    id messageID = info[@"id"];
+    NSNumber *index = info[@"index"];
+    NSNumber *count = info[@"count"];
+    if (messageID == nil || ![index isKindOfClass: [NSNumber class]] || ![count isKindOfClass: [NSNumber class]] ||
+        count.unsignedIntegerValue == 0 || index.unsignedIntegerValue >= count.unsignedIntegerValue ||
+        ![chunk.data isKindOfClass: [NSString class]])
+    {
+        return nil;
+    }
+    
+    [self removeExpiredSets];
+    NSString *key = [NSString stringWithFormat: @"%@\n%@", chunk.channel, messageID];
+    FayeMessageChunkSet *set = _sets[key];
+    if (set == nil) {
+        if (_sets.count >= self.maximumPendingMessages) {
+            return nil;
+        }
+        set = [FayeMessageChunkSet new];
+        set.pieces = [NSMutableArray arrayWithCapacity: count.unsignedIntegerValue];
+        for (NSUInteger i = 0; i < count.unsignedIntegerValue; i++) {
+            [set.pieces addObject: [NSNull null]];
+        }
+        set.startTime = CFAbsoluteTimeGetCurrent();
+        _sets[key] = set;
+    }
+    if (set.pieces.count != count.unsignedIntegerValue) {
+        return nil;
+    }
+    if (set.pieces[index.unsignedIntegerValue] == [NSNull null]) {
+        set.pieces[index.unsignedIntegerValue] = chunk.data;
+        set.received++;
+    }
+    if (set.received < set.pieces.count) {
+        return nil;
+    }
+    
+    [_sets removeObjectForKey: key];
+    NSMutableData *data = [NSMutableData new];
+    for (NSString *piece in set.pieces) {
+        NSData *decoded = [[NSData alloc] initWithBase64EncodedString: piece options: 0];
+        if (decoded == nil) {
+            _droppedMessageCount++;
+            return nil;
+        }
+        [data appendData: decoded];
+    }
+    id object = [NSJSONSerialization JSONObjectWithData: data options: NSJSONReadingAllowFragments error: NULL];
+    if (object == nil) {
+        _droppedMessageCount++;
+        return nil;
+    }
+    FayeMessage *message = [FayeMessage new];
+    message.channel = chunk.channel;
+    message.channelTag = chunk.channelTag;
+    message.clientId = chunk.clientId;
+    message.fayeId = [messageID description];
+    NSMutableDictionary *ext = [chunk.ext mutableCopy];
+    [ext removeObjectForKey: FayeMessageChunkExtensionKey];
+    message.ext = ext.count > 0 ? ext : nil;
+    message.data = object;
+    return message;
+}
+
+- (void) removeAllChunks
+{
+    [_sets removeAllObjects];
+}
+
+@end
@@ -0,0 +1,71 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessageDispatcher.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+/*
+ Hands received messages over to the queue that user code runs on.  Ordinary
+ deliveries are simply queued; conflated deliveries keep at most one pending
+ block per key, so a consumer that falls behind only ever sees the newest data.
+ */
+
+typedef void(^FayeMessageDispatcherThrottleHandler)(BOOL throttled);
+
+@interface FayeMessageDispatcher : NSObject
+// Changing it only affects later dispatches; those already queued run where
+// they were sent, and pending conflated blocks and counters carry over.
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, readonly) NSUInteger conflatedCount;
+// Deliveries queued but not yet run.
+@property (nonatomic, readonly) NSUInteger pendingCount;
+// When pendingCount reaches the high watermark the throttle handler is called
+// with YES; once it drains back down to the low watermark, with NO.  A high
+// watermark of zero disables throttling.  Calls are serialised and always
+// report the current state, so the same value may be reported twice.
+@property (nonatomic, assign) NSUInteger highWatermark;
+@property (nonatomic, assign) NSUInteger lowWatermark;
+@property (nonatomic, copy) FayeMessageDispatcherThrottleHandler throttleHandler;
+
+- (id) initWithQueue: (dispatch_queue_t) queue;
+
+- (void) dispatchBlock: (dispatch_block_t) block;
+// If a block for `key` is still waiting to run, it's replaced by this one and
+// the replacement is counted against `counterKey`.
+- (void) dispatchBlock: (dispatch_block_t) block
+      conflatingWithKey: (NSString*) key
+             counterKey: (NSString*) counterKey;
+
+// For conflation done before the dispatcher ever saw the message.
+- (void) countConflationForCounterKey: (NSString*) counterKey;
+- (NSUInteger) conflatedCountForCounterKey: (NSString*) counterKey;
+- (void) resetCounters;
+// Forgets that the throttle handler was told YES, without calling it.  The
+// next dispatch over the high watermark throttles again.
+- (void) resetThrottle;
+
+@end
@@ -0,0 +1,238 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessageDispatcher.m
+//  FayeObjC
+//
+
+#import "FayeMessageDispatcher.h"
+#import <pthread.h>
+
+@implementation FayeMessageDispatcher {
+    dispatch_queue_t _queue;
+    pthread_mutex_t _lock;
+    // Held while telling the throttle handler, so calls can't overtake each other.
+    pthread_mutex_t _throttleHandlerLock;
+    NSMutableDictionary *_pendingBlocks;
+    NSMutableDictionary *_conflatedCounts;
+    NSUInteger _conflatedCount;
+    NSUInteger _pendingCount;
+    BOOL _throttled;
+}
+
+- (id) initWithQueue:(dispatch_queue_t)queue
+{
+    self = [super init];
+    if (self) {
+        _queue = queue;
+        pthread_mutex_init(&_lock, NULL);
+        pthread_mutex_init(&_throttleHandlerLock, NULL);
+        _pendingBlocks = [NSMutableDictionary new];
+        _conflatedCounts = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    pthread_mutex_destroy(&_lock);
+    pthread_mutex_destroy(&_throttleHandlerLock);
+}
+
+#pragma mark - Pending Count (lock held)
+
+// Both return YES if the throttle state changed, in which case the caller
+// calls notifyThrottleHandler once it has let go of the lock.
+- (BOOL) incrementPendingCount
+{
+    _pendingCount++;
+    if (!_throttled && _highWatermark > 0 && _pendingCount >= _highWatermark) {
+        _throttled = YES;
+        return YES;
+    }
+    return NO;
+}
+
+- (BOOL) decrementPendingCount
+{
+    _pendingCount--;
+    if (_throttled && _pendingCount <= _lowWatermark) {
+        _throttled = NO;
+        return YES;
+    }
+    return NO;
+}
+
+- (void) notifyThrottleHandler
+{
+    pthread_mutex_lock(&_throttleHandlerLock);
+    pthread_mutex_lock(&_lock);
+    BOOL throttled = _throttled;
+    FayeMessageDispatcherThrottleHandler handler = _throttleHandler;
+    pthread_mutex_unlock(&_lock);
+    if (handler != NULL) {
+        handler(throttled);
+    }
+    pthread_mutex_unlock(&_throttleHandlerLock);
+}
+
+#pragma mark - Dispatching
+
+- (void) dispatchBlock:(dispatch_block_t)block
+{
+    pthread_mutex_lock(&_lock);
+    BOOL changed = [self incrementPendingCount];
+    dispatch_queue_t queue = _queue;
+    pthread_mutex_unlock(&_lock);
+    if (changed) {
+        [self notifyThrottleHandler];
+    }
+    dispatch_async(queue, ^{
+        block();
+        pthread_mutex_lock(&_lock);
+        BOOL drained = [self decrementPendingCount];
+        pthread_mutex_unlock(&_lock);
+        if (drained) {
+            [self notifyThrottleHandler];
+        }
+    });
+}
+
+- (void) dispatchBlock:(dispatch_block_t)block
+     conflatingWithKey:(NSString *)key
+            counterKey:(NSString *)counterKey
+{
+    pthread_mutex_lock(&_lock);
+    BOOL alreadyScheduled = _pendingBlocks[key] != nil;
+    BOOL changed = NO;
+    _pendingBlocks[key] = [block copy];
+    if (alreadyScheduled) {
+        _conflatedCount++;
+        _conflatedCounts[counterKey] = @([_conflatedCounts[counterKey] unsignedIntegerValue] + 1);
+    } else {
+        changed = [self incrementPendingCount];
+    }
+    dispatch_queue_t queue = _queue;
+    pthread_mutex_unlock(&_lock);
+    
+    if (changed) {
+        [self notifyThrottleHandler];
+    }
+    if (alreadyScheduled) {
+        return;
+    }
+    dispatch_async(queue, ^{
+        pthread_mutex_lock(&_lock);
+        dispatch_block_t latest = _pendingBlocks[key];
+        [_pendingBlocks removeObjectForKey: key];
+        pthread_mutex_unlock(&_lock);
+        if (latest != NULL) {
+            latest();
+        }
+        pthread_mutex_lock(&_lock);
+        BOOL drained = [self decrementPendingCount];
+        pthread_mutex_unlock(&_lock);
+        if (drained) {
+            [self notifyThrottleHandler];
+        }
+    });
+}
+
+- (dispatch_queue_t) queue
+{
+    pthread_mutex_lock(&_lock);
+    dispatch_queue_t queue = _queue;
+    pthread_mutex_unlock(&_lock);
+    return queue;
+}
+
+- (void) setQueue:(dispatch_queue_t)queue
+{
+    pthread_mutex_lock(&_lock);
+    _queue = queue;
+    pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger) pendingCount
+{
+    pthread_mutex_lock(&_lock);
+    NSUInteger count = _pendingCount;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+- (void) setHighWatermark:(NSUInteger)highWatermark
+{
+    pthread_mutex_lock(&_lock);
+    _highWatermark = highWatermark;
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void) setLowWatermark:(NSUInteger)lowWatermark
+{
+    pthread_mutex_lock(&_lock);
+    _lowWatermark = lowWatermark;
+    pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger) conflatedCount
+{
+    pthread_mutex_lock(&_lock);
+    NSUInteger count = _conflatedCount;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+- (NSUInteger) conflatedCountForCounterKey:(NSString *)counterKey
+{
+    pthread_mutex_lock(&_lock);
+    NSUInteger count = [_conflatedCounts[counterKey] unsignedIntegerValue];
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+- (void) countConflationForCounterKey:(NSString *)counterKey
+{
+    pthread_mutex_lock(&_lock);
+    _conflatedCount++;
+    _conflatedCounts[counterKey] = @([_conflatedCounts[counterKey] unsignedIntegerValue] + 1);
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void) resetCounters
+{
+    pthread_mutex_lock(&_lock);
+    _conflatedCount = 0;
+    [_conflatedCounts removeAllObjects];
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void) resetThrottle
+{
+    pthread_mutex_lock(&_lock);
+    _throttled = NO;
+    pthread_mutex_unlock(&_lock);
+}
+
+@end
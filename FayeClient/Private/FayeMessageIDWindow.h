@@ -0,0 +1,48 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessageIDWindow.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+/*
+ Fixed-memory record of the last `horizon` message keys seen, for dropping
+ duplicates.  Keys are reduced to 64-bit hashes kept in a ring buffer (for
+ eviction order) and an open-addressed hash set (for lookup), so every check
+ costs the same no matter how full the window is.  Not thread-safe.
+ */
+
+@interface FayeMessageIDWindow : NSObject
+@property (nonatomic, readonly) NSUInteger horizon;
+
+- (id) initWithHorizon: (NSUInteger) horizon;
+
+// Returns YES and records the key if it hasn't been seen within the horizon;
+// returns NO if it's a duplicate.
+- (BOOL) recordChannel: (NSString*) channel messageID: (NSString*) messageID extra: (NSString*) extra;
+- (void) removeAllKeys;
+
+@end
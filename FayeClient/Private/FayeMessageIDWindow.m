@@ -0,0 +1,187 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessageIDWindow.m
+//  FayeObjC
+//
+
+#import "FayeMessageIDWindow.h"
+
+#pragma mark - Hash Set
+
+typedef struct {
+    uint64_t *ring;
+    uint64_t *slots;
+    size_t capacity;
+    size_t ringStart;
+    size_t ringCount;
+    size_t slotMask;
+} FayeIDWindow;
+
+static void FayeIDWindowInit(FayeIDWindow *window, size_t capacity)
+{
+    size_t slotCount = 16;
+    // Keep the load factor at or below 50% so probe sequences stay short.
+    while (slotCount < capacity * 2) {
+        slotCount <<= 1;
+    }
+    window->ring = calloc(capacity, sizeof(uint64_t));
+    window->slots = calloc(slotCount, sizeof(uint64_t));
+    window->capacity = capacity;
+    window->ringStart = 0;
+    window->ringCount = 0;
+    window->slotMask = slotCount - 1;
+}
+
+static void FayeIDWindowFree(FayeIDWindow *window)
+{
+    free(window->ring);
+    free(window->slots);
+    window->ring = NULL;
+    window->slots = NULL;
+}
+
+static void FayeIDWindowClear(FayeIDWindow *window)
+{
+    memset(window->slots, 0, (window->slotMask + 1) * sizeof(uint64_t));
+    window->ringStart = 0;
+    window->ringCount = 0;
+}
+
+// Zero marks an empty slot, so it can't be a key.
+static inline uint64_t FayeIDWindowNormalise(uint64_t hash)
+{
+    return hash == 0 ? 1 : hash;
+}
+
+static inline size_t FayeIDWindowFind(const FayeIDWindow *window, uint64_t hash)
+{
+    size_t index = (size_t)(hash ^ (hash >> 32)) & window->slotMask;
+    while (window->slots[index] != 0 && window->slots[index] != hash) {
+        index = (index + 1) & window->slotMask;
+    }
+    return index;
+}
+
+// Backward-shift deletion: no tombstones, so lookups never degrade over time.
+static void FayeIDWindowRemoveSlot(FayeIDWindow *window, size_t index)
+{
+    size_t hole = index;
+    size_t next = (index + 1) & window->slotMask;
+    while (window->slots[next] != 0) {
+        uint64_t hash = window->slots[next];
+        size_t home = (size_t)(hash ^ (hash >> 32)) & window->slotMask;
+        // Move the entry into the hole unless its home lies cyclically in (hole, next].
+        BOOL stays = (hole <= next) ? (home > hole && home <= next) : (home > hole || home <= next);
+        if (!stays) {
+            window->slots[hole] = hash;
+            hole = next;
+        }
+        next = (next + 1) & window->slotMask;
+    }
+    window->slots[hole] = 0;
+}
+
+static BOOL FayeIDWindowInsert(FayeIDWindow *window, uint64_t hash)
+{
+    hash = FayeIDWindowNormalise(hash);
+    size_t index = FayeIDWindowFind(window, hash);
+    if (window->slots[index] == hash) {
+        return NO;
+    }
+    if (window->ringCount == window->capacity) {
+        uint64_t oldest = window->ring[window->ringStart];
+        FayeIDWindowRemoveSlot(window, FayeIDWindowFind(window, oldest));
+        window->ringStart = (window->ringStart + 1) % window->capacity;
+        window->ringCount--;
+        // The removal may have shifted our empty slot.
+        index = FayeIDWindowFind(window, hash);
+    }
+    window->slots[index] = hash;
+    window->ring[(window->ringStart + window->ringCount) % window->capacity] = hash;
+    window->ringCount++;
+    return YES;
+}
+
+#pragma mark - Hashing
+
+static const uint64_t FayeFNVOffsetBasis = 14695981039346656037ULL;
+static const uint64_t FayeFNVPrime = 1099511628211ULL;
+
+static uint64_t FayeHashString(uint64_t hash, NSString *string)
+{
+    // Hash UTF-16 code units straight out of the string, in stack-sized pieces,
+    // so nothing gets allocated per message.
+    unichar buffer[64];
+    NSUInteger length = string.length;
+    for (NSUInteger offset = 0; offset < length; offset += 64) {
+        NSUInteger count = MIN((NSUInteger) 64, length - offset);
+        [string getCharacters: buffer range: NSMakeRange(offset, count)];
+        for (NSUInteger i = 0; i < count; i++) {
+            hash = (hash ^ (buffer[i] & 0xff)) * FayeFNVPrime;
+            hash = (hash ^ (buffer[i] >> 8)) * FayeFNVPrime;
+        }
+    }
+    // Separator, so ("ab", "c") and ("a", "bc") differ.
+    hash = (hash ^ 0xff) * FayeFNVPrime;
+    return hash;
+}
+
+@implementation FayeMessageIDWindow {
+    FayeIDWindow _window;
+}
+
+- (id) initWithHorizon:(NSUInteger)horizon
+{
+    NSParameterAssert(horizon > 0);
+    self = [super init];
+    if (self) {
+        _horizon = horizon;
+        FayeIDWindowInit(&_window, horizon);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    FayeIDWindowFree(&_window);
+}
+
+- (BOOL) recordChannel:(NSString *)channel messageID:(NSString *)messageID extra:(NSString *)extra
+{
+    uint64_t hash = FayeFNVOffsetBasis;
+    hash = FayeHashString(hash, channel);
+    hash = FayeHashString(hash, messageID);
+    if (extra != nil) {
+        hash = FayeHashString(hash, extra);
+    }
+    return FayeIDWindowInsert(&_window, hash);
+}
+
+- (void) removeAllKeys
+{
+    FayeIDWindowClear(&_window);
+}
+
+@end
@@ -0,0 +1,48 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessagePack.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+/*
+ Minimal MessagePack codec for Bayeux payloads.  Supports the subset of types
+ that NSJSONSerialization produces (plus NSData, which maps to the bin family),
+ so messages can round-trip through either encoding unchanged.
+ */
+
+@interface FayeMessagePack : NSObject
+
++ (NSData*) dataWithObject: (id) object error: (NSError**) error;
++ (id) objectWithData: (NSData*) data error: (NSError**) error;
+// An array whose elements are already encoded, so a batch can be split into
+// frames without encoding its messages twice.
++ (NSData*) arrayDataWithEncodedElements: (NSArray*) elements;
+
+// Cheap sniff used to tell MessagePack frames apart from JSON ones.
++ (BOOL) dataLooksLikeMessagePack: (NSData*) data;
+
+@end
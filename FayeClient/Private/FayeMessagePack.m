@@ -0,0 +1,362 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessagePack.m
+//  FayeObjC
+//
+
+#import "FayeMessagePack.h"
+#import "FayeClient.h"
+
+// Anything deeper than this is almost certainly garbage (or hostile).
+static const NSUInteger FayeMessagePackMaximumDepth = 128;
+
+static NSError *FayeMessagePackError(NSString *description)
+{
+    return [NSError errorWithDomain: kFayeErrorDomain
+                               code: 0
+                           userInfo: @{ NSLocalizedDescriptionKey: description }];
+}
+
+#pragma mark - Encoding
+
+static void FayeMessagePackWriteByte(NSMutableData *buffer, uint8_t byte)
+{
+    [buffer appendBytes: &byte length: 1];
+}
+
+static void FayeMessagePackWriteBigEndian(NSMutableData *buffer, uint8_t type, uint64_t value, NSUInteger width)
+{
+    uint8_t bytes[9];
+    bytes[0] = type;
+    for (NSUInteger i = 0; i < width; i++) {
+        bytes[width - i] = (uint8_t)(value >> (8 * i));
+    }
+    [buffer appendBytes: bytes length: width + 1];
+}
+
+static void FayeMessagePackWriteLength(NSMutableData *buffer, NSUInteger length,
+                                       uint8_t fixBase, NSUInteger fixMax,
+                                       uint8_t type8, uint8_t type16, uint8_t type32)
+{
+    // A fixBase of zero means the family has no fix form (bin), even for
+    // length zero.
+    if (fixBase != 0 && length <= fixMax) {
+        FayeMessagePackWriteByte(buffer, fixBase | (uint8_t) length);
+    } else if (type8 != 0 && length <= UINT8_MAX) {
+        FayeMessagePackWriteBigEndian(buffer, type8, length, 1);
+    } else if (length <= UINT16_MAX) {
+        FayeMessagePackWriteBigEndian(buffer, type16, length, 2);
+    } else {
+        FayeMessagePackWriteBigEndian(buffer, type32, length, 4);
+    }
+}
+
+static void FayeMessagePackWriteInteger(NSMutableData *buffer, long long value)
+{
+    if (value >= 0) {
+        if (value <= 0x7f) {
+            FayeMessagePackWriteByte(buffer, (uint8_t) value);
+        } else if (value <= UINT8_MAX) {
+            FayeMessagePackWriteBigEndian(buffer, 0xcc, value, 1);
+        } else if (value <= UINT16_MAX) {
+            FayeMessagePackWriteBigEndian(buffer, 0xcd, value, 2);
+        } else if (value <= UINT32_MAX) {
+            FayeMessagePackWriteBigEndian(buffer, 0xce, value, 4);
+        } else {
+            FayeMessagePackWriteBigEndian(buffer, 0xcf, value, 8);
+        }
+    } else {
+        if (value >= -32) {
+            FayeMessagePackWriteByte(buffer, (uint8_t)(int8_t) value);
+        } else if (value >= INT8_MIN) {
+            FayeMessagePackWriteBigEndian(buffer, 0xd0, (uint8_t)(int8_t) value, 1);
+        } else if (value >= INT16_MIN) {
+            FayeMessagePackWriteBigEndian(buffer, 0xd1, (uint16_t)(int16_t) value, 2);
+        } else if (value >= INT32_MIN) {
+            FayeMessagePackWriteBigEndian(buffer, 0xd2, (uint32_t)(int32_t) value, 4);
+        } else {
+            FayeMessagePackWriteBigEndian(buffer, 0xd3, (uint64_t) value, 8);
+        }
+    }
+}
+
+static BOOL FayeMessagePackWriteObject(NSMutableData *buffer, id object, NSUInteger depth, NSError **error)
+{
+    if (depth > FayeMessagePackMaximumDepth) {
+        if (error) *error = FayeMessagePackError(@"MessagePack: object nested too deeply.");
+        return NO;
+    }
+    if (object == nil || object == [NSNull null]) {
+        FayeMessagePackWriteByte(buffer, 0xc0);
+    } else if ([object isKindOfClass: [NSString class]]) {
+        NSString *string = object;
+        NSUInteger length = [string lengthOfBytesUsingEncoding: NSUTF8StringEncoding];
+        FayeMessagePackWriteLength(buffer, length, 0xa0, 31, 0xd9, 0xda, 0xdb);
+        NSUInteger offset = buffer.length;
+        [buffer increaseLengthBy: length];
+        [string getBytes: (uint8_t*) buffer.mutableBytes + offset
+               maxLength: length
+              usedLength: NULL
+                encoding: NSUTF8StringEncoding
+                 options: 0
+                   range: NSMakeRange(0, string.length)
+          remainingRange: NULL];
+    } else if ([object isKindOfClass: [NSNumber class]]) {
+        NSNumber *number = object;
+        if (CFGetTypeID((__bridge CFTypeRef) number) == CFBooleanGetTypeID()) {
+            FayeMessagePackWriteByte(buffer, number.boolValue ? 0xc3 : 0xc2);
+        } else {
+            const char *type = number.objCType;
+            if (type[0] == 'f' || type[0] == 'd') {
+                double value = number.doubleValue;
+                uint64_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                FayeMessagePackWriteBigEndian(buffer, 0xcb, bits, 8);
+            } else if (type[0] == 'Q' && number.unsignedLongLongValue > LLONG_MAX) {
+                FayeMessagePackWriteBigEndian(buffer, 0xcf, number.unsignedLongLongValue, 8);
+            } else {
+                FayeMessagePackWriteInteger(buffer, number.longLongValue);
+            }
+        }
+    } else if ([object isKindOfClass: [NSArray class]]) {
+        NSArray *array = object;
+        FayeMessagePackWriteLength(buffer, array.count, 0x90, 15, 0, 0xdc, 0xdd);
+        for (id element in array) {
+            if (!FayeMessagePackWriteObject(buffer, element, depth + 1, error)) {
+                return NO;
+            }
+        }
+    } else if ([object isKindOfClass: [NSDictionary class]]) {
+        NSDictionary *dictionary = object;
+        FayeMessagePackWriteLength(buffer, dictionary.count, 0x80, 15, 0, 0xde, 0xdf);
+        __block BOOL success = YES;
+        [dictionary enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            if (!FayeMessagePackWriteObject(buffer, key, depth + 1, error) ||
+                !FayeMessagePackWriteObject(buffer, value, depth + 1, error)) {
+                success = NO;
+                *stop = YES;
+            }
+        }];
+        return success;
+    } else if ([object isKindOfClass: [NSData class]]) {
+        NSData *data = object;
+        FayeMessagePackWriteLength(buffer, data.length, 0, 0, 0xc4, 0xc5, 0xc6);
+        [buffer appendData: data];
+    } else {
+        if (error) *error = FayeMessagePackError([NSString stringWithFormat: @"MessagePack: cannot encode object of class %@.", [object class]]);
+        return NO;
+    }
+    return YES;
+}
+
+#pragma mark - Decoding
+
+typedef struct {
+    const uint8_t *bytes;
+    NSUInteger length;
+    NSUInteger offset;
+} FayeMessagePackReader;
+
+static BOOL FayeMessagePackReadBigEndian(FayeMessagePackReader *reader, NSUInteger width, uint64_t *value)
+{
+    if (reader->length - reader->offset < width) {
+        return NO;
+    }
+    uint64_t result = 0;
+    for (NSUInteger i = 0; i < width; i++) {
+        result = (result << 8) | reader->bytes[reader->offset + i];
+    }
+    reader->offset += width;
+    *value = result;
+    return YES;
+}
+
+static id FayeMessagePackReadObject(FayeMessagePackReader *reader, NSUInteger depth);
+
+static id FayeMessagePackReadString(FayeMessagePackReader *reader, uint64_t length)
+{
+    if (reader->length - reader->offset < length) {
+        return nil;
+    }
+    NSString *string = [[NSString alloc] initWithBytes: reader->bytes + reader->offset
+                                                length: (NSUInteger) length
+                                              encoding: NSUTF8StringEncoding];
+    reader->offset += (NSUInteger) length;
+    return string;
+}
+
+static id FayeMessagePackReadBinary(FayeMessagePackReader *reader, uint64_t length)
+{
+    if (reader->length - reader->offset < length) {
+        return nil;
+    }
+    NSData *data = [NSData dataWithBytes: reader->bytes + reader->offset length: (NSUInteger) length];
+    reader->offset += (NSUInteger) length;
+    return data;
+}
+
+static id FayeMessagePackReadArray(FayeMessagePackReader *reader, uint64_t count, NSUInteger depth)
+{
+    // Every element takes at least one byte, so a bogus count can't make us over-allocate.
+    if (reader->length - reader->offset < count) {
+        return nil;
+    }
+    NSMutableArray *array = [NSMutableArray arrayWithCapacity: (NSUInteger) count];
+    for (uint64_t i = 0; i < count; i++) {
+        id element = FayeMessagePackReadObject(reader, depth + 1);
+        if (element == nil) {
+            return nil;
+        }
+        [array addObject: element];
+    }
+    return array;
+}
+
+static id FayeMessagePackReadMap(FayeMessagePackReader *reader, uint64_t count, NSUInteger depth)
+{
+    if ((reader->length - reader->offset) / 2 < count) {
+        return nil;
+    }
+    NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity: (NSUInteger) count];
+    for (uint64_t i = 0; i < count; i++) {
+        id key = FayeMessagePackReadObject(reader, depth + 1);
+        id value = FayeMessagePackReadObject(reader, depth + 1);
+        if (key == nil || value == nil || ![key conformsToProtocol: @protocol(NSCopying)]) {
+            return nil;
+        }
+        dictionary[key] = value;
+    }
+    return dictionary;
+}
+
+static id FayeMessagePackReadObject(FayeMessagePackReader *reader, NSUInteger depth)
+{
+    if (depth > FayeMessagePackMaximumDepth || reader->offset >= reader->length) {
+        return nil;
+    }
+    uint8_t type = reader->bytes[reader->offset++];
+    uint64_t value = 0;
+    
+    if (type <= 0x7f) {
+        return @(type);
+    } else if (type >= 0xe0) {
+        return @((int8_t) type);
+    } else if ((type & 0xf0) == 0x80) {
+        return FayeMessagePackReadMap(reader, type & 0x0f, depth);
+    } else if ((type & 0xf0) == 0x90) {
+        return FayeMessagePackReadArray(reader, type & 0x0f, depth);
+    } else if ((type & 0xe0) == 0xa0) {
+        return FayeMessagePackReadString(reader, type & 0x1f);
+    }
+    
+    switch (type) {
+        case 0xc0: return [NSNull null];
+        case 0xc2: return @NO;
+        case 0xc3: return @YES;
+        case 0xc4: return FayeMessagePackReadBigEndian(reader, 1, &value) ? FayeMessagePackReadBinary(reader, value) : nil;
+        case 0xc5: return FayeMessagePackReadBigEndian(reader, 2, &value) ? FayeMessagePackReadBinary(reader, value) : nil;
+        case 0xc6: return FayeMessagePackReadBigEndian(reader, 4, &value) ? FayeMessagePackReadBinary(reader, value) : nil;
+        case 0xca: {
+            if (!FayeMessagePackReadBigEndian(reader, 4, &value)) return nil;
+            uint32_t bits = (uint32_t) value;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            return @(f);
+        }
+        case 0xcb: {
+            if (!FayeMessagePackReadBigEndian(reader, 8, &value)) return nil;
+            double d;
+            memcpy(&d, &value, sizeof(d));
+            return @(d);
+        }
+        case 0xcc: return FayeMessagePackReadBigEndian(reader, 1, &value) ? @((uint8_t) value) : nil;
+        case 0xcd: return FayeMessagePackReadBigEndian(reader, 2, &value) ? @((uint16_t) value) : nil;
+        case 0xce: return FayeMessagePackReadBigEndian(reader, 4, &value) ? @((uint32_t) value) : nil;
+        case 0xcf: return FayeMessagePackReadBigEndian(reader, 8, &value) ? @((unsigned long long) value) : nil;
+        case 0xd0: return FayeMessagePackReadBigEndian(reader, 1, &value) ? @((int8_t) value) : nil;
+        case 0xd1: return FayeMessagePackReadBigEndian(reader, 2, &value) ? @((int16_t) value) : nil;
+        case 0xd2: return FayeMessagePackReadBigEndian(reader, 4, &value) ? @((int32_t) value) : nil;
+        case 0xd3: return FayeMessagePackReadBigEndian(reader, 8, &value) ? @((long long) value) : nil;
+        case 0xd9: return FayeMessagePackReadBigEndian(reader, 1, &value) ? FayeMessagePackReadString(reader, value) : nil;
+        case 0xda: return FayeMessagePackReadBigEndian(reader, 2, &value) ? FayeMessagePackReadString(reader, value) : nil;
+        case 0xdb: return FayeMessagePackReadBigEndian(reader, 4, &value) ? FayeMessagePackReadString(reader, value) : nil;
+        case 0xdc: return FayeMessagePackReadBigEndian(reader, 2, &value) ? FayeMessagePackReadArray(reader, value, depth) : nil;
+        case 0xdd: return FayeMessagePackReadBigEndian(reader, 4, &value) ? FayeMessagePackReadArray(reader, value, depth) : nil;
+        case 0xde: return FayeMessagePackReadBigEndian(reader, 2, &value) ? FayeMessagePackReadMap(reader, value, depth) : nil;
+        case 0xdf: return FayeMessagePackReadBigEndian(reader, 4, &value) ? FayeMessagePackReadMap(reader, value, depth) : nil;
+        default:
+            // Extension types (and the reserved 0xc1) have no meaning in Bayeux.
+            return nil;
+    }
+}
+
+@implementation FayeMessagePack
+
++ (NSData*) dataWithObject:(id)object error:(NSError **)error
+{
+    NSMutableData *buffer = [NSMutableData dataWithCapacity: 256];
+    if (!FayeMessagePackWriteObject(buffer, object, 0, error)) {
+        return nil;
+    }
+    return buffer;
+}
+
++ (NSData*) arrayDataWithEncodedElements:(NSArray *)elements
+{
+    NSUInteger length = 5;
+    for (NSData *element in elements) {
+        length += element.length;
+    }
+    NSMutableData *buffer = [NSMutableData dataWithCapacity: length];
+    FayeMessagePackWriteLength(buffer, elements.count, 0x90, 15, 0, 0xdc, 0xdd);
+    for (NSData *element in elements) {
+        [buffer appendData: element];
+    }
+    return buffer;
+}
+
++ (id) objectWithData:(NSData *)data error:(NSError **)error
+{
+    FayeMessagePackReader reader = { data.bytes, data.length, 0 };
+    id object = FayeMessagePackReadObject(&reader, 0);
+    if (object == nil || reader.offset != reader.length) {
+        if (error) *error = FayeMessagePackError(@"MessagePack: malformed or truncated data.");
+        return nil;
+    }
+    return object;
+}
+
++ (BOOL) dataLooksLikeMessagePack:(NSData *)data
+{
+    if (data.length == 0) {
+        return NO;
+    }
+    // Bayeux batches are always arrays.  A JSON array starts with '[' (possibly
+    // after whitespace), which isn't a valid MessagePack array header.
+    uint8_t first = ((const uint8_t*) data.bytes)[0];
+    return (first & 0xf0) == 0x90 || first == 0xdc || first == 0xdd;
+}
+
+@end
@@ -0,0 +1,45 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessagePool.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+@class FayeMessage;
+
+/*
+ A handful of spare FayeMessages for the receive loop to reuse, so a big
+ batch doesn't mean a big pile of short-lived message objects.  Messages that
+ are kept past the loop (`retained`) are left alone.  Not thread-safe.
+ */
+
+@interface FayeMessagePool : NSObject
+
+- (id) initWithCapacity: (NSUInteger) capacity;
+- (FayeMessage*) messageWithDict: (NSDictionary*) dict;
+- (void) recycleMessage: (FayeMessage*) message;
+
+@end
@@ -0,0 +1,67 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeMessagePool.m
+//  FayeObjC
+//
+
+#import "FayeMessagePool.h"
+#import "FayeMessage.h"
+
+@implementation FayeMessagePool {
+    NSMutableArray *_spares;
+    NSUInteger _capacity;
+}
+
+- (id) initWithCapacity:(NSUInteger)capacity
+{
+    self = [super init];
+    if (self) {
+        _capacity = capacity;
+        _spares = [NSMutableArray arrayWithCapacity: capacity];
+    }
+    return self;
+}
+
+- (FayeMessage*) messageWithDict:(NSDictionary *)dict
+{
+    FayeMessage *message = [_spares lastObject];
+    if (message == nil) {
+        return [[FayeMessage alloc] initWithDict: dict];
+    }
+    [_spares removeLastObject];
+    [message setPropertiesWithDict: dict];
+    return message;
+}
+
+- (void) recycleMessage:(FayeMessage *)message
+{
+    if (message.retained || _spares.count >= _capacity) {
+        return;
+    }
+    [message reset];
+    [_spares addObject: message];
+}
+
+@end
@@ -0,0 +1,60 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeRequestTable.h
+//  FayeObjC
+//
+
+
+#import <Foundation/Foundation.h>
+
+typedef void(^FayeRequestTableStartHandler)(NSString *correlationID);
+typedef void(^FayeRequestTableCompletionHandler)(NSDictionary *response, NSError *error);
+
+/*
+ The requests a client is waiting on replies to, by correlation id.  At most
+ `concurrencyLimit` are in flight at once (zero means no limit) and the rest
+ wait their turn in order.  Every request has a deadline, counted from when it
+ was added, and fails with a timeout error once it passes, waiting or not.
+ Not thread-safe: use it on the queue it was created with, where its deadline
+ timer also fires.
+ */
+
+@interface FayeRequestTable : NSObject
+@property (nonatomic, assign) NSUInteger concurrencyLimit;
+// Nothing starts while suspended, though deadlines still run.
+@property (nonatomic, assign, getter=isSuspended) BOOL suspended;
+
+- (id) initWithQueue: (dispatch_queue_t) queue;
+
+// `start` is called, once, when the request may be sent.
+- (void) addRequestWithTimeout: (NSTimeInterval) timeout
+                  startHandler: (FayeRequestTableStartHandler) start
+             completionHandler: (FayeRequestTableCompletionHandler) completion;
+// Returns NO for late or unknown replies.
+- (BOOL) completeRequest: (NSString*) correlationID
+            withResponse: (NSDictionary*) response
+                   error: (NSError*) error;
+
+@end
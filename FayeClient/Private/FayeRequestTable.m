@@ -0,0 +1,170 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeRequestTable.m
+//  FayeObjC
+//
+
+
+#import "FayeRequestTable.h"
+#import "FayeClient.h"
+
+@interface FayeRequest : NSObject
+@property (nonatomic, copy) NSString *correlationID;
+@property (nonatomic, assign) CFAbsoluteTime deadline;
+@property (nonatomic, copy) FayeRequestTableStartHandler startHandler;
+@property (nonatomic, copy) FayeRequestTableCompletionHandler completionHandler;
+@end
+
+@implementation FayeRequest
+@end
+
+@implementation FayeRequestTable {
+    dispatch_source_t _timer;
+    NSMutableDictionary *_inFlight;
+    NSMutableArray *_waiting;
+    unsigned long long _lastID;
+}
+
+- (id) initWithQueue:(dispatch_queue_t)queue
+{
+    self = [super init];
+    if (self) {
+        _inFlight = [NSMutableDictionary new];
+        _waiting = [NSMutableArray new];
+        _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+        __weak FayeRequestTable *weakSelf = self;
+        dispatch_source_set_event_handler(_timer, ^{
+            [weakSelf expireRequests];
+        });
+        dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(_timer);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    dispatch_source_cancel(_timer);
+}
+
+- (void) setConcurrencyLimit:(NSUInteger)concurrencyLimit
+{
+    _concurrencyLimit = concurrencyLimit;
+    [self startWaitingRequests];
+}
+
+- (void) setSuspended:(BOOL)suspended
+{
+    _suspended = suspended;
+    [self startWaitingRequests];
+}
+
+- (void) addRequestWithTimeout:(NSTimeInterval)timeout
+                  startHandler:(FayeRequestTableStartHandler)start
+             completionHandler:(FayeRequestTableCompletionHandler)completion
+{
+    FayeRequest *request = [FayeRequest new];
+    request.correlationID = [NSString stringWithFormat: @"%llx", ++_lastID];
+    request.deadline = CFAbsoluteTimeGetCurrent() + timeout;
+    request.startHandler = start;
+    request.completionHandler = completion;
+    [_waiting addObject: request];
+    [self startWaitingRequests];
+    [self scheduleTimer];
+}
+
+- (BOOL) completeRequest:(NSString *)correlationID withResponse:(NSDictionary *)response error:(NSError *)error
+{
+    FayeRequest *request = _inFlight[correlationID];
+    if (request == nil) {
+        return NO;
+    }
+    [_inFlight removeObjectForKey: correlationID];
+    request.completionHandler(response, error);
+    [self startWaitingRequests];
+    [self scheduleTimer];
+    return YES;
+}
+
+- (void) startWaitingRequests
+{
+    while (!_suspended && _waiting.count > 0 &&
+           (_concurrencyLimit == 0 || _inFlight.count < _concurrencyLimit))
+    {
+        FayeRequest *request = _waiting[0];
+        [_waiting removeObjectAtIndex: 0];
+        _inFlight[request.correlationID] = request;
+        FayeRequestTableStartHandler start = request.startHandler;
+        request.startHandler = nil;
+        start(request.correlationID);
+    }
+}
+
+- (void) expireRequests
+{
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    NSMutableArray *expired = [NSMutableArray new];
+    for (FayeRequest *request in _inFlight.allValues) {
+        if (request.deadline <= now) {
+            [expired addObject: request];
+            [_inFlight removeObjectForKey: request.correlationID];
+        }
+    }
+    NSIndexSet *expiredWaiting = [_waiting indexesOfObjectsPassingTest:^BOOL(FayeRequest *request, NSUInteger idx, BOOL *stop) {
+        return request.deadline <= now;
+    }];
+    [expired addObjectsFromArray: [_waiting objectsAtIndexes: expiredWaiting]];
+    [_waiting removeObjectsAtIndexes: expiredWaiting];
+    
+    NSError *error = [NSError errorWithDomain: kFayeErrorDomain
+                                         code: 0
+                                     userInfo: @{ NSLocalizedDescriptionKey: @"The request timed out." }];
+    for (FayeRequest *request in expired) {
+        request.completionHandler(nil, error);
+    }
+    [self startWaitingRequests];
+    [self scheduleTimer];
+}
+
+// One timer, for the earliest deadline.
+- (void) scheduleTimer
+{
+    CFAbsoluteTime deadline = DBL_MAX;
+    for (FayeRequest *request in _inFlight.allValues) {
+        deadline = MIN(deadline, request.deadline);
+    }
+    for (FayeRequest *request in _waiting) {
+        deadline = MIN(deadline, request.deadline);
+    }
+    if (deadline == DBL_MAX) {
+        dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        return;
+    }
+    NSTimeInterval delay = MAX(deadline - CFAbsoluteTimeGetCurrent(), 0);
+    dispatch_source_set_timer(_timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)),
+                              DISPATCH_TIME_FOREVER, (uint64_t)(0.01 * NSEC_PER_SEC));
+}
+
+@end
@@ -0,0 +1,59 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeSequenceTracker.h
+//  FayeObjC
+//
+
+#import <Foundation/Foundation.h>
+
+typedef void(^FayeSequenceTrackerFlushHandler)(NSArray *messages);
+
+/*
+ Puts messages carrying a per-channel sequence number (ext.seq) back in order.
+ Messages that arrive ahead of a gap are held until the gap is filled, either by
+ late live messages or by the replay a resubscribe brings back.  If the gap
+ can't be filled within the timeout (or too much piles up behind it) the held
+ messages are released anyway and the missing ones are counted as lost.
+ */
+
+@interface FayeSequenceTracker : NSObject
+@property (nonatomic, assign) NSUInteger reorderLimit;
+@property (nonatomic, assign) NSTimeInterval gapTimeout;
+@property (nonatomic, readonly) NSUInteger lostMessageCount;
+// Called on the tracker's queue with messages released by the gap timeout.
+@property (nonatomic, copy) FayeSequenceTrackerFlushHandler flushHandler;
+
+- (id) initWithQueue: (dispatch_queue_t) queue;
+
+// Returns the messages that are now deliverable, in order.  May be empty.
+- (NSArray*) messagesReadyAfterReceiving: (id) message
+                                sequence: (long long) sequence
+                               onChannel: (NSString*) channel;
+// Last contiguous sequence number seen for every channel the subscription
+// matches, suitable for a replay request.
+- (NSDictionary*) replayPositionsForSubscription: (NSString*) subscription;
+- (void) forgetSubscription: (NSString*) subscription;
+
+@end
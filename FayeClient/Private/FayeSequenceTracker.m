@@ -0,0 +1,196 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeSequenceTracker.m
+//  FayeObjC
+//
+
+#import "FayeSequenceTracker.h"
+#import "FayeChannel.h"
+#import <pthread.h>
+
+@interface FayeSequenceState : NSObject {
+@public
+    long long _lastSequence;
+    NSMutableDictionary *_pending;
+    CFAbsoluteTime _gapOpenedAt;
+}
+@end
+
+@implementation FayeSequenceState
+@end
+
+@implementation FayeSequenceTracker {
+    dispatch_queue_t _queue;
+    pthread_mutex_t _lock;
+    NSMutableDictionary *_states;
+}
+
+- (id) initWithQueue:(dispatch_queue_t)queue
+{
+    self = [super init];
+    if (self) {
+        _queue = queue;
+        pthread_mutex_init(&_lock, NULL);
+        _states = [NSMutableDictionary new];
+        _reorderLimit = 256;
+        _gapTimeout = 2.0;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark - Lock Held
+
+- (void) drainState: (FayeSequenceState*) state intoArray: (NSMutableArray*) ready
+{
+    id next = nil;
+    while ((next = state->_pending[@(state->_lastSequence + 1)]) != nil) {
+        [ready addObject: next];
+        [state->_pending removeObjectForKey: @(state->_lastSequence + 1)];
+        state->_lastSequence++;
+    }
+    state->_gapOpenedAt = state->_pending.count > 0 ? CFAbsoluteTimeGetCurrent() : 0;
+}
+
+// Stops waiting for the oldest gap: skips ahead to the first held message.
+- (void) abandonGapInState: (FayeSequenceState*) state intoArray: (NSMutableArray*) ready
+{
+    long long first = LLONG_MAX;
+    for (NSNumber *sequence in state->_pending) {
+        first = MIN(first, sequence.longLongValue);
+    }
+    if (first == LLONG_MAX) {
+        return;
+    }
+    _lostMessageCount += (NSUInteger)(first - state->_lastSequence - 1);
+    state->_lastSequence = first - 1;
+    [self drainState: state intoArray: ready];
+}
+
+- (void) scheduleGapTimerForChannel: (NSString*) channel
+{
+    __weak FayeSequenceTracker *weakSelf = self;
+    dispatch_time_t when = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_gapTimeout * NSEC_PER_SEC));
+    dispatch_after(when, _queue, ^{
+        [weakSelf gapTimerFiredForChannel: channel];
+    });
+}
+
+#pragma mark - Public
+
+- (NSArray*) messagesReadyAfterReceiving:(id)message
+                                sequence:(long long)sequence
+                               onChannel:(NSString *)channel
+{
+    NSMutableArray *ready = [NSMutableArray new];
+    pthread_mutex_lock(&_lock);
+    FayeSequenceState *state = _states[channel];
+    if (state == nil) {
+        // First message we've seen here, nothing to compare it to.
+        state = [FayeSequenceState new];
+        state->_lastSequence = sequence;
+        state->_pending = [NSMutableDictionary new];
+        _states[channel] = state;
+        [ready addObject: message];
+    } else if (sequence <= state->_lastSequence || state->_pending[@(sequence)] != nil) {
+        // Already delivered (or already held): a replay overlapping live traffic.
+    } else if (sequence == state->_lastSequence + 1) {
+        [ready addObject: message];
+        state->_lastSequence = sequence;
+        [self drainState: state intoArray: ready];
+    } else {
+        BOOL gapWasOpen = state->_pending.count > 0;
+        state->_pending[@(sequence)] = message;
+        if (!gapWasOpen) {
+            state->_gapOpenedAt = CFAbsoluteTimeGetCurrent();
+            [self scheduleGapTimerForChannel: channel];
+        }
+        if (state->_pending.count > _reorderLimit) {
+            [self abandonGapInState: state intoArray: ready];
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+    return ready;
+}
+
+- (void) gapTimerFiredForChannel: (NSString*) channel
+{
+    NSMutableArray *ready = [NSMutableArray new];
+    BOOL reschedule = NO;
+    pthread_mutex_lock(&_lock);
+    FayeSequenceState *state = _states[channel];
+    if (state != nil && state->_pending.count > 0) {
+        // The gap may have been filled and a new one opened since we were scheduled.
+        if (CFAbsoluteTimeGetCurrent() - state->_gapOpenedAt >= _gapTimeout * 0.9) {
+            [self abandonGapInState: state intoArray: ready];
+        }
+        reschedule = state->_pending.count > 0;
+    }
+    if (reschedule) {
+        [self scheduleGapTimerForChannel: channel];
+    }
+    pthread_mutex_unlock(&_lock);
+    if (ready.count > 0 && self.flushHandler != NULL) {
+        self.flushHandler(ready);
+    }
+}
+
+- (NSDictionary*) replayPositionsForSubscription:(NSString *)subscription
+{
+    NSMutableDictionary *positions = [NSMutableDictionary new];
+    pthread_mutex_lock(&_lock);
+    [_states enumerateKeysAndObjectsUsingBlock:^(NSString *channel, FayeSequenceState *state, BOOL *stop) {
+        if ([FayeChannel subscription: subscription matchesChannel: channel]) {
+            positions[channel] = @(state->_lastSequence);
+        }
+    }];
+    pthread_mutex_unlock(&_lock);
+    return positions.copy;
+}
+
+- (void) forgetSubscription:(NSString *)subscription
+{
+    pthread_mutex_lock(&_lock);
+    for (NSString *channel in _states.allKeys) {
+        if ([FayeChannel subscription: subscription matchesChannel: channel]) {
+            [_states removeObjectForKey: channel];
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger) lostMessageCount
+{
+    pthread_mutex_lock(&_lock);
+    NSUInteger count = _lostMessageCount;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+@end
@@ -7,6 +7,8 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "FayeClient.h"
+#import "FayeChannelStatusTable.h"
 
 typedef NS_ENUM(NSInteger, FayeServerConnectionType) {
     FayeServerConnectionTypeSecureWebSocket,
@@ -21,9 +23,18 @@ typedef NS_ENUM(NSInteger, FayeServerConnectionType) {
 @property (nonatomic, assign) NSInteger failures;
 @property (nonatomic, copy) NSDictionary *extension;
 @property (nonatomic, assign) NSInteger sortIndex;
-@property (nonatomic, strong) NSMutableDictionary *channelStatus;
+@property (nonatomic, readonly) FayeChannelStatusTable *channelStatus;
 @property (nonatomic, strong) NSString *clientID;
 @property (nonatomic, copy) NSDictionary *advice;
+// Negotiated during the handshake; always JSON until the server says otherwise.
+@property (nonatomic, assign) FayeClientMessageEncoding messageEncoding;
+// HTTP servers only: messages arrive on an EventSource stream rather than in
+// /meta/connect responses.  Also negotiated during the handshake.
+@property (nonatomic, assign) BOOL streamsWithEventSource;
+// Smoothed WebSocket ping round-trip time and its mean deviation, kept the
+// way TCP keeps its RTO estimate.  Zero until the first sample.
+@property (nonatomic, readonly) NSTimeInterval roundTripTime;
+@property (nonatomic, readonly) NSTimeInterval roundTripTimeVariation;
 
 + (instancetype) fayeServerWithURL: (NSURL*) url;
 
@@ -32,6 +43,17 @@ typedef NS_ENUM(NSInteger, FayeServerConnectionType) {
 - (BOOL) connectsWithWebSockets;
 - (BOOL) connectsWithLongPolling;
 
+- (void) addRoundTripTimeSample: (NSTimeInterval) sample;
+// How long to wait for a pong: the smoothed RTT plus four deviations, clamped
+// to the given bounds.  The maximum until there's a sample to go on.
+- (NSTimeInterval) heartbeatDeadlineWithMinimum: (NSTimeInterval) minimum
+                                        maximum: (NSTimeInterval) maximum;
+
+// Property-list snapshot of what's worth keeping across launches: health,
+// advice, client ID and the channels the server has us subscribed to.
+- (NSDictionary*) sessionState;
+- (void) restoreSessionState: (NSDictionary*) state;
+
 - (NSString*) reconnectAdvice;
 - (NSTimeInterval) intervalAdvice;
 - (NSTimeInterval) timeoutAdvice;
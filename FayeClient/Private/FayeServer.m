@@ -15,7 +15,7 @@
     self = [super init];
     if (self) {
         self.extension = @{};
-        self.channelStatus = [NSMutableDictionary new];
+        _channelStatus = [FayeChannelStatusTable new];
         self.advice = @{ @"reconnect": @"retry",
                          @"interval": @0,
                          @"timeout": @60000};
@@ -66,6 +66,66 @@
     return _connectionType == FayeServerConnectionTypeWebSocket || _connectionType == FayeServerConnectionTypeSecureWebSocket;
 }
 
+- (void) addRoundTripTimeSample:(NSTimeInterval)sample
+{
+    if (_roundTripTime == 0) {
+        _roundTripTime = sample;
+        _roundTripTimeVariation = sample / 2;
+    } else {
+        _roundTripTimeVariation = 0.75 * _roundTripTimeVariation + 0.25 * fabs(_roundTripTime - sample);
+        _roundTripTime = 0.875 * _roundTripTime + 0.125 * sample;
+    }
+}
+
+- (NSTimeInterval) heartbeatDeadlineWithMinimum:(NSTimeInterval)minimum maximum:(NSTimeInterval)maximum
+{
+    if (_roundTripTime == 0) {
+        return maximum;
+    }
+    NSTimeInterval deadline = _roundTripTime + 4 * _roundTripTimeVariation;
+    return MIN(MAX(deadline, minimum), maximum);
+}
+
+- (NSDictionary*) sessionState
+{
+    NSMutableDictionary *state = [NSMutableDictionary new];
+    state[@"url"] = self.url.absoluteString;
+    state[@"failures"] = @(self.failures);
+    if (self.clientID != nil) {
+        state[@"clientID"] = self.clientID;
+    }
+    NSData *advice = [NSJSONSerialization dataWithJSONObject: self.advice ?: @{} options: 0 error: NULL];
+    if (advice != nil) {
+        state[@"advice"] = advice;
+    }
+    if (_roundTripTime > 0) {
+        state[@"roundTripTime"] = @(_roundTripTime);
+        state[@"roundTripTimeVariation"] = @(_roundTripTimeVariation);
+    }
+    // Anything mid-flight is as good as unsubscribed after a restart.
+    state[@"subscribed"] = [self.channelStatus channelsWithStatus: FayeChannelSubscriptionStatusSubscribed];
+    return state;
+}
+
+- (void) restoreSessionState:(NSDictionary *)state
+{
+    self.failures = [state[@"failures"] integerValue];
+    self.clientID = state[@"clientID"];
+    NSDictionary *advice = nil;
+    if ([state[@"advice"] isKindOfClass: [NSData class]]) {
+        advice = [NSJSONSerialization JSONObjectWithData: state[@"advice"] options: 0 error: NULL];
+    }
+    if ([advice isKindOfClass: [NSDictionary class]] && advice.count > 0) {
+        self.advice = advice;
+    }
+    _roundTripTime = [state[@"roundTripTime"] doubleValue];
+    _roundTripTimeVariation = [state[@"roundTripTimeVariation"] doubleValue];
+    [self.channelStatus removeAllStatuses];
+    for (NSString *channel in state[@"subscribed"]) {
+        [self.channelStatus setStatus: FayeChannelSubscriptionStatusSubscribed forChannel: channel];
+    }
+}
+
 - (NSString*) reconnectAdvice
 {
     return self.advice[@"reconnect"];
@@ -0,0 +1,72 @@
+/* The MIT License
+ 
+ Copyright (c) 2011 Paul Crawford
+ Copyright (c) 2013 Tyrone Trevorrow
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+//
+//  FayeWeakDelegate.m
+//  FayeObjC
+//
+
+
+
+#import "FayeWeakDelegate.h"
+
+@implementation FayeWeakDelegate {
+    __weak id _target;
+    // Kept so there's a signature to hand out after the target has gone.
+    Class _targetClass;
+}
+
+- (id) initWithTarget:(id)target
+{
+    _target = target;
+    _targetClass = [target class];
+    return self;
+}
+
+- (BOOL) respondsToSelector:(SEL)selector
+{
+    return [_targetClass instancesRespondToSelector: selector];
+}
+
+- (BOOL) conformsToProtocol:(Protocol *)protocol
+{
+    return [_targetClass conformsToProtocol: protocol];
+}
+
+- (id) forwardingTargetForSelector:(SEL)selector
+{
+    return _target;
+}
+
+- (NSMethodSignature*) methodSignatureForSelector:(SEL)selector
+{
+    return [_targetClass instanceMethodSignatureForSelector: selector] ?:
+        [NSObject instanceMethodSignatureForSelector: @selector(init)];
+}
+
+- (void) forwardInvocation:(NSInvocation *)invocation
+{
+    // Only reached once the target has gone.
+}
+
+@end
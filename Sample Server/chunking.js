@@ -0,0 +1,123 @@
+// Frame size limits and chunked publishes, the server half of
+// FayeClient.maximumFrameSize.
+//
+// A publish too big for one frame travels as several publishes on the same
+// channel, each with a base64 slice of the JSON-encoded data and
+// ext.chunk = { id: originalId, index: i, count: n }.  The server passes
+// chunks from clients straight through to subscribers; split() does the
+// chunking for frames the server sends, and Reassembler puts chunks back
+// together for anything server-side that wants whole messages.
+
+var PUBLIC_CHANNEL = /^\/(?!meta\/)/;
+
+var byteLength = function(message) {
+  return Buffer.byteLength(JSON.stringify(message));
+};
+
+var chunk = function(message, maxLength, measure) {
+  var json = Buffer.from(JSON.stringify(message.data)),
+      id = String(message.id),
+      ext = Object.assign({}, message.ext);
+
+  // Size the envelope with the widest index and count this could need.
+  ext.chunk = { id: id, index: json.length, count: json.length };
+  var envelope = measure(Object.assign({}, message, { id: id + '.' + json.length, data: '', ext: ext })),
+      pieceLength = Math.floor((maxLength - envelope) / 4) * 3;
+  if (pieceLength <= 0) return null;
+
+  var count = Math.ceil(json.length / pieceLength),
+      chunks = [];
+  for (var index = 0; index < count; index++) {
+    var chunkExt = Object.assign({}, message.ext);
+    chunkExt.chunk = { id: id, index: index, count: count };
+    chunks.push(Object.assign({}, message, {
+      id:   id + '.' + index,
+      data: json.slice(index * pieceLength, (index + 1) * pieceLength).toString('base64'),
+      ext:  chunkExt
+    }));
+  }
+  return chunks;
+};
+
+// Splits a batch into frames of at most maxFrameSize bytes, in order,
+// chunking oversized publishes.  Returns an array of message arrays.
+exports.split = function(messages, maxFrameSize, measure) {
+  measure = measure || byteLength;
+  if (!maxFrameSize) return [messages];
+
+  var framing = 3,
+      items = [];
+
+  messages.forEach(function(message) {
+    var length = measure(message);
+    if (length + framing <= maxFrameSize) {
+      items.push({ message: message, length: length });
+      return;
+    }
+    var chunks = null;
+    if (message.data !== undefined && message.id !== undefined && PUBLIC_CHANNEL.test(message.channel)) {
+      chunks = chunk(message, maxFrameSize - framing, measure);
+    }
+    (chunks || [message]).forEach(function(piece) {
+      items.push({ message: piece, length: measure(piece) });
+    });
+  });
+
+  var frames = [],
+      frame = [],
+      frameLength = 0;
+  items.forEach(function(item) {
+    if (frame.length > 0 && frameLength + item.length + framing > maxFrameSize) {
+      frames.push(frame);
+      frame = [];
+      frameLength = 0;
+    }
+    frame.push(item.message);
+    frameLength += item.length + 1;
+  });
+  if (frame.length > 0) frames.push(frame);
+  return frames;
+};
+
+exports.isChunk = function(message) {
+  return !!(message.ext && message.ext.chunk && typeof message.data === 'string');
+};
+
+// Collects chunks; add() returns the whole message once its last chunk is in,
+// otherwise null.  Incomplete messages are dropped after `timeout` ms.
+var Reassembler = exports.Reassembler = function(options) {
+  this.timeout = (options && options.timeout) || 30000;
+  this.maxPending = (options && options.maxPending) || 32;
+  this.sets = {};
+};
+
+Reassembler.prototype.add = function(message) {
+  var info = message.ext.chunk,
+      now = Date.now();
+
+  for (var key in this.sets) {
+    if (now - this.sets[key].started > this.timeout) delete this.sets[key];
+  }
+  if (!(info.count > 0 && info.index >= 0 && info.index < info.count)) return null;
+
+  var key = message.channel + '\n' + info.id,
+      set = this.sets[key];
+  if (!set) {
+    if (Object.keys(this.sets).length >= this.maxPending) return null;
+    set = this.sets[key] = { pieces: new Array(info.count), received: 0, started: now };
+  }
+  if (set.pieces.length !== info.count) return null;
+  if (set.pieces[info.index] === undefined) {
+    set.pieces[info.index] = message.data;
+    set.received++;
+  }
+  if (set.received < set.pieces.length) return null;
+  delete this.sets[key];
+
+  var json = Buffer.concat(set.pieces.map(function(piece) { return Buffer.from(piece, 'base64'); }));
+  var ext = Object.assign({}, message.ext);
+  delete ext.chunk;
+  var whole = Object.assign({}, message, { id: info.id, data: JSON.parse(json.toString('utf8')), ext: ext });
+  if (Object.keys(ext).length === 0) delete whole.ext;
+  return whole;
+};
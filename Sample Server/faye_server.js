@@ -1,11 +1,24 @@
 var http = require('http'),
-    faye = require('faye');
+    faye = require('faye'),
+    WebSocket = require('faye-websocket'),
+    msgpack = require('./msgpack'),
+    sequencing = require('./sequencing'),
+    chunking = require('./chunking'),
+    rpc = require('./rpc');
 
 var bayeux = new faye.NodeAdapter({
   mount:    '/faye',
   timeout:  45
 });
 
+bayeux.addExtension(sequencing.extension({ historySize: 100 }));
+
+// Answers requests on /rpc/echo with what was sent, for trying out
+// -[FayeClient sendRequest:toChannel:completionHandler:].
+rpc.responder(bayeux, '/rpc/echo', function(data, respond) {
+  respond(null, { echo: data, time: new Date().toString() });
+});
+
 // Handle non-Bayeux requests
 var server = http.createServer(function(request, response) {
   response.writeHead(200, {'Content-Type': 'text/plain'});
@@ -14,6 +27,91 @@ var server = http.createServer(function(request, response) {
 });
 
 bayeux.attach(server);
+
+// Faye's own WebSocket handler only speaks JSON text frames.  Replace it with
+// one that also understands MessagePack binary frames, negotiated through the
+// handshake ext the same way FayeClient does it.  This leans on the adapter's
+// internal Server object, which is fine for a test server.
+server.removeAllListeners('upgrade');
+server.on('upgrade', function(request, socket, head) {
+  if (!WebSocket.isWebSocket(request)) return socket.end();
+
+  var ws = new WebSocket(request, socket, head),
+      clientId = null,
+      binary = false,
+      maxFrameSize = 0;
+
+  var encode = function(messages) {
+    return binary ? msgpack.encode(messages) : JSON.stringify(messages);
+  };
+
+  var measure = function(message) {
+    return binary ? msgpack.encode(message).length : Buffer.byteLength(JSON.stringify(message));
+  };
+
+  // Honour the client's frame size limit, chunking oversized publishes.
+  var send = function(messages) {
+    if (!ws) return;
+    chunking.split(messages, maxFrameSize, measure).forEach(function(frame) {
+      ws.send(encode(frame));
+    });
+  };
+
+  var decode = function(data) {
+    if (msgpack.looksLikeMessagePack(data)) return msgpack.decode(data);
+    return JSON.parse(data.toString('utf8'));
+  };
+
+  // The engine only ever calls send() with a JSON string.
+  var deliverySocket = {
+    send:  function(json) { send([].concat(JSON.parse(json))); },
+    close: function() { if (ws) ws.close(); }
+  };
+
+  ws.onmessage = function(event) {
+    var messages;
+    try {
+      messages = [].concat(decode(event.data));
+    } catch (e) {
+      return ws.close();
+    }
+
+    var wantsBinary = messages.some(function(message) {
+      return message.channel === '/meta/handshake' && message.ext &&
+             [].concat(message.ext.encodings || []).indexOf('msgpack') >= 0;
+    });
+
+    messages.forEach(function(message) {
+      if (message.channel === '/meta/handshake' && message.ext && message.ext.maxFrameSize > 0) {
+        maxFrameSize = message.ext.maxFrameSize;
+      }
+      if (message.channel === '/meta/connect' && message.clientId) {
+        clientId = message.clientId;
+        bayeux._server.openSocket(clientId, deliverySocket, request);
+      }
+    });
+
+    bayeux._server.process(messages, request, function(replies) {
+      if (wantsBinary) {
+        replies.forEach(function(reply) {
+          if (reply.channel === '/meta/handshake' && reply.successful) {
+            reply.ext = reply.ext || {};
+            reply.ext.encoding = 'msgpack';
+          }
+        });
+      }
+      send(replies);
+      // The handshake reply itself goes out as JSON; everything after it doesn't.
+      if (wantsBinary) binary = true;
+    });
+  };
+
+  ws.onclose = function() {
+    if (clientId) bayeux._server.closeSocket(clientId, false);
+    ws = null;
+  };
+});
+
 server.listen(8000);
 
 var cli = bayeux.getClient();
@@ -0,0 +1,190 @@
+// Minimal MessagePack codec, matching FayeMessagePack on the Objective-C side.
+// Only the types Bayeux messages can contain are supported: nil, booleans,
+// integers, doubles, strings, binary, arrays and maps.
+
+function encode(value) {
+  var chunks = [];
+  write(value, chunks);
+  return Buffer.concat(chunks);
+}
+
+function header(type, length, width) {
+  var buffer = Buffer.alloc(1 + width);
+  buffer[0] = type;
+  if (width === 1) buffer.writeUInt8(length, 1);
+  if (width === 2) buffer.writeUInt16BE(length, 1);
+  if (width === 4) buffer.writeUInt32BE(length, 1);
+  return buffer;
+}
+
+function lengthHeader(length, fixBase, fixMax, type8, type16, type32) {
+  if (length <= fixMax) return Buffer.from([fixBase | length]);
+  if (type8 && length <= 0xff) return header(type8, length, 1);
+  if (length <= 0xffff) return header(type16, length, 2);
+  return header(type32, length, 4);
+}
+
+function writeInteger(value, chunks) {
+  var buffer;
+  if (value >= 0) {
+    if (value <= 0x7f)            return chunks.push(Buffer.from([value]));
+    if (value <= 0xff)            return chunks.push(header(0xcc, value, 1));
+    if (value <= 0xffff)          return chunks.push(header(0xcd, value, 2));
+    if (value <= 0xffffffff)      return chunks.push(header(0xce, value, 4));
+    buffer = Buffer.alloc(9);
+    buffer[0] = 0xcf;
+    buffer.writeBigUInt64BE(BigInt(value), 1);
+    return chunks.push(buffer);
+  }
+  if (value >= -32) return chunks.push(Buffer.from([value & 0xff]));
+  if (value >= -0x80) {
+    buffer = Buffer.alloc(2); buffer[0] = 0xd0; buffer.writeInt8(value, 1);
+  } else if (value >= -0x8000) {
+    buffer = Buffer.alloc(3); buffer[0] = 0xd1; buffer.writeInt16BE(value, 1);
+  } else if (value >= -0x80000000) {
+    buffer = Buffer.alloc(5); buffer[0] = 0xd2; buffer.writeInt32BE(value, 1);
+  } else {
+    buffer = Buffer.alloc(9); buffer[0] = 0xd3; buffer.writeBigInt64BE(BigInt(value), 1);
+  }
+  chunks.push(buffer);
+}
+
+function write(value, chunks) {
+  if (value === null || value === undefined) {
+    chunks.push(Buffer.from([0xc0]));
+  } else if (value === true || value === false) {
+    chunks.push(Buffer.from([value ? 0xc3 : 0xc2]));
+  } else if (typeof value === 'number') {
+    if (Number.isSafeInteger(value)) {
+      writeInteger(value, chunks);
+    } else {
+      var buffer = Buffer.alloc(9);
+      buffer[0] = 0xcb;
+      buffer.writeDoubleBE(value, 1);
+      chunks.push(buffer);
+    }
+  } else if (typeof value === 'string') {
+    var string = Buffer.from(value, 'utf8');
+    chunks.push(lengthHeader(string.length, 0xa0, 31, 0xd9, 0xda, 0xdb), string);
+  } else if (Buffer.isBuffer(value)) {
+    chunks.push(lengthHeader(value.length, 0, -1, 0xc4, 0xc5, 0xc6), value);
+  } else if (Array.isArray(value)) {
+    chunks.push(lengthHeader(value.length, 0x90, 15, 0, 0xdc, 0xdd));
+    value.forEach(function(element) { write(element, chunks); });
+  } else if (typeof value === 'object') {
+    if (typeof value.toJSON === 'function') return write(value.toJSON(), chunks);
+    var keys = Object.keys(value).filter(function(key) { return value[key] !== undefined; });
+    chunks.push(lengthHeader(keys.length, 0x80, 15, 0, 0xde, 0xdf));
+    keys.forEach(function(key) {
+      write(key, chunks);
+      write(value[key], chunks);
+    });
+  } else {
+    throw new Error('MessagePack: cannot encode ' + typeof value);
+  }
+}
+
+function decode(buffer) {
+  var offset = 0;
+
+  function need(bytes) {
+    if (offset + bytes > buffer.length) throw new Error('MessagePack: truncated data');
+  }
+
+  function bytes(length) {
+    need(length);
+    var slice = buffer.slice(offset, offset + length);
+    offset += length;
+    return slice;
+  }
+
+  function uint(width) {
+    need(width);
+    var value = width === 1 ? buffer.readUInt8(offset)
+              : width === 2 ? buffer.readUInt16BE(offset)
+              : width === 4 ? buffer.readUInt32BE(offset)
+              : Number(buffer.readBigUInt64BE(offset));
+    offset += width;
+    return value;
+  }
+
+  function int(width) {
+    need(width);
+    var value = width === 1 ? buffer.readInt8(offset)
+              : width === 2 ? buffer.readInt16BE(offset)
+              : width === 4 ? buffer.readInt32BE(offset)
+              : Number(buffer.readBigInt64BE(offset));
+    offset += width;
+    return value;
+  }
+
+  function array(count) {
+    var result = [];
+    for (var i = 0; i < count; i++) result.push(read());
+    return result;
+  }
+
+  function map(count) {
+    var result = {};
+    for (var i = 0; i < count; i++) {
+      var key = read();
+      result[key] = read();
+    }
+    return result;
+  }
+
+  function read() {
+    need(1);
+    var type = buffer[offset++], value;
+    if (type <= 0x7f) return type;
+    if (type >= 0xe0) return type - 0x100;
+    if ((type & 0xf0) === 0x80) return map(type & 0x0f);
+    if ((type & 0xf0) === 0x90) return array(type & 0x0f);
+    if ((type & 0xe0) === 0xa0) return bytes(type & 0x1f).toString('utf8');
+
+    switch (type) {
+      case 0xc0: return null;
+      case 0xc2: return false;
+      case 0xc3: return true;
+      case 0xc4: return bytes(uint(1));
+      case 0xc5: return bytes(uint(2));
+      case 0xc6: return bytes(uint(4));
+      case 0xca: need(4); value = buffer.readFloatBE(offset); offset += 4; return value;
+      case 0xcb: need(8); value = buffer.readDoubleBE(offset); offset += 8; return value;
+      case 0xcc: return uint(1);
+      case 0xcd: return uint(2);
+      case 0xce: return uint(4);
+      case 0xcf: return uint(8);
+      case 0xd0: return int(1);
+      case 0xd1: return int(2);
+      case 0xd2: return int(4);
+      case 0xd3: return int(8);
+      case 0xd9: return bytes(uint(1)).toString('utf8');
+      case 0xda: return bytes(uint(2)).toString('utf8');
+      case 0xdb: return bytes(uint(4)).toString('utf8');
+      case 0xdc: return array(uint(2));
+      case 0xdd: return array(uint(4));
+      case 0xde: return map(uint(2));
+      case 0xdf: return map(uint(4));
+      default:   throw new Error('MessagePack: unsupported type 0x' + type.toString(16));
+    }
+  }
+
+  var result = read();
+  if (offset !== buffer.length) throw new Error('MessagePack: trailing data');
+  return result;
+}
+
+// Bayeux batches are arrays, and a MessagePack array header can never be
+// mistaken for the '[' that starts a JSON one.
+function looksLikeMessagePack(buffer) {
+  if (!Buffer.isBuffer(buffer) || buffer.length === 0) return false;
+  var first = buffer[0];
+  return (first & 0xf0) === 0x90 || first === 0xdc || first === 0xdd;
+}
+
+module.exports = {
+  encode: encode,
+  decode: decode,
+  looksLikeMessagePack: looksLikeMessagePack
+};
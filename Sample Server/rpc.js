@@ -0,0 +1,42 @@
+// Request/response, the server half of -[FayeClient sendRequest:toChannel:...].
+//
+// A request is an ordinary publish carrying ext.replyTo (the client's reply
+// channel) and ext.correlationId.  A responder answers by publishing to
+// replyTo with the same ext.correlationId, and ext.error in place of a result
+// if the request failed.
+
+// Calls handler(data, respond) for every request published to `channel`;
+// respond(error, result) sends the answer back.
+exports.responder = function(bayeux, channel, handler) {
+  var client = bayeux.getClient();
+
+  // Publishes from a server-side client can't set ext, so answers go out
+  // wrapped and are unwrapped on their way through.
+  client.addExtension({
+    outgoing: function(message, callback) {
+      var answer = message.data && message.data.rpcAnswer;
+      if (answer) {
+        message.ext = message.ext || {};
+        message.ext.correlationId = answer.correlationId;
+        if (answer.error !== undefined) message.ext.error = answer.error;
+        message.data = answer.result;
+      }
+      callback(message);
+    }
+  });
+
+  bayeux.addExtension({
+    incoming: function(message, callback) {
+      var ext = message.ext;
+      if (message.channel === channel && message.data !== undefined &&
+          ext && ext.replyTo && ext.correlationId !== undefined) {
+        handler(message.data, function(error, result) {
+          var answer = { correlationId: ext.correlationId, result: error ? {} : result };
+          if (error) answer.error = String(error.message || error);
+          client.publish(ext.replyTo, { rpcAnswer: answer });
+        });
+      }
+      callback(message);
+    }
+  });
+};
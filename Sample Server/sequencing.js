@@ -0,0 +1,86 @@
+// Per-channel sequence numbers and a bounded replay history, the server half of
+// FayeChannelSubscriptionOptionSequenced.
+//
+// Every published message gets ext.seq, counting up from 1 per channel.  The
+// last `historySize` messages on each channel are kept, and a /meta/subscribe
+// carrying ext.replay = { channel: lastSeenSeq, ... } gets the messages the
+// client missed back in the subscribe reply's ext.replay.
+
+var PUBLIC_CHANNEL = /^\/(?!meta\/|service\/)/;
+
+function Ring(size) {
+  this.size = size;
+  this.items = [];
+  this.start = 0;
+}
+
+Ring.prototype.push = function(item) {
+  if (this.items.length < this.size) {
+    this.items.push(item);
+  } else {
+    this.items[this.start] = item;
+    this.start = (this.start + 1) % this.size;
+  }
+};
+
+Ring.prototype.since = function(seq) {
+  var result = [];
+  for (var i = 0; i < this.items.length; i++) {
+    var item = this.items[(this.start + i) % this.items.length];
+    if (item.ext.seq > seq) result.push(item);
+  }
+  return result;
+};
+
+exports.extension = function(options) {
+  var historySize = (options && options.historySize) || 100,
+      sequences = {},
+      histories = {},
+      pendingReplays = {};
+
+  return {
+    incoming: function(message, callback) {
+      if (message.channel === '/meta/subscribe') {
+        if (message.ext && message.ext.replay) {
+          pendingReplays[message.clientId + ' ' + message.subscription] = message.ext.replay;
+        }
+      } else if (PUBLIC_CHANNEL.test(message.channel) && message.data !== undefined) {
+        var channel = message.channel,
+            seq = sequences[channel] = (sequences[channel] || 0) + 1;
+
+        message.ext = message.ext || {};
+        message.ext.seq = seq;
+
+        histories[channel] = histories[channel] || new Ring(historySize);
+        histories[channel].push({
+          channel: channel,
+          id:      message.id,
+          data:    message.data,
+          ext:     { seq: seq }
+        });
+      }
+      callback(message);
+    },
+
+    outgoing: function(message, callback) {
+      if (message.channel !== '/meta/subscribe') return callback(message);
+
+      var key = message.clientId + ' ' + message.subscription,
+          positions = pendingReplays[key];
+
+      delete pendingReplays[key];
+      if (!message.successful || !positions) return callback(message);
+
+      var replay = [];
+      Object.keys(positions).forEach(function(channel) {
+        if (histories[channel]) {
+          replay = replay.concat(histories[channel].since(positions[channel]));
+        }
+      });
+
+      message.ext = message.ext || {};
+      message.ext.replay = replay;
+      callback(message);
+    }
+  };
+};